@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "backoff.h"
+#include <gnutls/gnutls.h>
+#include <gnutls/crypto.h>
+
+Backoff::Backoff(unsigned base_ms, unsigned cap_ms, unsigned threshold,
+                 unsigned cooldown_ms)
+{
+    this->base_ms = base_ms;
+    this->cap_ms = cap_ms;
+    this->threshold = threshold;
+    this->cooldown_ms = cooldown_ms;
+    this->failures = 0;
+}
+
+/* qrand() starts from the same seed in every process, which would give
+ * every client the same "random" delays */
+unsigned Backoff::random(unsigned max)
+{
+    uint32_t r = 0;
+
+    if (max == 0)
+        return 0;
+    gnutls_rnd(GNUTLS_RND_NONCE, &r, sizeof(r));
+    return r % (max + 1);
+}
+
+unsigned Backoff::failure()
+{
+    uint64_t ceiling;
+
+    failures++;
+
+    /* open: half to all of the cool-down, for a single probe */
+    if (failures >= threshold)
+        return cooldown_ms / 2 + random(cooldown_ms / 2);
+
+    ceiling = (uint64_t) base_ms << (failures - 1 < 20 ? failures - 1 : 20);
+    if (ceiling > cap_ms)
+        ceiling = cap_ms;
+    return random(ceiling);
+}
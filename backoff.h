@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <stdint.h>
+
+/* Delays between the attempts to re-establish a session. The delay is
+ * drawn uniformly from zero to an exponentially growing ceiling (full
+ * jitter), so that clients which lost the gateway at the same moment do
+ * not come back at the same moment. After a run of failures the breaker
+ * opens: attempts are then a long cool-down apart, each of them a single
+ * probe, until one succeeds.
+ */
+class Backoff {
+ public:
+    Backoff(unsigned base_ms, unsigned cap_ms, unsigned threshold,
+            unsigned cooldown_ms);
+
+    /* records a failed attempt (or the loss of the session) and returns
+     * the delay before the next one */
+    unsigned failure();
+    void success() {
+        failures = 0;
+    }
+
+    unsigned get_failures() {
+        return failures;
+    }
+    bool is_open() {
+        return failures >= threshold;
+    }
+
+ private:
+    unsigned random(unsigned max);
+
+    unsigned base_ms;
+    unsigned cap_ms;
+    unsigned threshold;
+    unsigned cooldown_ms;
+    unsigned failures;
+};
+
+#endif                          // BACKOFF_H
@@ -35,16 +35,31 @@
 #define TMP_CERT_PREFIX "tmp-certXXXXXX"
 #define TMP_KEY_PREFIX "tmp-keyXXXXXX"
 
-#define OFF_ICON QPixmap(QString::fromLatin1(":/new/resource/traffic_light_red.png"))
-#define ON_ICON QPixmap(QString::fromLatin1(":/new/resource/traffic_light_green.png"))
-#define CONNECTING_ICON QPixmap(QString::fromLatin1(":/new/resource/traffic_light_yellow.png"))
-#define CONNECTING_ICON2 QPixmap(QString::fromLatin1(":/new/resource/traffic_light_off.png"))
+/* these are decoded once into MainWindow's icon cache */
+#define OFF_ICON ":/new/resource/traffic_light_red.png"
+#define ON_ICON ":/new/resource/traffic_light_green.png"
+#define CONNECTING_ICON ":/new/resource/traffic_light_yellow.png"
+#define CONNECTING_ICON2 ":/new/resource/traffic_light_off.png"
 
-#define TRAY_OFF_ICON QPixmap(QString::fromLatin1(":/new/resource/network-disconnected.png"))
-#define TRAY_ON_ICON QPixmap(QString::fromLatin1(":/new/resource/network-connected.png"))
+#define TRAY_OFF_ICON ":/new/resource/network-disconnected.png"
+#define TRAY_ON_ICON ":/new/resource/network-connected.png"
+
+#define BLINK_TIMER 1500
+/* how long to wait for the VPN thread to log off on exit, before exiting
+ * without it */
+#define SHUTDOWN_TIMEOUT 10000
 
 #define UPDATE_TIMER 10000
 
+/* re-establishing a lost session: the backoff ceiling starts at the base
+ * and doubles up to the cap; after the given number of failures the
+ * attempts are a cool-down apart. The wait is polled for a disconnect. */
+#define REBUILD_BACKOFF_BASE 1000
+#define REBUILD_BACKOFF_CAP (5*60*1000)
+#define REBUILD_BREAKER_FAILURES 10
+#define REBUILD_BREAKER_COOLDOWN (30*60*1000)
+#define REBUILD_POLL 100
+
 #ifdef _WIN32
 #define DEFAULT_VPNC_SCRIPT "vpnc-script.js"
 #define net_errno WSAGetLastError()
@@ -67,8 +82,33 @@
 #define USE_SYSTEM_KEYS
 #endif
 
+/* the userspace tun data path needs /dev/net/tun, and path MTU probing
+ * unprivileged ping sockets; the native network configuration uses
+ * rtnetlink, and the script runner of the tun data path as its fallback */
+#ifdef __linux__
+#define USE_TUN_PUMP
+#define USE_MTU_PROBE
+#define USE_NETLINK
+#endif
+
+/* the caching DNS stub is installed through the vpnc-script's shell
+ * environment */
+#ifndef _WIN32
+#define USE_DNS_PROXY
+#endif
+
+/* the vpnc-script output is streamed through a FIFO on POSIX systems; on
+ * Windows the script writes vpnc.log, read once it is done */
+#ifndef _WIN32
+#define USE_SCRIPT_LOG
+#endif
+
 #include <QString>
 
+/* prints the time spent since startup when OPENCONNECT_GUI_STARTUP_TIMING
+ * is set in the environment */
+void startup_mark(const char *phase);
+
 inline bool is_url(QString & str)
 {
     if (str.startsWith("system:") ||
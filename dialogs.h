@@ -26,6 +26,15 @@
 #include <QApplication>
 #include <QMutex>
 
+/* a prompt of the session thread queued just before a disconnect (or
+ * quit) was requested is answered as cancelled, not shown */
+static inline bool prompt_cancelled(QWidget * w)
+{
+    MainWindow *m = qobject_cast < MainWindow * >(w);
+
+    return m != NULL && m->disconnect_requested() == true;
+}
+
 /* These input dialogs work from a different to main thread */
 class MyInputDialog:public QObject {
 
@@ -60,7 +69,9 @@ class MyInputDialog:public QObject {
     virtual bool event(QEvent * ev) {
         res = false;
         if (ev->type() == QEvent::User) {
-            if (this->have_list)
+            if (prompt_cancelled(w) == true)
+                res = false;
+            else if (this->have_list)
                 text = QInputDialog::getItem(w, t1, t2, list, 0, true, &res);
             else
                 text = QInputDialog::getText(w, t1, t2, type, QString(), &res);
@@ -109,7 +120,9 @@ class MyMsgBox:public QObject {
     }
     virtual bool event(QEvent * ev) {
         res = false;
-        if (ev->type() == QEvent::User) {
+        if (ev->type() == QEvent::User && prompt_cancelled(w) == true) {
+            mutex.unlock();
+        } else if (ev->type() == QEvent::User) {
             QMessageBox *msgBox = new QMessageBox(w);
             int ret;
 
@@ -168,7 +181,9 @@ class MyCertMsgBox:public QObject {
     }
     virtual bool event(QEvent * ev) {
         res = false;
-        if (ev->type() == QEvent::User) {
+        if (ev->type() == QEvent::User && prompt_cancelled(w) == true) {
+            mutex.unlock();
+        } else if (ev->type() == QEvent::User) {
             QMessageBox *msgBox = new QMessageBox(w);
             int ret;
 
@@ -0,0 +1,852 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dnsproxy.h"
+
+#ifdef USE_DNS_PROXY
+
+extern "C" {
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+}
+#include <gnutls/gnutls.h>
+#include <gnutls/crypto.h>
+
+#define DNS_MAX_PACKET 4096
+#define DNS_RETRY_TIME 1000     /* ms before asking the next server */
+#define DNS_MAX_TRIES 3
+#define DNS_MAX_TTL 86400
+#define DNS_CACHE_MAX 10000
+#define DNS_TYPE_OPT 41
+#define DNS_MAX_INFLIGHT 512    /* each holds a socket */
+#define DNS_TCP_MAX 16          /* client connections */
+#define DNS_TCP_TIMEOUT 5000    /* ms for a query over TCP */
+#define DNS_TCP_IDLE 10000      /* ms before an idle connection is closed */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline unsigned get16(const uint8_t * p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t get32(const uint8_t * p)
+{
+    return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline void put16(uint8_t * p, unsigned v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+static inline void put32(uint8_t * p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+/* returns the offset after the name, or zero */
+static size_t skip_name(const uint8_t * pkt, size_t len, size_t off)
+{
+    unsigned c;
+
+    while (off < len) {
+        c = pkt[off];
+        if (c == 0)
+            return off + 1;
+        if ((c & 0xc0) == 0xc0)
+            return off + 2 <= len ? off + 2 : 0;
+        if (c & 0xc0)
+            return 0;
+        off += c + 1;
+    }
+    return 0;
+}
+
+/* Reads the single question of a message into a cache key (the name in
+ * lower case, the type and the class); returns the offset after it, or
+ * zero.
+ */
+static size_t parse_question(const uint8_t * pkt, size_t len,
+                             std::string & key)
+{
+    size_t off = 12;
+    unsigned c, i;
+    char buf[16];
+
+    if (len < 12 || get16(pkt + 4) != 1)
+        return 0;
+
+    key.clear();
+    while (off < len) {
+        c = pkt[off++];
+        if (c == 0)
+            break;
+        if ((c & 0xc0) || off + c > len)
+            return 0;
+        for (i = 0; i < c; i++) {
+            char ch = pkt[off + i];
+            if (ch >= 'A' && ch <= 'Z')
+                ch += 'a' - 'A';
+            key += ch;
+        }
+        key += '.';
+        off += c;
+    }
+    if (off + 4 > len)
+        return 0;
+
+    snprintf(buf, sizeof(buf), "/%u/%u", get16(pkt + off),
+             get16(pkt + off + 2));
+    key += buf;
+    return off + 4;
+}
+
+/* Walks the resource records after the question; returns the smallest
+ * TTL found, or -1 if the message cannot be parsed. With age > 0 the TTLs
+ * are reduced by that many seconds.
+ */
+static long walk_ttls(uint8_t * pkt, size_t len, size_t off, uint32_t age)
+{
+    unsigned count, i, type, rdlen;
+    long min = -1;
+    uint32_t ttl;
+
+    count = get16(pkt + 6) + get16(pkt + 8) + get16(pkt + 10);
+    for (i = 0; i < count; i++) {
+        off = skip_name(pkt, len, off);
+        if (off == 0 || off + 10 > len)
+            return -1;
+
+        type = get16(pkt + off);
+        ttl = get32(pkt + off + 4);
+        rdlen = get16(pkt + off + 8);
+
+        /* the TTL field of OPT carries flags */
+        if (type != DNS_TYPE_OPT) {
+            if (min == -1 || ttl < (uint32_t) min)
+                min = ttl;
+            if (age > 0)
+                put32(pkt + off + 4, ttl > age ? ttl - age : 0);
+        }
+        off += 10 + rdlen;
+        if (off > len)
+            return -1;
+    }
+    return min;
+}
+
+DnsProxy::DnsProxy()
+{
+    listen_fd = -1;
+    tcp_fd = -1;
+    stop_pipe[0] = stop_pipe[1] = -1;
+    use_cache = true;
+    memset(&stats, 0, sizeof(stats));
+}
+
+DnsProxy::~DnsProxy()
+{
+    std::map < std::string, pending >::iterator it;
+    unsigned i;
+
+    stop();
+    for (it = inflight.begin(); it != inflight.end(); ++it) {
+        if (it->second.fd != -1)
+            close(it->second.fd);
+    }
+    for (i = 0; i < tcp.size(); i++)
+        tcp_close(tcp[i]);
+    if (listen_fd != -1)
+        close(listen_fd);
+    if (tcp_fd != -1)
+        close(tcp_fd);
+    if (stop_pipe[0] != -1) {
+        close(stop_pipe[0]);
+        close(stop_pipe[1]);
+    }
+}
+
+bool DnsProxy::add_server(const char *addr, bool local)
+{
+    struct sockaddr_storage ss;
+    struct sockaddr_in *s4 = (struct sockaddr_in *)&ss;
+    struct sockaddr_in6 *s6 = (struct sockaddr_in6 *)&ss;
+
+    memset(&ss, 0, sizeof(ss));
+    if (inet_pton(AF_INET, addr, &s4->sin_addr) == 1) {
+        s4->sin_family = AF_INET;
+        s4->sin_port = htons(53);
+    } else if (inet_pton(AF_INET6, addr, &s6->sin6_addr) == 1) {
+        s6->sin6_family = AF_INET6;
+        s6->sin6_port = htons(53);
+    } else {
+        return false;
+    }
+    if (local)
+        local_servers.push_back(ss);
+    else
+        servers.push_back(ss);
+    return true;
+}
+
+static bool is_loopback(const struct sockaddr_storage *ss)
+{
+    const struct sockaddr_in *s4 = (const struct sockaddr_in *)ss;
+    const struct sockaddr_in6 *s6 = (const struct sockaddr_in6 *)ss;
+
+    if (ss->ss_family == AF_INET)
+        return (ntohl(s4->sin_addr.s_addr) >> 24) == 127;
+    return IN6_IS_ADDR_LOOPBACK(&s6->sin6_addr);
+}
+
+/* Loopback resolvers are skipped: a local caching daemon may itself be
+ * pointed at this stub by the script, and would send the queries back.
+ * For systemd-resolved, RESOLVED_CONF gives the servers behind it.
+ */
+unsigned DnsProxy::add_local_servers(const char *resolv_conf)
+{
+    char line[256], addr[128];
+    unsigned n = 0;
+    FILE *fp;
+
+    fp = fopen(resolv_conf, "r");
+    if (fp == NULL)
+        return 0;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, " nameserver %127s", addr) != 1)
+            continue;
+        if (add_server(addr, true) == false)
+            continue;
+        if (is_loopback(&local_servers.back())) {
+            local_servers.pop_back();
+            continue;
+        }
+        n++;
+    }
+    fclose(fp);
+    return n;
+}
+
+int DnsProxy::setup(std::string & err)
+{
+    struct sockaddr_in sa;
+    int one = 1;
+
+    if (servers.empty()) {
+        err = "no DNS servers";
+        return -1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(53);
+    inet_pton(AF_INET, DNS_PROXY_ADDR, &sa.sin_addr);
+
+    listen_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+        goto fail;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(listen_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+        goto fail;
+
+    /* without it, clients would get truncated answers and nowhere to
+     * retry; the stub is then not installed */
+    tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (tcp_fd < 0)
+        goto fail;
+    setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(tcp_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0
+        || listen(tcp_fd, DNS_TCP_MAX) < 0)
+        goto fail;
+
+    if (pipe2(stop_pipe, O_CLOEXEC) < 0) {
+        stop_pipe[0] = stop_pipe[1] = -1;
+        goto fail;
+    }
+    return 0;
+
+ fail:
+    err = strerror(errno);
+    return -1;
+}
+
+void DnsProxy::stop()
+{
+    char c = 0;
+
+    if (this->isRunning() == false)
+        return;
+
+    if (write(stop_pipe[1], &c, 1) < 0)
+        return;
+    this->wait();
+}
+
+void DnsProxy::get_stats(struct dns_stats *s)
+{
+    QMutexLocker locker(&mutex);
+    *s = stats;
+}
+
+void DnsProxy::reply(const waiter & w, std::vector < uint8_t > answer,
+                     uint64_t age)
+{
+    size_t qend;
+    std::string key;
+
+    put16(&answer[0], w.id);
+    /* echo the case of the client's question */
+    memcpy(&answer[12], &w.question[0], w.question.size());
+
+    if (age > 0) {
+        qend = parse_question(&answer[0], answer.size(), key);
+        if (qend != 0)
+            walk_ttls(&answer[0], answer.size(), qend, age);
+    }
+
+    sendto(listen_fd, &answer[0], answer.size(), 0,
+           (const struct sockaddr *)&w.addr, w.addr_len);
+}
+
+struct sockaddr_storage *DnsProxy::server_of(const struct pending *p)
+{
+    if (p->local)
+        return &local_servers[p->server % local_servers.size()];
+    return &servers[p->server % servers.size()];
+}
+
+/* a socket connected to the server; the kernel picks a random source
+ * port, and drops datagrams from anywhere else */
+static int open_upstream(const struct sockaddr_storage *s, int type)
+{
+    socklen_t len = s->ss_family == AF_INET6 ?
+        sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+    int fd;
+
+    fd = socket(s->ss_family, type | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (const struct sockaddr *)s, len) < 0
+        && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static uint16_t random_id(void)
+{
+    uint16_t id = 0;
+
+    gnutls_rnd(GNUTLS_RND_NONCE, &id, sizeof(id));
+    return id;
+}
+
+/* every try goes out with a new id from a new port */
+void DnsProxy::forward(const std::string & key, struct pending *p)
+{
+    if (p->fd != -1) {
+        by_fd.erase(p->fd);
+        close(p->fd);
+    }
+
+    p->upstream_id = random_id();
+    put16(&p->query[0], p->upstream_id);
+    p->fd = open_upstream(server_of(p), SOCK_DGRAM);
+    if (p->fd != -1) {
+        by_fd[p->fd] = key;
+        send(p->fd, &p->query[0], p->query.size(), 0);
+    }
+    p->sent = now_ms();
+    p->tries++;
+}
+
+void DnsProxy::finish(std::map < std::string, pending >::iterator it)
+{
+    if (it->second.fd != -1) {
+        by_fd.erase(it->second.fd);
+        close(it->second.fd);
+    }
+    inflight.erase(it);
+}
+
+/* whether the name goes to the local resolvers */
+bool DnsProxy::route_local(const uint8_t * pkt, size_t qend)
+{
+    uint64_t start;
+    bool local;
+
+    if (get_split() == false)
+        return false;
+
+    start = now_ns();
+    local = split.match_wire(pkt + 12, qend - 12) == false;
+
+    QMutexLocker locker(&mutex);
+    stats.route_ns += now_ns() - start;
+    if (local)
+        stats.local++;
+    return local;
+}
+
+void DnsProxy::handle_query(const uint8_t * pkt, size_t len,
+                            struct sockaddr_storage *from, socklen_t from_len)
+{
+    std::map < std::string, cache_entry >::iterator c;
+    std::map < std::string, pending >::iterator it;
+    std::string key;
+    waiter w;
+    size_t qend;
+    uint64_t now = now_ms();
+    bool local;
+
+    QMutexLocker locker(&mutex);
+    stats.queries++;
+
+    /* only plain queries with a single question */
+    qend = parse_question(pkt, len, key);
+    if (qend == 0 || (pkt[2] & 0x80)) {
+        stats.failed++;
+        return;
+    }
+
+    w.addr = *from;
+    w.addr_len = from_len;
+    w.id = get16(pkt);
+    w.question.assign(pkt + 12, pkt + qend);
+
+    c = cache.find(key);
+    if (c != cache.end() && now < c->second.expires) {
+        stats.hits++;
+        locker.unlock();
+        reply(w, c->second.answer, (now - c->second.stored) / 1000);
+        return;
+    }
+
+    it = inflight.find(key);
+    if (it != inflight.end()) {
+        stats.coalesced++;
+        it->second.waiters.push_back(w);
+        return;
+    }
+
+    /* each query holds a socket */
+    if (inflight.size() >= DNS_MAX_INFLIGHT) {
+        stats.failed++;
+        return;
+    }
+    stats.forwarded++;
+    locker.unlock();
+
+    local = route_local(pkt, qend);
+
+    pending & p = inflight[key];
+    p.fd = -1;
+    p.query.assign(pkt, pkt + len);
+    p.waiters.push_back(w);
+    p.server = 0;
+    p.tries = 0;
+    p.local = local;
+
+    forward(key, &p);
+}
+
+void DnsProxy::handle_answer(int fd)
+{
+    uint8_t buf[DNS_MAX_PACKET];
+    std::map < int, std::string >::iterator f;
+    std::map < std::string, pending >::iterator it;
+    std::vector < uint8_t > answer;
+    std::string key;
+    size_t qend;
+    ssize_t len;
+    long ttl;
+    unsigned rcode, i;
+
+    f = by_fd.find(fd);
+    if (f == by_fd.end())
+        return;
+    it = inflight.find(f->second);
+    if (it == inflight.end())
+        return;
+    pending & p = it->second;
+
+    len = recv(fd, buf, sizeof(buf), 0);
+    if (len < 12 || get16(buf) != p.upstream_id)
+        return;
+
+    qend = parse_question(buf, len, key);
+    if (qend == 0 || key != it->first)
+        return;
+
+    answer.assign(buf, buf + len);
+    for (i = 0; i < p.waiters.size(); i++)
+        reply(p.waiters[i], answer, 0);
+
+    /* positive and negative answers are cached; failures and truncated
+     * answers are not */
+    rcode = buf[3] & 0x0f;
+    ttl = walk_ttls(buf, len, qend, 0);
+    if (use_cache && (rcode == 0 || rcode == 3) && (buf[2] & 0x02) == 0
+        && ttl > 0) {
+        cache_entry & e = cache[key];
+        if (ttl > DNS_MAX_TTL)
+            ttl = DNS_MAX_TTL;
+        e.answer = answer;
+        e.stored = now_ms();
+        e.expires = e.stored + ttl * 1000;
+    }
+
+    finish(it);
+}
+
+void DnsProxy::tcp_accept()
+{
+    struct tcp_conn c;
+    int fd;
+
+    fd = accept4(tcp_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0)
+        return;
+    if (tcp.size() >= DNS_TCP_MAX) {
+        close(fd);
+        return;
+    }
+
+    c.fd = fd;
+    c.up = -1;
+    c.state = TCP_READ_QUERY;
+    c.id = 0;
+    c.off = 0;
+    c.since = now_ms();
+    tcp.push_back(c);
+}
+
+void DnsProxy::tcp_close(struct tcp_conn &c)
+{
+    if (c.up != -1)
+        close(c.up);
+    close(c.fd);
+}
+
+/* Reads more of a length-prefixed message into buf; returns 1 once it is
+ * complete, 0 if more is to come, -1 on end of file or an error.
+ */
+static int read_message(int fd, std::vector < uint8_t > &buf)
+{
+    size_t have, want;
+    ssize_t len;
+
+    for (;;) {
+        have = buf.size();
+        want = have < 2 ? 2 : 2 + get16(&buf[0]);
+        if (have == want && have > 2)
+            return 1;
+        if (want < 2 + 12 && have >= 2)
+            return -1;
+
+        buf.resize(want);
+        len = recv(fd, &buf[have], want - have, 0);
+        if (len <= 0) {
+            buf.resize(have);
+            if (len < 0 && (errno == EAGAIN || errno == EINTR))
+                return 0;
+            return -1;
+        }
+        buf.resize(have + len);
+    }
+}
+
+/* returns -1 on an error, 1 once all of buf is sent */
+static int send_message(int fd, const std::vector < uint8_t > &buf,
+                        size_t * off)
+{
+    ssize_t len;
+
+    len = send(fd, &buf[*off], buf.size() - *off, MSG_NOSIGNAL);
+    if (len < 0)
+        return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    *off += len;
+    return *off == buf.size() ? 1 : 0;
+}
+
+/* sends the query in c.buf to the first server for its name */
+bool DnsProxy::tcp_query(struct tcp_conn &c)
+{
+    struct pending p;
+    std::string key;
+    size_t qend;
+
+    qend = parse_question(&c.buf[2], c.buf.size() - 2, key);
+    if (qend == 0 || (c.buf[4] & 0x80))
+        return false;
+
+    {
+        QMutexLocker locker(&mutex);
+        stats.queries++;
+        stats.forwarded++;
+    }
+
+    p.local = route_local(&c.buf[2], qend);
+    p.server = 0;
+    c.up = open_upstream(server_of(&p), SOCK_STREAM);
+    if (c.up < 0)
+        return false;
+
+    c.id = get16(&c.buf[2]);
+    put16(&c.buf[2], random_id());
+    c.off = 0;
+    c.state = TCP_SEND_QUERY;
+    c.since = now_ms();
+    return true;
+}
+
+/* moves a connection on; returns false once it is to be closed */
+bool DnsProxy::tcp_event(struct tcp_conn &c, short revents)
+{
+    int ret, err = 0;
+    socklen_t len = sizeof(err);
+
+    if (revents & (POLLERR | POLLHUP | POLLNVAL))
+        return false;
+
+    switch (c.state) {
+    case TCP_READ_QUERY:
+        ret = read_message(c.fd, c.buf);
+        if (ret == 1)
+            return tcp_query(c);
+        return ret == 0;
+
+    case TCP_SEND_QUERY:
+        if (getsockopt(c.up, SOL_SOCKET, SO_ERROR, &err, &len) < 0
+            || err != 0)
+            return false;
+        ret = send_message(c.up, c.buf, &c.off);
+        if (ret == 1) {
+            c.buf.clear();
+            c.state = TCP_READ_ANSWER;
+        }
+        return ret >= 0;
+
+    case TCP_READ_ANSWER:
+        ret = read_message(c.up, c.buf);
+        if (ret != 1)
+            return ret == 0;
+        close(c.up);
+        c.up = -1;
+        put16(&c.buf[2], c.id);
+        c.off = 0;
+        c.state = TCP_SEND_ANSWER;
+        return true;
+
+    case TCP_SEND_ANSWER:
+        ret = send_message(c.fd, c.buf, &c.off);
+        if (ret == 1) {
+            c.buf.clear();
+            c.state = TCP_READ_QUERY;
+            c.since = now_ms();
+        }
+        return ret >= 0;
+    }
+    return false;
+}
+
+void DnsProxy::expire(uint64_t now)
+{
+    std::map < std::string, pending >::iterator it, next;
+    std::map < std::string, cache_entry >::iterator c, cnext;
+    unsigned i;
+
+    for (it = inflight.begin(); it != inflight.end(); it = next) {
+        next = it;
+        ++next;
+
+        if (now - it->second.sent < DNS_RETRY_TIME)
+            continue;
+
+        if (it->second.tries >= DNS_MAX_TRIES) {
+            QMutexLocker locker(&mutex);
+            stats.failed += it->second.waiters.size();
+            finish(it);
+            continue;
+        }
+
+        it->second.server++;
+        forward(it->first, &it->second);
+    }
+
+    for (i = 0; i < tcp.size();) {
+        if (now - tcp[i].since < (tcp[i].state == TCP_READ_QUERY ?
+                                  DNS_TCP_IDLE : DNS_TCP_TIMEOUT)) {
+            i++;
+            continue;
+        }
+        if (tcp[i].state != TCP_READ_QUERY) {
+            QMutexLocker locker(&mutex);
+            stats.failed++;
+        }
+        tcp_close(tcp[i]);
+        tcp.erase(tcp.begin() + i);
+    }
+
+    if (cache.size() > DNS_CACHE_MAX) {
+        for (c = cache.begin(); c != cache.end(); c = cnext) {
+            cnext = c;
+            ++cnext;
+            if (now >= c->second.expires)
+                cache.erase(c);
+        }
+        if (cache.size() > DNS_CACHE_MAX)
+            cache.clear();
+    }
+
+    QMutexLocker locker(&mutex);
+    stats.entries = cache.size();
+}
+
+/* the listening sockets and the stop pipe come first in the poll set,
+ * then the upstream sockets, then one per TCP connection */
+#define POLL_FIXED 3
+
+void DnsProxy::run()
+{
+    uint8_t buf[DNS_MAX_PACKET];
+    struct sockaddr_storage from;
+    socklen_t from_len;
+    std::vector < struct pollfd > pfd;
+    std::map < int, std::string >::iterator f;
+    struct pollfd p;
+    ssize_t len;
+    size_t i, n, first_tcp;
+    int ret;
+
+    for (;;) {
+        pfd.clear();
+        p.events = POLLIN;
+        p.revents = 0;
+        p.fd = listen_fd;
+        pfd.push_back(p);
+        p.fd = tcp_fd;
+        pfd.push_back(p);
+        p.fd = stop_pipe[0];
+        pfd.push_back(p);
+
+        for (f = by_fd.begin(); f != by_fd.end(); ++f) {
+            p.fd = f->first;
+            pfd.push_back(p);
+        }
+
+        first_tcp = pfd.size();
+        for (i = 0; i < tcp.size(); i++) {
+            switch (tcp[i].state) {
+            case TCP_READ_QUERY:
+                p.fd = tcp[i].fd;
+                p.events = POLLIN;
+                break;
+            case TCP_SEND_QUERY:
+                p.fd = tcp[i].up;
+                p.events = POLLOUT;
+                break;
+            case TCP_READ_ANSWER:
+                p.fd = tcp[i].up;
+                p.events = POLLIN;
+                break;
+            case TCP_SEND_ANSWER:
+                p.fd = tcp[i].fd;
+                p.events = POLLOUT;
+                break;
+            }
+            pfd.push_back(p);
+        }
+
+        ret = poll(&pfd[0], pfd.size(), inflight.empty() && tcp.empty() ?
+                   1000 : DNS_RETRY_TIME / 4);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (pfd[2].revents)
+            break;
+
+        if (pfd[0].revents & POLLIN) {
+            from_len = sizeof(from);
+            len = recvfrom(listen_fd, buf, sizeof(buf), 0,
+                           (struct sockaddr *)&from, &from_len);
+            if (len > 0)
+                handle_query(buf, len, &from, from_len);
+        }
+
+        /* answers may finish queries, but the sockets are closed only
+         * by them: any left in the set are still valid. An error (an
+         * ICMP unreachable) is cleared by reading it. */
+        for (i = POLL_FIXED; i < first_tcp; i++) {
+            if (pfd[i].revents)
+                handle_answer(pfd[i].fd);
+        }
+
+        /* the connections are still in the order of the poll set */
+        n = tcp.size();
+        for (i = 0; i < n;) {
+            if (pfd[first_tcp].revents == 0
+                || tcp_event(tcp[i], pfd[first_tcp].revents)) {
+                i++;
+            } else {
+                tcp_close(tcp[i]);
+                tcp.erase(tcp.begin() + i);
+                n--;
+            }
+            first_tcp++;
+        }
+
+        if (pfd[1].revents & POLLIN)
+            tcp_accept();
+
+        expire(now_ms());
+    }
+}
+
+#endif                          // USE_DNS_PROXY
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DNSPROXY_H
+#define DNSPROXY_H
+
+#include "common.h"
+#include "domaintrie.h"
+#include <QThread>
+#include <QMutex>
+#include <map>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#ifdef USE_DNS_PROXY
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+}
+
+/* the stub listens here; resolv.conf is pointed at it by the script */
+#define DNS_PROXY_ADDR "127.0.2.53"
+/* with systemd-resolved, resolv.conf names its stub at 127.0.0.53; the
+ * servers it forwards to are listed here */
+#define RESOLVED_CONF "/run/systemd/resolve/resolv.conf"
+
+struct dns_stats {
+    unsigned queries;
+    unsigned hits;
+    unsigned coalesced;
+    unsigned forwarded;
+    unsigned failed;
+    unsigned entries;
+    unsigned local;             /* forwarded to the local resolvers */
+    uint64_t route_ns;          /* time spent matching split domains */
+};
+
+/* A caching DNS stub for the session. Queries are answered from the
+ * cache while the TTLs of the answer last; otherwise they are forwarded
+ * to the VPN's servers, and identical queries arriving meanwhile wait for
+ * the same answer instead of being forwarded again. Every forwarded
+ * query gets a random id and a socket of its own, hence a random source
+ * port.
+ *
+ * Queries over TCP, which clients make after a truncated answer, are
+ * passed on to the same servers over TCP, one at a time per connection,
+ * and are not cached.
+ *
+ * When split domains are given, only names under them are sent to the
+ * VPN's servers and the rest to the resolvers the system used before.
+ */
+class DnsProxy:public QThread {
+ public:
+    DnsProxy();
+    ~DnsProxy();
+
+    /* adds an upstream server; returns false if it is not an address */
+    bool add_server(const char *addr, bool local = false);
+    /* adds the non-loopback servers of a resolv.conf; returns their count */
+    unsigned add_local_servers(const char *resolv_conf);
+    void add_split_domain(const char *domain) {
+        split.add(domain);
+    }
+    /* whether queries are routed by domain */
+    bool get_split() {
+        return split.size() > 0 && local_servers.empty() == false;
+    }
+    unsigned get_split_domains() {
+        return split.size();
+    }
+    void set_cache(bool c) {
+        use_cache = c;
+    }
+    /* binds the listening socket; returns zero on success */
+    int setup(std::string & err);
+    void stop();
+
+    void get_stats(struct dns_stats *s);
+
+ protected:
+    void run();
+
+ private:
+    struct waiter {
+        struct sockaddr_storage addr;
+        socklen_t addr_len;
+        uint16_t id;
+        std::vector < uint8_t > question;
+    };
+
+    struct pending {
+        uint16_t upstream_id;
+        int fd;                 /* connected to the server, or -1 */
+        std::vector < uint8_t > query;
+        std::vector < waiter > waiters;
+        uint64_t sent;
+        unsigned server;
+        unsigned tries;
+        bool local;
+    };
+
+    struct cache_entry {
+        std::vector < uint8_t > answer;
+        uint64_t stored;
+        uint64_t expires;
+    };
+
+    enum tcp_state {
+        TCP_READ_QUERY,
+        TCP_SEND_QUERY,
+        TCP_READ_ANSWER,
+        TCP_SEND_ANSWER
+    };
+
+    /* a client connection; the message in buf carries its length */
+    struct tcp_conn {
+        int fd;
+        int up;                 /* to the server, while a query is out */
+        enum tcp_state state;
+        uint16_t id;            /* the client's */
+        std::vector < uint8_t > buf;
+        size_t off;             /* sent so far */
+        uint64_t since;
+    };
+
+    void handle_query(const uint8_t * pkt, size_t len,
+                      struct sockaddr_storage *from, socklen_t from_len);
+    void handle_answer(int fd);
+    bool route_local(const uint8_t * pkt, size_t qend);
+    void forward(const std::string & key, struct pending *p);
+    void finish(std::map < std::string, pending >::iterator it);
+    void expire(uint64_t now);
+    struct sockaddr_storage *server_of(const struct pending *p);
+    void reply(const waiter & w, std::vector < uint8_t > answer,
+               uint64_t age);
+
+    void tcp_accept();
+    bool tcp_event(struct tcp_conn &c, short revents);
+    bool tcp_query(struct tcp_conn &c);
+    void tcp_close(struct tcp_conn &c);
+
+    std::vector < struct sockaddr_storage >servers;
+    std::vector < struct sockaddr_storage >local_servers;
+    DomainTrie split;
+    bool use_cache;
+    std::map < std::string, pending > inflight;
+    std::map < int, std::string > by_fd;
+    std::map < std::string, cache_entry > cache;
+    std::vector < tcp_conn > tcp;
+
+    int listen_fd;
+    int tcp_fd;
+    int stop_pipe[2];
+
+    QMutex mutex;               /* protects stats */
+    struct dns_stats stats;
+};
+
+#endif                          // USE_DNS_PROXY
+
+#endif                          // DNSPROXY_H
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "domaintrie.h"
+#include <string.h>
+#include <algorithm>
+
+#define MAX_LABELS 128
+#define MAX_LABEL_LEN 63
+
+static inline char lower(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c + ('a' - 'A');
+    return c;
+}
+
+/* orders labels as std::string does, but with the second one in lower
+ * case */
+static int compare_label(const char *a, unsigned alen, const char *p,
+                         unsigned len)
+{
+    unsigned i, n = alen < len ? alen : len;
+    unsigned char x, y;
+
+    for (i = 0; i < n; i++) {
+        x = a[i];
+        y = lower(p[i]);
+        if (x != y)
+            return x < y ? -1 : 1;
+    }
+    if (alen == len)
+        return 0;
+    return alen < len ? -1 : 1;
+}
+
+DomainTrie::DomainTrie()
+{
+    clear();
+}
+
+void DomainTrie::clear()
+{
+    nodes.clear();
+    nodes.resize(1);
+    nodes[0].terminal = false;
+    text.clear();
+    count = 0;
+}
+
+int DomainTrie::find_child(uint32_t parent, const char *p, unsigned len)
+{
+    const std::vector < edge > &c = nodes[parent].children;
+    unsigned lo = 0, hi = c.size(), mid;
+    int r;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        r = compare_label(text.data() + c[mid].off, c[mid].len, p, len);
+        if (r == 0)
+            return c[mid].child;
+        if (r < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return -(int)lo - 1;
+}
+
+void DomainTrie::add(const char *domain)
+{
+    struct label labels[MAX_LABELS];
+    unsigned n = 0, i;
+    const char *p = domain, *dot;
+    uint32_t cur = 0;
+    edge e;
+    int r;
+
+    /* split into labels, ignoring empty ones from leading or trailing
+     * dots */
+    while (*p != 0 && n < MAX_LABELS) {
+        dot = strchr(p, '.');
+        if (dot == NULL)
+            dot = p + strlen(p);
+        if (dot != p) {
+            labels[n].p = p;
+            labels[n].len = dot - p;
+            n++;
+        }
+        p = *dot ? dot + 1 : dot;
+    }
+    if (n == 0)
+        return;
+
+    for (i = n; i > 0; i--) {
+        const struct label & l = labels[i - 1];
+
+        r = find_child(cur, l.p, l.len);
+        if (r >= 0) {
+            cur = r;
+            continue;
+        }
+
+        e.off = text.size();
+        e.len = l.len;
+        text.append(l.p, l.len);
+        std::transform(text.begin() + e.off, text.end(), text.begin() + e.off,
+                       lower);
+
+        nodes.push_back(node());
+        nodes.back().terminal = false;
+        e.child = nodes.size() - 1;
+        /* the push_back may have moved the parent */
+        nodes[cur].children.insert(nodes[cur].children.begin() + (-r - 1), e);
+        cur = nodes.size() - 1;
+    }
+
+    if (nodes[cur].terminal == false) {
+        nodes[cur].terminal = true;
+        count++;
+    }
+}
+
+bool DomainTrie::walk(const struct label *labels, unsigned n)
+{
+    uint32_t cur = 0;
+    int r;
+
+    while (n > 0) {
+        n--;
+        r = find_child(cur, labels[n].p, labels[n].len);
+        if (r < 0)
+            return false;
+        cur = r;
+        if (nodes[cur].terminal)
+            return true;
+    }
+    return false;
+}
+
+bool DomainTrie::match(const char *name)
+{
+    struct label labels[MAX_LABELS];
+    unsigned n = 0;
+    const char *p = name, *dot;
+
+    if (count == 0)
+        return false;
+
+    while (*p != 0) {
+        if (n == MAX_LABELS)
+            return false;
+        dot = strchr(p, '.');
+        if (dot == NULL)
+            dot = p + strlen(p);
+        if (dot != p) {
+            labels[n].p = p;
+            labels[n].len = dot - p;
+            n++;
+        }
+        p = *dot ? dot + 1 : dot;
+    }
+    return walk(labels, n);
+}
+
+bool DomainTrie::match_wire(const uint8_t * name, size_t len)
+{
+    struct label labels[MAX_LABELS];
+    unsigned n = 0, c;
+    size_t off = 0;
+
+    if (count == 0)
+        return false;
+
+    while (off < len) {
+        c = name[off++];
+        if (c == 0)
+            return walk(labels, n);
+        /* questions are not compressed */
+        if (c > MAX_LABEL_LEN || off + c > len || n == MAX_LABELS)
+            return false;
+        labels[n].p = (const char *)name + off;
+        labels[n].len = c;
+        n++;
+        off += c;
+    }
+    return false;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DOMAINTRIE_H
+#define DOMAINTRIE_H
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+/* A set of domain suffixes kept as a trie of their labels, last label
+ * first, so that "corp.example.com" is stored as com -> example -> corp.
+ * A name matches when it equals one of the domains or lies below it; a
+ * lookup costs one binary search per label of the name.
+ */
+class DomainTrie {
+ public:
+    DomainTrie();
+
+    void clear();
+    /* adds a domain such as "example.com" or ".example.com" */
+    void add(const char *domain);
+    unsigned size() {
+        return count;
+    }
+
+    /* matches a dotted name */
+    bool match(const char *name);
+    /* matches a name in DNS wire format; len bounds the buffer */
+    bool match_wire(const uint8_t * name, size_t len);
+
+ private:
+    struct label {
+        const char *p;
+        unsigned len;
+    };
+    /* the labels live in one buffer, so that inserting an edge moves
+     * a few words rather than strings */
+    struct edge {
+        uint32_t off;           /* of the label in text */
+        uint32_t len;
+        uint32_t child;
+    };
+
+    struct node {
+        std::vector < edge > children;  /* sorted by label */
+        bool terminal;
+    };
+
+    bool walk(const struct label *labels, unsigned n);
+    int find_child(uint32_t parent, const char *p, unsigned len);
+
+    std::vector < node > nodes;     /* node 0 is the root */
+    std::string text;           /* the labels in lower case */
+    unsigned count;
+};
+
+#endif                          // DOMAINTRIE_H
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dpdtuner.h"
+
+DpdTuner::DpdTuner(unsigned base, bool adaptive)
+{
+    this->adaptive = adaptive;
+    if (base == 0 && adaptive == true)
+        base = DPD_DEFAULT;
+    this->base = base;
+    this->cur = base;
+    last_rx = 0;
+    last_tx = 0;
+    last_rx_time = 0;
+    last_activity = 0;
+    last_drop = 0;
+}
+
+bool DpdTuner::set(unsigned v)
+{
+    if (v < DPD_MIN)
+        v = DPD_MIN;
+    if (v > DPD_MAX)
+        v = DPD_MAX;
+    if (v == cur)
+        return false;
+    cur = v;
+    return true;
+}
+
+bool DpdTuner::update(uint64_t rx_pkts, uint64_t tx_pkts, uint64_t now)
+{
+    bool active = false;
+
+    if (rx_pkts != last_rx || last_rx_time == 0) {
+        last_rx = rx_pkts;
+        last_rx_time = now;
+        active = true;
+    }
+    if (tx_pkts != last_tx) {
+        last_tx = tx_pkts;
+        active = true;
+    }
+    if (active || last_activity == 0)
+        last_activity = now;
+
+    if (adaptive == false)
+        return false;
+
+    if (last_drop != 0 && now - last_drop < DPD_LOSS_MEMORY * 1000)
+        return set(base / 2);
+
+    if (now - last_activity >= DPD_IDLE_TIME * 1000)
+        return set(cur * 2);
+
+    return set(base);
+}
+
+bool DpdTuner::dead_peer(uint64_t now)
+{
+    if (last_rx_time != 0)
+        latencies.push_back(now - last_rx_time);
+    last_drop = now;
+
+    if (adaptive == false)
+        return false;
+    return set(base / 2);
+}
+
+unsigned DpdTuner::get_average_latency()
+{
+    uint64_t sum = 0;
+    unsigned i;
+
+    if (latencies.empty())
+        return 0;
+
+    for (i = 0; i < latencies.size(); i++)
+        sum += latencies[i];
+    return sum / latencies.size();
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DPDTUNER_H
+#define DPDTUNER_H
+
+#include <stdint.h>
+#include <vector>
+
+#define DPD_DEFAULT 30          /* seconds, when the profile leaves it to us */
+#define DPD_MIN 10
+#define DPD_MAX 300
+#define DPD_IDLE_TIME 120       /* no traffic for this long is idle */
+#define DPD_LOSS_MEMORY 600     /* a drop shortens DPD for this long */
+
+/* Picks the dead peer detection interval of a session. In adaptive mode
+ * the interval is halved for a while after a drop and doubled while the
+ * link is idle; otherwise it stays at the profile's value. Every drop
+ * records how long after the last received packet it was detected.
+ */
+class DpdTuner {
+ public:
+    DpdTuner(unsigned base, bool adaptive);
+
+    /* the interval to apply now; zero to keep the server's */
+    unsigned get_dpd() {
+        return cur;
+    }
+
+    /* both return true if the interval changed; times are in ms */
+    bool update(uint64_t rx_pkts, uint64_t tx_pkts, uint64_t now);
+    bool dead_peer(uint64_t now);
+
+    /* detection latencies in ms, one per drop */
+    const std::vector < unsigned >&get_latencies() {
+        return latencies;
+    }
+    unsigned get_average_latency();
+
+    /* ms since an update last saw a received packet */
+    uint64_t get_silence(uint64_t now) {
+        return now - last_rx_time;
+    }
+
+ private:
+    bool set(unsigned v);
+
+    unsigned base;
+    unsigned cur;
+    bool adaptive;
+    uint64_t last_rx;
+    uint64_t last_tx;
+    uint64_t last_rx_time;
+    uint64_t last_activity;
+    uint64_t last_drop;
+    std::vector < unsigned >latencies;
+};
+
+#endif                          // DPDTUNER_H
@@ -25,10 +25,6 @@
 #include <QListWidget>
 #include <QItemSelectionModel>
 
-#ifdef USE_SYSTEM_KEYS
-#include <gnutls/system-keys.h>
-#endif
-
 static int token_tab(int mode)
 {
     switch (mode) {
@@ -49,16 +45,15 @@ int token_rtab[] = {
     [2] = OC_TOKEN_MODE_STOKEN
 };
 
+/* the entries of the last enumeration are shown at once; a new one runs
+ * in the background, and its entries are merged in as they arrive */
 void EditDialog::load_win_certs()
 {
 #ifdef USE_SYSTEM_KEYS
-    gnutls_system_key_iter_t iter = NULL;
-    char *label;
-    char *cert_url;
-    char *key_url;
-    int ret, idx = -1;
-    int row = 0;
+    SystemKeys *keys = SystemKeys::instance();
+    std::vector < win_cert_st > list;
     QString prekey = ss->get_key_url();
+    unsigned i;
 
     if (prekey.isEmpty() == false) {
         ui->userKeyEdit->setText(prekey);
@@ -67,39 +62,71 @@ void EditDialog::load_win_certs()
     this->winCerts.clear();
     ui->loadWinCertList->clear();
 
-    do {
-        ret =
-            gnutls_system_key_iter_get_info(&iter, GNUTLS_CRT_X509, &cert_url, &key_url, &label,
-                                            NULL, 0);
-        if (ret >= 0) {
-            win_cert_st st;
-            QString l;
-            if (label != NULL)
-                l = QString::fromUtf8(label);
-            else
-                l = QString::fromUtf8(cert_url);
-            ui->loadWinCertList->addItem(l);
-            if (prekey.isEmpty() == false) {
-                if (QString::compare(prekey, QString::fromUtf8(key_url),
-                                     Qt::CaseSensitive) == 0) {
-                    idx = row;
-                }
-            }
-            row++;
-
-            st.label = l;
-            st.key_url = QString::fromUtf8(key_url);
-            st.cert_url = QString::fromUtf8(cert_url);
-            this->winCerts.push_back(st);
-        }
-    } while (ret >= 0);
+    /* connected first, so that an enumeration ending meanwhile is seen */
+    connect(keys, SIGNAL(found(QString, QString, QString)), this,
+            SLOT(win_cert_found(QString, QString, QString)),
+            Qt::UniqueConnection);
+    connect(keys, SIGNAL(done()), this, SLOT(win_certs_done()),
+            Qt::UniqueConnection);
+
+    list = keys->get_entries();
+    for (i = 0; i < list.size(); i++)
+        add_win_cert(list[i]);
+    keys->refresh();
+#endif
+}
+
+void EditDialog::add_win_cert(const win_cert_st & st)
+{
+    unsigned i;
 
-    if (idx != -1) {
-        ui->loadWinCertList->setCurrentRow(idx);
-        ui->loadWinCertList->item(idx)->setSelected(true);
+    for (i = 0; i < this->winCerts.size(); i++) {
+        if (this->winCerts[i].key_url == st.key_url
+            && this->winCerts[i].cert_url == st.cert_url)
+            return;
+    }
+
+    this->winCerts.push_back(st);
+    ui->loadWinCertList->addItem(st.label);
+
+    if (st.key_url == ss->get_key_url()) {
+        ui->loadWinCertList->setCurrentRow(this->winCerts.size() - 1);
+        ui->loadWinCertList->item(this->winCerts.size() - 1)->setSelected(true);
     }
-    gnutls_system_key_iter_deinit(iter);
-#endif
+}
+
+void EditDialog::win_cert_found(QString label, QString cert_url,
+                                QString key_url)
+{
+    win_cert_st st;
+
+    st.label = label;
+    st.cert_url = cert_url;
+    st.key_url = key_url;
+    add_win_cert(st);
+}
+
+/* drops the entries that are gone from the store; the enumeration may
+ * have started before this dialog, so its result is taken in whole */
+void EditDialog::win_certs_done()
+{
+    std::vector < win_cert_st > list = SystemKeys::instance()->get_entries();
+    unsigned i, j;
+
+    for (i = this->winCerts.size(); i > 0; i--) {
+        for (j = 0; j < list.size(); j++) {
+            if (list[j].key_url == this->winCerts[i - 1].key_url
+                && list[j].cert_url == this->winCerts[i - 1].cert_url)
+                break;
+        }
+        if (j == list.size()) {
+            delete ui->loadWinCertList->takeItem(i - 1);
+            this->winCerts.erase(this->winCerts.begin() + (i - 1));
+        }
+    }
+
+    for (j = 0; j < list.size(); j++)
+        add_win_cert(list[j]);
 }
 
  EditDialog::EditDialog(QString server, QSettings * settings, QWidget * parent):
@@ -129,6 +156,9 @@ ui(new Ui::EditDialog)
         ui->labelEdit->setText(server);
     }
     ui->groupnameEdit->setText(ss->get_groupname());
+    if (ss->get_form_answer_count() > 0)
+        ui->formAnswersEdit->setText(QString::number(ss->get_form_answer_count())
+                                     + tr(" stored"));
     ui->usernameEdit->setText(ss->get_username());
     ui->gatewayEdit->setText(ss->get_servername());
     ui->userCertHash->setText(ss->get_client_cert_hash());
@@ -137,6 +167,25 @@ ui(new Ui::EditDialog)
     ui->minimizeBox->setChecked(ss->get_minimize());
     ui->proxyBox->setChecked(ss->get_proxy());
     ui->disableUDP->setChecked(ss->get_disable_udp());
+    ui->userspaceTunBox->setChecked(ss->get_userspace_tun());
+    ui->mtuProbeBox->setChecked(ss->get_mtu_probe());
+    ui->dpdSpin->setValue(ss->get_dpd());
+    ui->reconnectSpin->setValue(ss->get_reconnect_timeout());
+    ui->adaptiveDpdBox->setChecked(ss->get_adaptive_dpd());
+    ui->compressionBox->setCurrentIndex(ss->get_compression());
+    ui->dtlsPeriodSpin->setValue(ss->get_dtls_attempt_period());
+    ui->scriptTimeoutSpin->setValue(ss->get_script_timeout());
+    ui->nativeConfigBox->setChecked(ss->get_native_config());
+    ui->netMonitorBox->setChecked(ss->get_net_monitor());
+    ui->autoReconnectBox->setChecked(ss->get_auto_reconnect());
+    ui->keepSessionBox->setChecked(ss->get_keep_session());
+    ui->pinCacheSpin->setValue(ss->get_pin_cache());
+#if !OPENCONNECT_CHECK_VER(5,7)
+    /* see USE_REATTACH */
+    ui->keepSessionBox->setEnabled(false);
+#endif
+    ui->dnsCacheBox->setChecked(ss->get_dns_cache());
+    ui->splitDnsBox->setChecked(ss->get_split_dns());
 
     // Load the windows certificates
     load_win_certs();
@@ -227,6 +276,21 @@ void EditDialog::on_buttonBox_accepted()
     ss->set_minimize(ui->minimizeBox->isChecked());
     ss->set_proxy(ui->proxyBox->isChecked());
     ss->set_disable_udp(ui->disableUDP->isChecked());
+    ss->set_userspace_tun(ui->userspaceTunBox->isChecked());
+    ss->set_mtu_probe(ui->mtuProbeBox->isChecked());
+    ss->set_dpd(ui->dpdSpin->value());
+    ss->set_reconnect_timeout(ui->reconnectSpin->value());
+    ss->set_adaptive_dpd(ui->adaptiveDpdBox->isChecked());
+    ss->set_compression(ui->compressionBox->currentIndex());
+    ss->set_dtls_attempt_period(ui->dtlsPeriodSpin->value());
+    ss->set_script_timeout(ui->scriptTimeoutSpin->value());
+    ss->set_native_config(ui->nativeConfigBox->isChecked());
+    ss->set_net_monitor(ui->netMonitorBox->isChecked());
+    ss->set_auto_reconnect(ui->autoReconnectBox->isChecked());
+    ss->set_keep_session(ui->keepSessionBox->isChecked());
+    ss->set_pin_cache(ui->pinCacheSpin->value());
+    ss->set_dns_cache(ui->dnsCacheBox->isChecked());
+    ss->set_split_dns(ui->splitDnsBox->isChecked());
 
     type = ui->tokenBox->currentIndex();
     if (type != -1 && ui->tokenEdit->text().isEmpty() == false) {
@@ -319,6 +383,12 @@ void EditDialog::on_toolButton_clicked()
     ui->groupnameEdit->clear();
 }
 
+void EditDialog::on_formAnswersClear_clicked()
+{
+    ss->clear_form_answers();
+    ui->formAnswersEdit->clear();
+}
+
 void EditDialog::on_loadWinCert_clicked()
 {
     int idx = ui->loadWinCertList->currentRow();
@@ -24,12 +24,7 @@
 #include <QDialog>
 #include <vector>
 #include "common.h"
-
-struct win_cert_st {
-    QString label;
-    QString key_url;
-    QString cert_url;
-};
+#include "systemkeys.h"
 
 namespace Ui {
     class EditDialog;
@@ -40,6 +35,8 @@ namespace Ui {
     ~EditDialog();
 
     private slots:void load_win_certs();
+    void win_cert_found(QString label, QString cert_url, QString key_url);
+    void win_certs_done();
     void on_buttonBox_accepted();
 
     void on_buttonBox_rejected();
@@ -62,9 +59,13 @@ namespace Ui {
 
     void on_toolButton_clicked();
 
+    void on_formAnswersClear_clicked();
+
     void on_loadWinCert_clicked();
 
  private:
+    void add_win_cert(const win_cert_st & st);
+
      Ui::EditDialog * ui;
      std::vector < win_cert_st > winCerts;
     StoredServer *ss;
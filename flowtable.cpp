@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "flowtable.h"
+#include <string.h>
+#include <algorithm>
+
+#define MAX_LOAD (FLOW_TABLE_SIZE * 3 / 4)
+/* what is left after making room */
+#define LOW_LOAD (FLOW_TABLE_SIZE / 2)
+
+#define IPPROTO_TCP_ 6
+#define IPPROTO_UDP_ 17
+
+FlowTable::FlowTable()
+{
+    table = new flow_entry[FLOW_TABLE_SIZE];
+    spare = new flow_entry[FLOW_TABLE_SIZE];
+    routes = NULL;
+    clear();
+}
+
+FlowTable::~FlowTable()
+{
+    delete[]table;
+    delete[]spare;
+}
+
+void FlowTable::clear()
+{
+    QMutexLocker locker(&mutex);
+    memset(table, 0, sizeof(flow_entry) * FLOW_TABLE_SIZE);
+    used = 0;
+    retired_tx.clear();
+    retired_rx.clear();
+    evicted = 0;
+    untracked_bytes = 0;
+    pump_ns = 0;
+    pump_pkts = 0;
+}
+
+/* FNV-1a over the key */
+static uint32_t hash_key(const struct flow_key *key)
+{
+    const uint8_t *p = reinterpret_cast < const uint8_t * >(key);
+    uint32_t h = 2166136261u;
+    unsigned i;
+
+    for (i = 0; i < sizeof(*key); i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h ? h : 1;
+}
+
+static bool has_ports(uint8_t proto)
+{
+    return proto == IPPROTO_TCP_ || proto == IPPROTO_UDP_;
+}
+
+/* Fills in the key from the packet header; the local side is the source
+ * of outbound packets and the destination of inbound ones.
+ */
+static bool parse_packet(const uint8_t * pkt, size_t len, bool outbound,
+                         struct flow_key *key)
+{
+    const uint8_t *src, *dst, *l4 = NULL;
+    size_t alen, hlen;
+    uint8_t proto;
+
+    memset(key, 0, sizeof(*key));
+    if (len < 1)
+        return false;
+
+    if ((pkt[0] >> 4) == 4) {
+        if (len < 20)
+            return false;
+        hlen = (pkt[0] & 0x0f) * 4;
+        proto = pkt[9];
+        src = pkt + 12;
+        dst = pkt + 16;
+        alen = 4;
+        key->family = 4;
+        /* only the first fragment carries the ports */
+        if ((((pkt[6] & 0x1f) << 8) | pkt[7]) == 0 && len >= hlen + 4)
+            l4 = pkt + hlen;
+    } else if ((pkt[0] >> 4) == 6) {
+        if (len < 40)
+            return false;
+        proto = pkt[6];
+        src = pkt + 8;
+        dst = pkt + 24;
+        alen = 16;
+        key->family = 6;
+        hlen = 40;
+        /* skip the common extension headers */
+        while ((proto == 0 || proto == 43 || proto == 60)
+               && len >= hlen + 8) {
+            proto = pkt[hlen];
+            hlen += (pkt[hlen + 1] + 1) * 8;
+        }
+        if (len >= hlen + 4)
+            l4 = pkt + hlen;
+    } else {
+        return false;
+    }
+
+    key->proto = proto;
+    if (outbound) {
+        memcpy(key->local, src, alen);
+        memcpy(key->remote, dst, alen);
+    } else {
+        memcpy(key->local, dst, alen);
+        memcpy(key->remote, src, alen);
+    }
+
+    if (l4 != NULL && has_ports(proto)) {
+        uint16_t sport = (l4[0] << 8) | l4[1];
+        uint16_t dport = (l4[2] << 8) | l4[3];
+        key->lport = outbound ? sport : dport;
+        key->rport = outbound ? dport : sport;
+    }
+    return true;
+}
+
+static bool more_traffic(const flow_entry & a, const flow_entry & b)
+{
+    return a.tx_bytes + a.rx_bytes > b.tx_bytes + b.rx_bytes;
+}
+
+void FlowTable::retire(const struct flow_entry *e)
+{
+    if (e->route != 0) {
+        if (retired_tx.size() < e->route) {
+            retired_tx.resize(e->route, 0);
+            retired_rx.resize(e->route, 0);
+        }
+        retired_tx[e->route - 1] += e->tx_bytes;
+        retired_rx[e->route - 1] += e->rx_bytes;
+    }
+    evicted++;
+}
+
+/* Brings the table down to LOW_LOAD entries, dropping the idle flows
+ * first and then those with the least traffic. Linear probing cannot
+ * simply empty a slot, so the survivors are inserted into a new table.
+ */
+void FlowTable::evict(uint32_t now)
+{
+    unsigned i, j, n = 0;
+
+    for (i = 0; i < FLOW_TABLE_SIZE; i++) {
+        if (table[i].hash == 0)
+            continue;
+        if (now - table[i].last >= FLOW_IDLE)
+            retire(&table[i]);
+        else
+            spare[n++] = table[i];
+    }
+
+    if (n > LOW_LOAD) {
+        std::nth_element(spare, spare + LOW_LOAD, spare + n, more_traffic);
+        for (i = LOW_LOAD; i < n; i++)
+            retire(&spare[i]);
+        n = LOW_LOAD;
+    }
+
+    memset(table, 0, sizeof(flow_entry) * FLOW_TABLE_SIZE);
+    for (i = 0; i < n; i++) {
+        j = spare[i].hash & (FLOW_TABLE_SIZE - 1);
+        while (table[j].hash != 0)
+            j = (j + 1) & (FLOW_TABLE_SIZE - 1);
+        table[j] = spare[i];
+    }
+    used = n;
+}
+
+struct flow_entry *FlowTable::lookup(const struct flow_key *key,
+                                     uint32_t hash, uint32_t now)
+{
+    unsigned i = hash & (FLOW_TABLE_SIZE - 1);
+    struct flow_entry *e;
+
+    for (;;) {
+        e = &table[i];
+        if (e->hash == 0) {
+            if (used >= MAX_LOAD) {
+                evict(now);
+                /* the slots have moved */
+                return lookup(key, hash, now);
+            }
+            e->hash = hash;
+            e->key = *key;
+            if (routes != NULL)
+                e->route = routes->lookup(key->remote, key->family) + 1;
+            used++;
+            return e;
+        }
+        if (e->hash == hash && memcmp(&e->key, key, sizeof(*key)) == 0)
+            return e;
+        i = (i + 1) & (FLOW_TABLE_SIZE - 1);
+    }
+}
+
+void FlowTable::account(const uint8_t * pkt, size_t len, bool outbound,
+                        uint32_t now)
+{
+    struct flow_key key;
+    struct flow_entry *e;
+    uint32_t hash;
+
+    if (parse_packet(pkt, len, outbound, &key) == false) {
+        QMutexLocker locker(&mutex);
+        untracked_bytes += len;
+        return;
+    }
+    hash = hash_key(&key);
+
+    QMutexLocker locker(&mutex);
+    e = lookup(&key, hash, now);
+
+    e->last = now;
+    if (outbound) {
+        e->tx_pkts++;
+        e->tx_bytes += len;
+    } else {
+        e->rx_pkts++;
+        e->rx_bytes += len;
+    }
+}
+
+void FlowTable::add_pump_time(uint64_t ns, unsigned pkts)
+{
+    QMutexLocker locker(&mutex);
+    pump_ns += ns;
+    pump_pkts += pkts;
+}
+
+void FlowTable::route_totals(std::vector < uint64_t > &tx,
+                             std::vector < uint64_t > &rx, unsigned nroutes)
+{
+    unsigned i;
+
+    tx.assign(nroutes, 0);
+    rx.assign(nroutes, 0);
+
+    QMutexLocker locker(&mutex);
+    for (i = 0; i < retired_tx.size() && i < nroutes; i++) {
+        tx[i] = retired_tx[i];
+        rx[i] = retired_rx[i];
+    }
+    for (i = 0; i < FLOW_TABLE_SIZE; i++) {
+        if (table[i].hash == 0 || table[i].route == 0
+            || table[i].route > nroutes)
+            continue;
+        tx[table[i].route - 1] += table[i].tx_bytes;
+        rx[table[i].route - 1] += table[i].rx_bytes;
+    }
+}
+
+void FlowTable::top(std::vector < flow_entry > &out, unsigned n)
+{
+    unsigned i;
+
+    out.clear();
+    {
+        QMutexLocker locker(&mutex);
+        out.reserve(used);
+        for (i = 0; i < FLOW_TABLE_SIZE; i++) {
+            if (table[i].hash != 0)
+                out.push_back(table[i]);
+        }
+    }
+
+    if (out.size() > n) {
+        std::partial_sort(out.begin(), out.begin() + n, out.end(),
+                          more_traffic);
+        out.resize(n);
+    } else {
+        std::sort(out.begin(), out.end(), more_traffic);
+    }
+}
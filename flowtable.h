@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FLOWTABLE_H
+#define FLOWTABLE_H
+
+#include <QMutex>
+#include "routetable.h"
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+#define FLOW_TABLE_SIZE 4096    /* must be a power of two */
+/* seconds without a packet after which a flow may be dropped for room */
+#define FLOW_IDLE 120
+
+struct flow_key {
+    uint8_t local[16];
+    uint8_t remote[16];
+    uint16_t lport;
+    uint16_t rport;
+    uint8_t proto;
+    uint8_t family;             /* 4 or 6 */
+    uint8_t pad[2];
+};
+
+/* 80 bytes; the hash is compared before the key while probing */
+struct flow_entry {
+    struct flow_key key;
+    uint32_t hash;              /* zero marks an empty slot */
+    uint32_t tx_pkts;
+    uint32_t rx_pkts;
+    uint32_t route;             /* split route index + 1, zero if none */
+    uint32_t last;              /* second of the last packet */
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
+};
+
+/* Per 5-tuple packet and byte counters of the tunnel traffic, kept in an
+ * open addressing (linear probing) table that is filled by the packet pump
+ * thread and read by the GUI. When it fills up, idle flows and then the
+ * smallest ones are dropped; their traffic stays in the route totals.
+ */
+class FlowTable {
+ public:
+    FlowTable();
+    ~FlowTable();
+
+    void clear();
+    /* new flows are tagged with their longest matching split route */
+    void set_routes(RouteTable * r) {
+        routes = r;
+    }
+
+    /* outbound is true for packets read from the tun device; now is a
+     * time in seconds */
+    void account(const uint8_t * pkt, size_t len, bool outbound,
+                 uint32_t now);
+    void add_pump_time(uint64_t ns, unsigned pkts);
+
+    /* copies the n flows with most traffic into out */
+    void top(std::vector < flow_entry > &out, unsigned n);
+    /* sums the traffic of the flows per split route */
+    void route_totals(std::vector < uint64_t > &tx,
+                      std::vector < uint64_t > &rx, unsigned nroutes);
+
+    uint64_t get_untracked_bytes() {
+        return untracked_bytes;
+    }
+    /* flows dropped to make room */
+    uint64_t get_evicted() {
+        return evicted;
+    }
+    uint64_t get_packets() {
+        return pump_pkts;
+    }
+    /* average time the pump spends per packet, in nanoseconds */
+    unsigned get_pump_cost() {
+        if (pump_pkts == 0)
+            return 0;
+        return (unsigned)(pump_ns / pump_pkts);
+    }
+
+ private:
+    struct flow_entry *lookup(const struct flow_key *key, uint32_t hash,
+                              uint32_t now);
+    void evict(uint32_t now);
+    void retire(const struct flow_entry *e);
+
+    struct flow_entry *table;
+    struct flow_entry *spare;   /* for rebuilding the table */
+    RouteTable *routes;
+    unsigned used;
+    std::vector < uint64_t > retired_tx;        /* by route */
+    std::vector < uint64_t > retired_rx;
+    uint64_t evicted;
+    uint64_t untracked_bytes;
+    uint64_t pump_ns;
+    uint64_t pump_pkts;
+    QMutex mutex;
+};
+
+#endif                          // FLOWTABLE_H
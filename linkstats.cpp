@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "linkstats.h"
+
+#ifdef __linux__
+extern "C" {
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#include <linux/version.h>
+#include <stddef.h>
+#include <string.h>
+}
+#endif
+
+/* below this, the CPU time is mostly the setup of the session */
+#define CPU_RATE_MIN_BYTES (1024 * 1024)
+
+LinkStats::LinkStats()
+{
+    last_time = 0;
+    last_payload = 0;
+    last_wire = 0;
+    last_fd = INVALID_SOCKET;
+    payload = 0;
+    wire = 0;
+    peak = 0;
+    link_rate = 0;
+    first_payload = 0;
+    start_cpu = 0;
+    cpu_ms = 0;
+}
+
+/* the bytes sent and received on a TCP socket, including the TLS
+ * records, and the delivery rate if the sender was not application
+ * limited, else zero */
+bool LinkStats::read_socket(SOCKET fd, uint64_t * bytes, uint64_t * rate)
+{
+#if defined(__linux__) && defined(TCP_INFO)
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+
+    if (fd == INVALID_SOCKET)
+        return false;
+
+    memset(&info, 0, sizeof(info));
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0)
+        return false;
+
+    /* older kernels return a shorter structure */
+    if (len < offsetof(struct tcp_info, tcpi_bytes_received) +
+        sizeof(info.tcpi_bytes_received))
+        return false;
+
+    *bytes = info.tcpi_bytes_acked + info.tcpi_bytes_received;
+
+    *rate = 0;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,9,0)
+    if (len >= offsetof(struct tcp_info, tcpi_delivery_rate) +
+        sizeof(info.tcpi_delivery_rate)
+        && info.tcpi_delivery_rate_app_limited == 0)
+        *rate = info.tcpi_delivery_rate;
+#endif
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t LinkStats::thread_cpu_ms()
+{
+#if defined(__linux__) && defined(RUSAGE_THREAD)
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_THREAD, &ru) != 0)
+        return 0;
+    return (uint64_t) (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000 +
+        (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000;
+#else
+    return 0;
+#endif
+}
+
+void LinkStats::update(const struct oc_stats *stats, SOCKET ssl_fd,
+                       bool dtls, uint64_t now)
+{
+    uint64_t total = stats->tx_bytes + stats->rx_bytes;
+    uint64_t bytes, rate, delivery = 0;
+    bool have_wire;
+
+    have_wire = read_socket(ssl_fd, &bytes, &delivery);
+
+    /* the first call is made on the session thread */
+    if (last_time == 0) {
+        start_cpu = thread_cpu_ms();
+        first_payload = total;
+    }
+
+    /* with DTLS up the socket carries little, and its rate means little */
+    if (dtls == false && delivery > link_rate)
+        link_rate = delivery;
+
+    if (last_time != 0 && now > last_time && total >= last_payload) {
+        rate = (total - last_payload) * 1000 / (now - last_time);
+        if (rate > peak)
+            peak = rate;
+
+        /* a reconnect starts a new socket and new counters */
+        if (dtls == false && have_wire && ssl_fd == last_fd
+            && bytes >= last_wire) {
+            payload += total - last_payload;
+            wire += bytes - last_wire;
+        }
+    }
+
+    last_time = now;
+    last_payload = total;
+    last_fd = have_wire ? ssl_fd : INVALID_SOCKET;
+    last_wire = have_wire ? bytes : 0;
+    cpu_ms = thread_cpu_ms() - start_cpu;
+}
+
+double LinkStats::get_wire_ratio()
+{
+    if (payload == 0)
+        return -1;
+    return (double)wire / payload;
+}
+
+uint64_t LinkStats::get_link_rate()
+{
+    if (link_rate != 0)
+        return link_rate;
+    return peak;
+}
+
+uint64_t LinkStats::get_cpu_rate()
+{
+    uint64_t moved;
+
+    if (last_payload < first_payload || cpu_ms == 0)
+        return 0;
+    moved = last_payload - first_payload;
+    if (moved < CPU_RATE_MIN_BYTES)
+        return 0;
+    return moved * 1000 / cpu_ms;
+}
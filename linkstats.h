@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LINKSTATS_H
+#define LINKSTATS_H
+
+#include "common.h"
+#include <stdint.h>
+
+extern "C" {
+#include <openconnect.h>
+}
+
+/* Link measurements of a session taken at every stats callback: the
+ * throughput, the rate the kernel measured on the CSTP socket, the CPU
+ * time of the session thread, and how the bytes on the CSTP socket
+ * compare to the tunneled payload. The comparison is only made over
+ * intervals without DTLS, when all traffic uses that socket.
+ */
+class LinkStats {
+ public:
+    LinkStats();
+
+    /* now is the session time in ms */
+    void update(const struct oc_stats *stats, SOCKET ssl_fd, bool dtls,
+                uint64_t now);
+
+    /* wire bytes per payload byte over TCP, or a negative value if
+     * unknown. It is the TLS and CSTP framing overhead, less what the
+     * compression saved; the compression ratio itself is not known. */
+    double get_wire_ratio();
+    uint64_t get_cpu_ms() {
+        return cpu_ms;
+    }
+    /* the highest throughput seen over a stats interval, bytes/s */
+    uint64_t get_peak_throughput() {
+        return peak;
+    }
+    /* the link rate in bytes/s: the highest delivery rate the kernel
+     * measured while the CSTP socket was not limited by the traffic, or
+     * the peak throughput where that is unknown; zero if unknown */
+    uint64_t get_link_rate();
+    /* the payload bytes/s the session thread could move at its CPU cost
+     * per byte so far (crypto, compression and copies), or zero if too
+     * little was moved to tell */
+    uint64_t get_cpu_rate();
+
+ private:
+    bool read_socket(SOCKET fd, uint64_t * bytes, uint64_t * rate);
+    uint64_t thread_cpu_ms();
+
+    uint64_t last_time;
+    uint64_t last_payload;
+    uint64_t last_wire;
+    SOCKET last_fd;
+    uint64_t payload;
+    uint64_t wire;
+    uint64_t peak;
+    uint64_t link_rate;
+    uint64_t first_payload;
+    uint64_t start_cpu;
+    uint64_t cpu_ms;
+};
+
+#endif                          // LINKSTATS_H
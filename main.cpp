@@ -18,26 +18,70 @@
  */
 
 #include "mainwindow.h"
+#include "singleinstance.h"
 #include <QApplication>
 #include <QCoreApplication>
 #include <QMessageBox>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+#include <QtConcurrent/QtConcurrentRun>
 #include <dialogs.h>
 #include "common.h"
+#include "pincache.h"
+#include "netconfig.h"
 extern "C" {
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include <openconnect.h>
 #include <gnutls/pkcs11.h>
 } static QStringList *log = NULL;
 
+static QElapsedTimer startup_timer;
+static QMutex startup_mutex;
+static bool startup_timing = false;
+static qint64 startup_last = 0;
+
+void startup_mark(const char *phase)
+{
+    QMutexLocker locker(&startup_mutex);
+    qint64 now;
+
+    if (startup_timing == false)
+        return;
+
+    now = startup_timer.elapsed();
+    fprintf(stderr, "startup: %-16s %6lld ms (+%lld ms)\n", phase,
+            (long long)now, (long long)(now - startup_last));
+    startup_last = now;
+}
+
+static void init_tls(void)
+{
+    gnutls_global_init();
+    openconnect_init_ssl();
+    startup_mark("tls init");
+}
+
 int pin_callback(void *userdata, int attempt, const char *token_url,
                  const char *token_label, unsigned flags, char *pin,
                  size_t pin_max)
 {
     MainWindow *w = (MainWindow *) userdata;
+    PinCache *cache = PinCache::instance();
     QString text, outtext, type = "user";
     bool ok;
 
+    /* a cached PIN is tried once; near a lock-out only the user answers */
+    if (attempt == 0
+        && (flags & (GNUTLS_PKCS11_PIN_FINAL_TRY | GNUTLS_PKCS11_PIN_COUNT_LOW))
+        == 0 && cache->lookup(token_url, pin, pin_max) == true)
+        return 0;
+    if (attempt > 0)
+        cache->forget(token_url);
+
     if (flags & GNUTLS_PIN_SO)
         type = QObject::tr("security officer");
 
@@ -50,6 +94,11 @@ int pin_callback(void *userdata, int attempt, const char *token_url,
     if (flags & GNUTLS_PKCS11_PIN_COUNT_LOW)
         outtext += QObject::tr(" Only few tries before token lock!");
 
+    /* the GUI may be waiting for the session thread to exit */
+    if (QThread::currentThread() != QCoreApplication::instance()->thread()
+        && w->disconnect_requested() == true)
+        return -1;
+
     MyInputDialog dialog(w, QLatin1String(token_url), outtext,
                          QLineEdit::Password);
     dialog.show();
@@ -59,6 +108,8 @@ int pin_callback(void *userdata, int attempt, const char *token_url,
         return -1;
 
     snprintf(pin, pin_max, "%s", text.toAscii().data());
+    if ((flags & GNUTLS_PIN_SO) == 0)
+        cache->store(token_url, pin);
     return 0;
 }
 
@@ -70,25 +121,108 @@ static void log_func(int level, const char *str)
     }
 }
 
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--show|--connect PROFILE|--disconnect|--status]\n",
+            prog);
+}
+
 int main(int argc, char *argv[])
 {
     int ret;
+    QString cmd = QLatin1String("show");
+    QString reply;
+
+    if (getenv("OPENCONNECT_GUI_STARTUP_TIMING") != NULL) {
+        startup_timing = true;
+        startup_timer.start();
+    }
+
+    if (argc == 2 && strcmp(argv[1], "--show") == 0) {
+        cmd = QLatin1String("show");
+    } else if (argc == 3 && strcmp(argv[1], "--connect") == 0) {
+        cmd = QLatin1String("connect ") + QString::fromLocal8Bit(argv[2]);
+    } else if (argc == 2 && strcmp(argv[1], "--disconnect") == 0) {
+        cmd = QLatin1String("disconnect");
+    } else if (argc == 2 && strcmp(argv[1], "--status") == 0) {
+        cmd = QLatin1String("status");
+    } else if (argc != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* hand the request to an already running instance, without paying
+     * for the GUI initialization */
+    {
+        QCoreApplication c(argc, argv);
+        ret = SingleInstance::forward(cmd, reply);
+    }
+    startup_mark("instance check");
+
+    if (ret == 0) {
+        if (cmd != QLatin1String("show"))
+            printf("%s\n", reply.toLocal8Bit().data());
+        return reply.startsWith(QLatin1String("error")) ? 1 : 0;
+    }
+
+    if (cmd == QLatin1String("status")) {
+        printf("not running\n");
+        return 1;
+    } else if (cmd == QLatin1String("disconnect")) {
+        return 0;
+    }
+
     QApplication a(argc, argv);
+    startup_mark("application");
     QVariant v;
+    SingleInstance instance;
+
+    ret = instance.listen();
+    if (ret == -1) {
+        /* another launch won the race since the check above; give it
+         * time to start listening */
+        for (int i = 0; i < 20; i++) {
+            ret = SingleInstance::forward(cmd, reply);
+            if (ret == 0)
+                break;
+            ms_sleep(100);
+        }
+        if (ret == 0) {
+            if (cmd != QLatin1String("show"))
+                printf("%s\n", reply.toLocal8Bit().data());
+            return reply.startsWith(QLatin1String("error")) ? 1 : 0;
+        }
+        fprintf(stderr, "another instance is running but does not answer on %s\n",
+                SingleInstance::server_name().toLocal8Bit().data());
+        return 1;
+    } else if (ret != 0) {
+        fprintf(stderr, "could not listen on %s\n",
+                SingleInstance::server_name().toLocal8Bit().data());
+    }
+#ifdef USE_NETLINK
+    /* no session of ours is running; one may have been killed */
+    NetConfig::recover();
+#endif
+
     MainWindow w;
+    instance.set_window(&w);
+    startup_mark("main window");
     QCoreApplication::setOrganizationDomain("redhat.com");
     QMessageBox msgBox;
     QSettings settings("Red Hat", "openconnect-gui");
 
-    gnutls_global_init();
 #ifndef _WIN32
     signal(SIGPIPE, SIG_IGN);
 #endif
-    openconnect_init_ssl();
+    /* nothing needs the TLS libraries before the first connection
+     * or profile edit; MainWindow waits for this to finish */
+    w.set_tls_init(QtConcurrent::run(init_tls));
 
 #ifdef ENABLE_PKCS11
     gnutls_pkcs11_set_pin_function(pin_callback, &w);
 #endif
+    /* before any thread can ask for it */
+    PinCache::instance();
 
 #if !defined(DEVEL)
     v = settings.value("mainwindow/size");
@@ -103,10 +237,17 @@ int main(int argc, char *argv[])
     if (v.isNull() == false && v.toInt() != 0) {
         w.setWindowState(Qt::WindowMaximized);
     }
+    startup_mark("geometry");
 #endif
 
     w.set_settings(&settings);
+    if (cmd.startsWith(QLatin1String("connect "))) {
+        reply = w.remote_connect(cmd.mid(8));
+        if (reply.startsWith(QLatin1String("error")))
+            fprintf(stderr, "%s\n", reply.toLocal8Bit().data());
+    }
     w.show();
+    startup_mark("window shown");
 
 #if !defined(_WIN32) && !defined(DEVEL)
     if (getuid() != 0) {
@@ -114,7 +255,9 @@ int main(int argc, char *argv[])
                        ("This program requires root privileges to fully function."));
         msgBox.setInformativeText(QObject::tr
                                   ("VPN connection establishment would fail."));
-        ret = msgBox.exec();
+        /* don't hold the event loop back for the warning */
+        msgBox.setModal(false);
+        msgBox.show();
     }
 #endif
 
@@ -127,11 +270,25 @@ int main(int argc, char *argv[])
 
     ret = a.exec();
 
+    /* quit otherwise than through the window (e.g. by the session
+     * manager): the session is logged off first all the same */
+    if (w.session_running() == true && w.quit_app() == true)
+        a.exec();
+
     settings.beginGroup("mainwindow");
     settings.setValue("size", w.size());
     settings.setValue("pos", w.pos());
     settings.setValue("fullscreen", w.isFullScreen());
     settings.endGroup();
 
+    /* the session could not be logged off in time, and its thread still
+     * uses the window; nothing is torn down under it */
+    if (w.session_running() == true) {
+        settings.sync();
+        fflush(stdout);
+        fflush(stderr);
+        _exit(ret);
+    }
+
     return ret;
 }
@@ -22,11 +22,13 @@
 extern "C" {
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 }
-#include <QtConcurrent/QtConcurrentRun>
 #include <QDateTime>
+#include <QCoreApplication>
 #include <QMessageBox>
 #include <vpninfo.h>
+#include "vpnworker.h"
 #include <storage.h>
 #include <gnutls/gnutls.h>
 #include <QLineEdit>
@@ -34,9 +36,11 @@ extern "C" {
 #include <QDialog>
 #include <QFutureWatcher>
 #include <QtNetwork/QNetworkProxyFactory>
-#include <QtNetwork/QNetworkProxy>
-#include <QtNetwork/QNetworkProxyQuery>
+#include <QtNetwork/QNetworkConfigurationManager>
 #include <QUrl>
+#include <QHostAddress>
+#include <QFileDialog>
+#include <QFile>
 #include "logdialog.h"
 #include "editdialog.h"
 #ifdef _WIN32
@@ -61,8 +65,23 @@ QMainWindow(parent), ui(new Ui::MainWindow)
     timer = new QTimer(this);
     blink_timer = new QTimer(this);
     this->cmd_fd = INVALID_SOCKET;
-
-    connect(ui->actionQuit, SIGNAL(triggered()), qApp, SLOT(quit()));
+    this->cancel_requested = false;
+    this->quitting = false;
+    this->keep_session = false;
+    this->status = STATUS_DISCONNECTED;
+    this->vpn_thread = NULL;
+    this->settings = NULL;
+    this->profiles_loaded = false;
+    this->trayIcon = NULL;
+    this->trayIconMenu = NULL;
+    this->minimizeAction = NULL;
+    this->restoreAction = NULL;
+    this->quitAction = NULL;
+    this->net_config = NULL;
+    this->flows.set_routes(&this->routes);
+    load_icons();
+
+    connect(ui->actionQuit, SIGNAL(triggered()), this, SLOT(quit_app()));
 
     connect(blink_timer, SIGNAL(timeout(void)), this, SLOT(blink_ui(void)),
             Qt::QueuedConnection);
@@ -74,59 +93,240 @@ QMainWindow(parent), ui(new Ui::MainWindow)
             SLOT(changeStatus(int)), Qt::QueuedConnection);
     QObject::connect(this, SIGNAL(log_changed(QString)), this,
                      SLOT(writeProgressBar(QString)), Qt::QueuedConnection);
-    QObject::connect(this, SIGNAL(stats_changed_sig(QString, QString, QString)),
-                     this, SLOT(statsChanged(QString, QString, QString)),
+    QObject::connect(this,
+                     SIGNAL(stats_changed_sig
+                            (QString, QString, QString, QString, QString)),
+                     this,
+                     SLOT(statsChanged
+                          (QString, QString, QString, QString, QString)),
                      Qt::QueuedConnection);
-    ui->iconLabel->setPixmap(OFF_ICON);
+    ui->iconLabel->setPixmap(off_icon);
     QNetworkProxyFactory::setUseSystemConfiguration(true);
+}
+
+/* The proxies found for a gateway may not apply on another network. The
+ * manager enumerates the network configurations when created, so that is
+ * left until the first connection, which is also when the cache is first
+ * filled.
+ */
+void MainWindow::watch_network()
+{
+    if (net_config != NULL)
+        return;
+
+    net_config = new QNetworkConfigurationManager(this);
+    connect(net_config,
+            SIGNAL(configurationChanged(const QNetworkConfiguration &)), this,
+            SLOT(network_changed()));
+}
+
+void MainWindow::network_changed()
+{
+    proxy_cache.invalidate();
+}
+
+/* the profile list is filled after the window is painted, unless a
+ * connection is asked for before */
+void MainWindow::load_profiles()
+{
+    if (this->profiles_loaded == true)
+        return;
+    reload_settings();
+    this->profiles_loaded = true;
+    startup_mark("profile list");
+}
+
+/* Work that is not needed to paint the window is done once the event
+ * loop is running: the profile list and the tray icon.
+ */
+void MainWindow::deferred_init()
+{
+    load_profiles();
 
     if (QSystemTrayIcon::isSystemTrayAvailable()) {
-        QIcon icon;
         createActions();
         createTrayIcon();
 
         connect(trayIcon, SIGNAL(activated(QSystemTrayIcon::ActivationReason)),
                 this, SLOT(iconActivated(QSystemTrayIcon::ActivationReason)));
 
-        icon.addPixmap(TRAY_OFF_ICON, QIcon::Normal, QIcon::Off);
-        trayIcon->setIcon(icon);
+        if (this->status == STATUS_CONNECTED)
+            trayIcon->setIcon(tray_on_icon);
+        else
+            trayIcon->setIcon(tray_off_icon);
         trayIcon->show();
+
+        minimizeAction->setEnabled(this->isVisible());
+        restoreAction->setEnabled(isMaximized() || !this->isVisible());
     } else {
         updateProgressBar(QLatin1String("System doesn't support tray icon"),
                           false);
         trayIcon = NULL;
     }
+    startup_mark("tray icon");
+}
+
+void MainWindow::remote_show()
+{
+    if (this->isHidden() || this->isMinimized())
+        this->showNormal();
+    this->raise();
+    this->activateWindow();
+}
+
+QString MainWindow::remote_connect(QString name)
+{
+    QString err;
+    int idx;
+
+    if (this->settings == NULL)
+        return QLatin1String("error: still starting");
+    if (this->quitting == true)
+        return QLatin1String("error: quitting");
+    load_profiles();
+
+    if (this->status != STATUS_DISCONNECTED) {
+        if (name == this->active_name)
+            return QLatin1String("ok");
+        return QLatin1String("error: already connected to ") +
+            this->active_name;
+    }
+
+    idx = ui->comboBox->findText(name);
+    if (idx == -1)
+        return QLatin1String("error: unknown profile ") + name;
+
+    ui->comboBox->setCurrentIndex(idx);
+    if (start_session(err) == false) {
+        if (err.isEmpty() == true)
+            err = QLatin1String("a session is being set up or torn down");
+        return QLatin1String("error: ") + err;
+    }
+    return QLatin1String("ok");
+}
+
+void MainWindow::remote_disconnect()
+{
+    if (this->status != STATUS_DISCONNECTED)
+        on_disconnectBtn_clicked();
+}
+
+QString MainWindow::status_text()
+{
+    if (this->status == STATUS_CONNECTED)
+        return QLatin1String("connected ") + this->active_name;
+    else if (this->status == STATUS_CONNECTING)
+        return QLatin1String("connecting ") + this->active_name;
+    return QLatin1String("disconnected");
+}
+
+/* The TLS libraries are initialized in a background thread during
+ * startup; anything that uses them must wait for that to complete.
+ */
+void MainWindow::wait_for_tls()
+{
+    if (this->tls_init.isFinished() == false) {
+        this->tls_init.waitForFinished();
+    }
 }
 
-static void term_thread(MainWindow * m, SOCKET * fd)
+void MainWindow::load_icons()
 {
-    char cmd = OC_CMD_CANCEL;
+    off_icon = QPixmap(QLatin1String(OFF_ICON));
+    on_icon = QPixmap(QLatin1String(ON_ICON));
+    connecting_icon = QPixmap(QLatin1String(CONNECTING_ICON));
+    connecting_icon2 = QPixmap(QLatin1String(CONNECTING_ICON2));
+
+    tray_off_icon.addPixmap(QPixmap(QLatin1String(TRAY_OFF_ICON)),
+                            QIcon::Normal, QIcon::Off);
+    tray_on_icon.addPixmap(QPixmap(QLatin1String(TRAY_ON_ICON)),
+                           QIcon::Normal, QIcon::Off);
+}
 
+/* cmd is OC_CMD_CANCEL, or OC_CMD_DETACH to leave the session on the
+ * gateway */
+static void term_thread(MainWindow * m, SOCKET * fd, char cmd)
+{
     if (*fd != INVALID_SOCKET) {
+        m->disconnect_started();
         int ret = pipe_write(*fd, &cmd, 1);
         if (ret < 0)
             m->updateProgressBar(QObject::tr("term_thread: IPC error: ") +
                                  QString::number(net_errno));
         *fd = INVALID_SOCKET;
-        ms_sleep(200);
     } else {
         m->vpn_status_changed(STATUS_DISCONNECTED);
     }
 }
 
+/* Quits once the session is logged off: the window goes away at once,
+ * and the application quits when the session thread finishes, or at
+ * SHUTDOWN_TIMEOUT if it does not. Returns true if the event loop must
+ * run for that.
+ */
+bool MainWindow::quit_app()
+{
+    if (this->vpn_thread == NULL) {
+        qApp->quit();
+        return false;
+    }
+    if (this->quitting == true)
+        return false;
+    this->quitting = true;
+
+    if (this->timer->isActive())
+        timer->stop();
+    if (trayIcon != NULL)
+        trayIcon->hide();
+    this->setVisible(false);
+
+    /* CANCEL makes openconnect log off the session; the thread exits
+     * once the session is freed */
+    QMutexLocker locker(&this->cmd_mutex);
+    this->cancel_requested = true;
+#ifdef USE_REATTACH
+    if (this->keep_session == true)
+        term_thread(this, &this->cmd_fd, OC_CMD_DETACH);
+    else
+#endif
+        term_thread(this, &this->cmd_fd, OC_CMD_CANCEL);
+
+    QTimer::singleShot(SHUTDOWN_TIMEOUT, this, SLOT(shutdown_expired()));
+    return true;
+}
+
+void MainWindow::shutdown_expired()
+{
+    if (this->vpn_thread == NULL)
+        return;
+
+    this->updateProgressBar(QObject::tr
+                            ("The session could not be logged off within ")
+                            + QString::number(SHUTDOWN_TIMEOUT) +
+                            QObject::tr(" ms; exiting without it"), false);
+    fprintf(stderr,
+            "The session could not be logged off within %d ms; exiting without it\n",
+            SHUTDOWN_TIMEOUT);
+    qApp->exit(1);
+}
+
+bool MainWindow::session_running()
+{
+    return this->vpn_thread != NULL && this->vpn_thread->isRunning();
+}
+
+/* main() does not destroy the window while the session thread runs;
+ * see quit_app() */
 MainWindow::~MainWindow()
 {
-    int counter = 10;
     if (this->timer->isActive())
         timer->stop();
 
-    if (this->futureWatcher.isRunning() == true) {
-        term_thread(this, &this->cmd_fd);
-    }
-    while (this->futureWatcher.isRunning() == true && counter > 0) {
-        ms_sleep(200);
-        counter--;
+    if (this->vpn_thread != NULL) {
+        delete this->vpn_thread;
+        this->vpn_thread = NULL;
     }
+
     delete ui;
     delete timer;
 }
@@ -156,17 +356,222 @@ QString value_to_string(uint64_t bytes)
     }
 }
 
-void MainWindow::statsChanged(QString tx, QString rx, QString dtls)
+void MainWindow::statsChanged(QString tx, QString rx, QString dtls,
+                              QString compression, QString dns_cache)
 {
+    ui->CompressionLabel->setText(compression);
+    ui->DNSCacheLabel->setText(dns_cache);
     ui->lcdDown->setText(rx);
     ui->lcdUp->setText(tx);
     ui->DTLSLabel->setText(dtls);
+    update_flows();
+    update_routes();
+}
+
+#define FLOWS_SHOWN 50
+
+static QString flow_addr(const uint8_t * addr, unsigned family, unsigned port)
+{
+    QString r;
+
+    if (family == 4) {
+        r = QHostAddress((quint32) addr[0] << 24 | addr[1] << 16 |
+                         addr[2] << 8 | addr[3]).toString();
+    } else {
+        r = QLatin1String("[") +
+            QHostAddress(const_cast < quint8 * >(addr)).toString() +
+            QLatin1String("]");
+    }
+
+    if (port != 0)
+        r += QLatin1String(":") + QString::number(port);
+    return r;
+}
+
+static bool parse_addr(QString str, uint8_t * addr, unsigned *family)
+{
+    QHostAddress a;
+    Q_IPV6ADDR a6;
+    quint32 a4;
+
+    if (a.setAddress(str.trimmed()) == false)
+        return false;
+
+    if (a.protocol() == QAbstractSocket::IPv6Protocol) {
+        a6 = a.toIPv6Address();
+        memcpy(addr, a6.c, 16);
+        *family = 6;
+    } else {
+        a4 = a.toIPv4Address();
+        addr[0] = a4 >> 24;
+        addr[1] = a4 >> 16;
+        addr[2] = a4 >> 8;
+        addr[3] = a4;
+        *family = 4;
+    }
+    return true;
+}
+
+void MainWindow::update_routes()
+{
+    std::vector < route_entry > list;
+    std::vector < uint64_t > tx, rx;
+    QTreeWidgetItem *item;
+    QStringList domains;
+    unsigned i;
+
+    list = routes.get_routes();
+    flows.route_totals(tx, rx, list.size());
+
+    ui->routeTree->clear();
+    for (i = 0; i < list.size(); i++) {
+        item = new QTreeWidgetItem(ui->routeTree);
+        item->setText(0, flow_addr(list[i].addr, list[i].family, 0) +
+                      QLatin1String("/") + QString::number(list[i].plen));
+        if (list[i].exclude)
+            item->setText(1, QObject::tr("direct"));
+        else
+            item->setText(1, QObject::tr("VPN"));
+        item->setText(2, value_to_string(tx[i]));
+        item->setText(3, value_to_string(rx[i]));
+    }
+
+    domains = routes.get_domains();
+    if (domains.isEmpty() == false)
+        ui->routeDomains->setText(QObject::tr("Split DNS: ") +
+                                  domains.join(", "));
+    else
+        ui->routeDomains->clear();
+}
+
+void MainWindow::on_routeQuery_returnPressed()
+{
+    uint8_t addr[16];
+    unsigned family;
+    int route;
+    bool vpn;
+    route_entry r;
+
+    if (this->status != STATUS_CONNECTED) {
+        ui->routeResult->setText(QObject::tr("not connected"));
+        return;
+    }
+
+    if (parse_addr(ui->routeQuery->text(), addr, &family) == false) {
+        ui->routeResult->setText(QObject::tr("invalid address"));
+        return;
+    }
+
+    vpn = routes.via_vpn(addr, family, &route);
+    if (vpn)
+        ui->routeResult->setText(QObject::tr("through the VPN"));
+    else
+        ui->routeResult->setText(QObject::tr("not through the VPN"));
+
+    if (route != -1) {
+        r = routes.get_routes().at(route);
+        ui->routeResult->setText(ui->routeResult->text() +
+                                 QObject::tr(" (matches ") +
+                                 flow_addr(r.addr, r.family, 0) +
+                                 QLatin1String("/") +
+                                 QString::number(r.plen) +
+                                 QLatin1String(")"));
+    }
 }
 
-void MainWindow::updateStats(const struct oc_stats *stats, QString dtls)
+void MainWindow::on_captureBox_toggled(bool checked)
+{
+    if (checked == false) {
+        capture.disable();
+        return;
+    }
+
+    if (capture.enable(ui->captureSnaplen->value()) == false) {
+        QMessageBox::warning(this, QLatin1String(APP_NAME),
+                             QObject::tr
+                             ("Not enough memory for the capture buffer."));
+        ui->captureBox->setChecked(false);
+    }
+}
+
+void MainWindow::on_captureSnaplen_valueChanged(int value)
+{
+    if (capture.is_enabled())
+        capture.enable(value);
+}
+
+void MainWindow::on_captureSaveBtn_clicked()
+{
+    QString filename;
+    int ret;
+
+    filename = QFileDialog::getSaveFileName(this,
+                                            tr("Save capture"), "",
+                                            tr("Capture Files (*.pcapng)"));
+    if (filename.isEmpty() == true)
+        return;
+
+    ret = capture.save_pcapng(QFile::encodeName(filename).constData(),
+                              ui->captureSeconds->value());
+    if (ret < 0) {
+        QMessageBox::warning(this, QLatin1String(APP_NAME),
+                             QObject::tr("Could not write ") + filename);
+        return;
+    }
+    updateProgressBar(QObject::tr("Saved ") + QString::number(ret) +
+                      QObject::tr(" packets to ") + filename);
+}
+
+void MainWindow::update_flows()
+{
+    std::vector < flow_entry > top;
+    QTreeWidgetItem *item;
+    QString proto;
+    unsigned i;
+
+    if (flows.get_packets() == 0)
+        return;
+
+    flows.top(top, FLOWS_SHOWN);
+
+    ui->flowTree->clear();
+    for (i = 0; i < top.size(); i++) {
+        const struct flow_key *key = &top[i].key;
+
+        if (key->proto == 6)
+            proto = QLatin1String("TCP");
+        else if (key->proto == 17)
+            proto = QLatin1String("UDP");
+        else if (key->proto == 1 || key->proto == 58)
+            proto = QLatin1String("ICMP");
+        else
+            proto = QString::number(key->proto);
+
+        item = new QTreeWidgetItem(ui->flowTree);
+        item->setText(0, proto);
+        item->setText(1, flow_addr(key->local, key->family, key->lport));
+        item->setText(2, flow_addr(key->remote, key->family, key->rport));
+        item->setText(3, value_to_string(top[i].tx_bytes));
+        item->setText(4, value_to_string(top[i].rx_bytes));
+    }
+
+    ui->flowSummary->setText(QObject::tr("Packets: ") +
+                             QString::number(flows.get_packets()) +
+                             QObject::tr(", untracked: ") +
+                             value_to_string(flows.get_untracked_bytes()) +
+                             QObject::tr(", idle or small flows dropped: ") +
+                             QString::number(flows.get_evicted()) +
+                             QObject::tr(", pump cost: ") +
+                             QString::number(flows.get_pump_cost()) +
+                             QObject::tr(" ns/packet"));
+}
+
+void MainWindow::updateStats(const struct oc_stats *stats, QString dtls,
+                             QString compression, QString dns_cache)
 {
     emit stats_changed_sig(value_to_string(stats->tx_bytes),
-                           value_to_string(stats->rx_bytes), dtls);
+                           value_to_string(stats->rx_bytes), dtls,
+                           compression, dns_cache);
 }
 
 void MainWindow::reload_settings()
@@ -184,7 +589,7 @@ void MainWindow::reload_settings()
 void MainWindow::set_settings(QSettings * s)
 {
     this->settings = s;
-    reload_settings();
+    QTimer::singleShot(0, this, SLOT(deferred_init()));
 };
 
 void MainWindow::writeProgressBar(QString str)
@@ -219,31 +624,55 @@ void MainWindow::blink_ui()
     static unsigned t = 1;
 
     if (t % 2 == 0) {
-        ui->iconLabel->setPixmap(CONNECTING_ICON);
+        ui->iconLabel->setPixmap(connecting_icon);
     } else {
-        ui->iconLabel->setPixmap(CONNECTING_ICON2);
+        ui->iconLabel->setPixmap(connecting_icon2);
     }
     t++;
 }
 
+/* The blink animation only runs while connecting and while the window
+ * can actually be seen; a tray-resident client has no wakeups for it.
+ */
+void MainWindow::update_blink_timer()
+{
+    if (this->status == STATUS_CONNECTING && this->isVisible()
+        && this->isMinimized() == false) {
+        if (blink_timer->isActive() == false)
+            blink_timer->start(BLINK_TIMER);
+    } else if (blink_timer->isActive()) {
+        blink_timer->stop();
+        if (this->status == STATUS_CONNECTING)
+            ui->iconLabel->setPixmap(connecting_icon);
+    }
+}
+
+void MainWindow::changeEvent(QEvent * e)
+{
+    QMainWindow::changeEvent(e);
+    if (e->type() == QEvent::WindowStateChange)
+        update_blink_timer();
+}
+
 void MainWindow::changeStatus(int val)
 {
-    QIcon icon;
+    this->status = val;
     if (val == STATUS_CONNECTED) {
 
-        blink_timer->stop();
-        ui->iconLabel->setPixmap(ON_ICON);
+        update_blink_timer();
+        ui->iconLabel->setPixmap(on_icon);
         ui->disconnectBtn->setEnabled(true);
         ui->connectBtn->setEnabled(false);
 
-        icon.addPixmap(TRAY_ON_ICON, QIcon::Normal, QIcon::Off);
-        trayIcon->setIcon(icon);
+        if (trayIcon)
+            trayIcon->setIcon(tray_on_icon);
 
         this->ui->IPLabel->setText(ip);
         this->ui->IP6Label->setText(ip6);
         this->ui->DNSLabel->setText(dns);
         this->ui->CSTPLabel->setText(cstp_cipher);
         this->ui->DTLSLabel->setText(dtls_cipher);
+        this->ui->MTULabel->setText(mtu);
 
         timer->start(UPDATE_TIMER);
 
@@ -260,16 +689,17 @@ void MainWindow::changeStatus(int val)
 
     } else if (val == STATUS_CONNECTING) {
 
-        if (trayIcon) {
-            icon.addPixmap(TRAY_OFF_ICON, QIcon::Normal, QIcon::Off);
-            trayIcon->setIcon(icon);
-        }
-        ui->iconLabel->setPixmap(CONNECTING_ICON);
+        if (trayIcon)
+            trayIcon->setIcon(tray_off_icon);
+        ui->iconLabel->setPixmap(connecting_icon);
         ui->disconnectBtn->setEnabled(true);
         ui->connectBtn->setEnabled(false);
-        blink_timer->start(1500);
+        update_blink_timer();
+        /* the session may be re-established without a command pipe */
+        if (this->timer->isActive())
+            timer->stop();
     } else if (val == STATUS_DISCONNECTED) {
-        blink_timer->stop();
+        update_blink_timer();
         if (this->timer->isActive())
             timer->stop();
         disable_cmd_fd();
@@ -279,15 +709,24 @@ void MainWindow::changeStatus(int val)
         ui->IPLabel->setText("");
         ui->DNSLabel->setText("");
         ui->IP6Label->setText("");
-        this->updateProgressBar(QObject::tr("Disconnected"));
+        ui->MTULabel->setText("");
+        ui->CompressionLabel->setText("");
+        ui->DNSCacheLabel->setText("");
+        if (disconnect_timer.isValid()) {
+            this->updateProgressBar(QObject::tr("Disconnected in ") +
+                                    QString::number(disconnect_timer.elapsed()) +
+                                    QObject::tr(" ms"));
+            disconnect_timer.invalidate();
+        } else {
+            this->updateProgressBar(QObject::tr("Disconnected"));
+        }
 
         ui->disconnectBtn->setEnabled(false);
         ui->connectBtn->setEnabled(true);
-        ui->iconLabel->setPixmap(OFF_ICON);
+        ui->iconLabel->setPixmap(off_icon);
 
         if (trayIcon) {
-            icon.addPixmap(TRAY_OFF_ICON, QIcon::Normal, QIcon::Off);
-            trayIcon->setIcon(icon);
+            trayIcon->setIcon(tray_off_icon);
 
             if (this->isHidden() == true)
                 trayIcon->showMessage(QLatin1String("Disconnected"), QLatin1String("You were disconnected from the VPN"),
@@ -297,74 +736,60 @@ void MainWindow::changeStatus(int val)
     }
 }
 
-static void main_loop(VpnInfo * vpninfo, MainWindow * m)
+void MainWindow::vpn_connecting()
 {
-    int ret;
-    QString ip, ip6, dns, cstp, dtls;
-    bool retry = false;
-    QString oldpass, oldgroup;
-    bool reset_password = false;
-    int retries = 2;
-    bool pass_was_empty;
-
-    m->vpn_status_changed(STATUS_CONNECTING);
-
-    pass_was_empty = vpninfo->ss->get_password().isEmpty();
-
-    do {
-        retry = false;
-        ret = vpninfo->connect();
-        if (ret != 0) {
-	    if (retries-- <= 0)
-               goto fail;
-
-            if (pass_was_empty != true) {
-                /* authentication failed in batch mode? switch to non
-                 * batch and retry */
-                oldpass = vpninfo->ss->get_password();
-                oldgroup = vpninfo->ss->get_groupname();
-                vpninfo->ss->clear_password();
-                vpninfo->ss->clear_groupname();
-                retry = true;
-                reset_password = true;
-                m->updateProgressBar(QObject::tr
-                                     ("Authentication failed in batch mode, retrying with batch mode disabled"));
-                vpninfo->reset_vpn();
-                continue;
-            }
-
-            /* if we didn't manage to connect on a retry, the failure reason
-             * may not have been a changed password, reset it */
-            if (reset_password == true) {
-                vpninfo->ss->set_password(oldpass);
-                vpninfo->ss->set_groupname(oldgroup);
-            }
-
-            m->updateProgressBar(vpninfo->last_err);
-            goto fail;
-        }
+    changeStatus(STATUS_CONNECTING);
+}
 
+void MainWindow::vpn_connected(QString dns, QString ip, QString ip6,
+                               QString cstp_cipher, QString dtls_cipher,
+                               QString mtu)
+{
+    this->mtu = mtu;
+    this->dns = dns;
+    this->ip = ip;
+    this->ip6 = ip6;
+    this->cstp_cipher = cstp_cipher;
+    this->dtls_cipher = dtls_cipher;
+    changeStatus(STATUS_CONNECTED);
+    update_routes();
+}
 
-    } while (retry == true);
+void MainWindow::vpn_disconnected(QString reason)
+{
+    routes.clear();
+    ui->routeTree->clear();
+    ui->routeDomains->clear();
+    ui->routeResult->clear();
+    changeStatus(STATUS_DISCONNECTED);
+}
 
-    ret = vpninfo->dtls_connect();
-    if (ret != 0) {
-        m->updateProgressBar(vpninfo->last_err);
+void MainWindow::vpn_thread_finished()
+{
+    if (this->vpn_thread != NULL) {
+        this->vpn_thread->deleteLater();
+        this->vpn_thread = NULL;
     }
+    if (this->quitting == true)
+        qApp->quit();
+}
 
-    vpninfo->get_info(dns, ip, ip6);
-    vpninfo->get_cipher_info(cstp, dtls);
-    m->vpn_status_changed(STATUS_CONNECTED, dns, ip, ip6, cstp, dtls);
-
-    vpninfo->ss->save();
-
-    vpninfo->mainloop();
+/* Queues a reload of the profile on the session thread; the stats
+ * command wakes the thread up to execute it.
+ */
+void MainWindow::request_reconfigure()
+{
+    char cmd = OC_CMD_STATS;
+    QMutexLocker locker(&this->cmd_mutex);
 
- fail:
-    m->vpn_status_changed(STATUS_DISCONNECTED);
+    if (this->vpn_thread == NULL || this->cmd_fd == INVALID_SOCKET)
+        return;
 
-    delete vpninfo;
-    return;
+    emit reconfigure_sig();
+    if (pipe_write(this->cmd_fd, &cmd, 1) < 0) {
+        this->updateProgressBar(QObject::tr("reconfigure: IPC error: ") +
+                                QString::number(net_errno));
+    }
 }
 
 void MainWindow::on_disconnectBtn_clicked()
@@ -372,112 +797,145 @@ void MainWindow::on_disconnectBtn_clicked()
     if (this->timer->isActive())
         this->timer->stop();
     this->updateProgressBar(QObject::tr("Disconnecting..."));
-    term_thread(this, &this->cmd_fd);
+
+    QMutexLocker locker(&this->cmd_mutex);
+    this->cancel_requested = true;
+    term_thread(this, &this->cmd_fd, OC_CMD_CANCEL);
+}
+
+/* The session thread swaps the command pipe under the lock before it
+ * frees a session, so that nothing is written to a closed pipe. */
+bool MainWindow::set_cmd_fd(SOCKET fd)
+{
+    QMutexLocker locker(&this->cmd_mutex);
+
+    if (fd != INVALID_SOCKET && this->cancel_requested == true)
+        return false;
+    this->cmd_fd = fd;
+    return true;
+}
+
+bool MainWindow::disconnect_requested()
+{
+    QMutexLocker locker(&this->cmd_mutex);
+
+    return this->cancel_requested;
 }
 
 void MainWindow::on_connectBtn_clicked()
+{
+    QString err;
+
+    if (start_session(err) == false && err.isEmpty() == false)
+        QMessageBox::information(this, tr(APP_NAME), err);
+}
+
+/* Starts the session thread for the selected profile. Returns false if
+ * none was started, with the reason in err; err is left empty when the
+ * button is disabled, as a click then does nothing.
+ */
+bool MainWindow::start_session(QString & err)
 {
     VpnInfo *vpninfo = NULL;
-    StoredServer *ss = new StoredServer(this->settings);
-    QFuture < void >future;
-    QString name, str, url;
-    QList < QNetworkProxy > proxies;
-    QUrl turl;
-    QNetworkProxyQuery query;
+    VpnWorker *worker;
+    StoredServer *ss;
+    QString name;
 
     if (ui->connectBtn->isEnabled() == false) {
-        return;
+        return false;
     }
 
     if (this->cmd_fd != INVALID_SOCKET) {
-        QMessageBox::information(this,
-                                 tr(APP_NAME),
-                                 tr
-                                 ("A previous VPN instance is still running (socket is active)"));
-        return;
+        err =
+            tr
+            ("A previous VPN instance is still running (socket is active)");
+        return false;
     }
 
-    if (this->futureWatcher.isRunning() == true) {
-        QMessageBox::information(this,
-                                 tr(APP_NAME),
-                                 tr
-                                 ("A previous VPN instance is still running"));
-        return;
+    if (this->vpn_thread != NULL) {
+        err = tr("A previous VPN instance is still running");
+        return false;
     }
 
     if (ui->comboBox->currentText().isEmpty()) {
-        QMessageBox::information(this,
-                                 tr(APP_NAME),
-                                 tr
-                                 ("You need to specify a gateway. E.g. vpn.example.com:443"));
-        return;
+        err = tr("You need to specify a gateway. E.g. vpn.example.com:443");
+        return false;
     }
 
     name = ui->comboBox->currentText();
+    this->active_name = name;
+    wait_for_tls();
+    ss = new StoredServer(this->settings);
     ss->load(name);
-    turl.setUrl("https://" + ss->get_servername());
-    query.setUrl(turl);
 
     /* ss is now deallocated by vpninfo */
     vpninfo = new VpnInfo(tr(APP_STRING), ss, this);
     if (vpninfo == NULL) {
-        QMessageBox::information(this,
-                                 tr(APP_NAME),
-                                 tr
-                                 ("There was an issue initializing the VPN."));
+        err = tr("There was an issue initializing the VPN.");
         goto fail;
     }
 
     this->minimize_on_connect = vpninfo->get_minimize();
+    this->keep_session = ss->get_keep_session();
+    this->cancel_requested = false;
 
     vpninfo->parse_url(ss->get_servername().toLocal8Bit().data());
 
     this->cmd_fd = vpninfo->get_cmd_fd();
     if (this->cmd_fd == INVALID_SOCKET) {
-        QMessageBox::information(this,
-                                 tr(APP_NAME),
-                                 tr
-                                 ("There was an issue establishing IPC with openconnect; try restarting the application."));
+        err =
+            tr
+            ("There was an issue establishing IPC with openconnect; try restarting the application.");
         goto fail;
     }
 
-    proxies = QNetworkProxyFactory::systemProxyForQuery(query);
-    if (proxies.size() > 0 && proxies.at(0).type() != QNetworkProxy::NoProxy) {
-        if (proxies.at(0).type() == QNetworkProxy::Socks5Proxy)
-            url = "socks5://";
-        else if (proxies.at(0).type() == QNetworkProxy::HttpCachingProxy
-                 || proxies.at(0).type() == QNetworkProxy::HttpProxy)
-            url = "http://";
-
-        if (url.isEmpty() == false) {
-
-            str =
-                proxies.at(0).user() + ":" + proxies.at(0).password() + "@" +
-                proxies.at(0).hostName();
-            if (proxies.at(0).port() != 0) {
-                str += ":" + QString::number(proxies.at(0).port());
-            }
-            this->updateProgressBar(tr("Setting proxy to: ") + str);
-            openconnect_set_http_proxy(vpninfo->vpninfo, str.toAscii().data());
-        }
-    }
-
-    future = QtConcurrent::run(main_loop, vpninfo, this);
+    /* each session gets its own thread; it is blocked in openconnect
+     * for the lifetime of the tunnel */
+    this->vpn_thread = new QThread();
+    worker = new VpnWorker(vpninfo, this);
+    worker->moveToThread(this->vpn_thread);
+
+    connect(this->vpn_thread, SIGNAL(started()), worker, SLOT(run()));
+    connect(worker, SIGNAL(finished()), this->vpn_thread, SLOT(quit()),
+            Qt::DirectConnection);
+    connect(this->vpn_thread, SIGNAL(finished()), worker,
+            SLOT(deleteLater()));
+    connect(this->vpn_thread, SIGNAL(finished()), this,
+            SLOT(vpn_thread_finished()), Qt::QueuedConnection);
+
+    connect(worker, SIGNAL(connecting()), this, SLOT(vpn_connecting()),
+            Qt::QueuedConnection);
+    connect(worker,
+            SIGNAL(connected
+                   (QString, QString, QString, QString, QString, QString)),
+            this,
+            SLOT(vpn_connected
+                 (QString, QString, QString, QString, QString, QString)),
+            Qt::QueuedConnection);
+    connect(worker, SIGNAL(disconnected(QString)), this,
+            SLOT(vpn_disconnected(QString)), Qt::QueuedConnection);
+    connect(this, SIGNAL(reconfigure_sig()), worker, SLOT(reconfigure()),
+            Qt::QueuedConnection);
 
-    this->futureWatcher.setFuture(future);
+    watch_network();
+    this->vpn_thread->start();
 
-    return;
+    return true;
  fail:
     if (vpninfo != NULL)
         delete vpninfo;
-    return;
+    return false;
 }
 
 void MainWindow::on_toolButton_clicked()
 {
     int idx;
+
+    wait_for_tls();
     EditDialog dialog(ui->comboBox->currentText(), this->settings);
     dialog.exec();
+    if (ui->comboBox->currentText() == this->active_name)
+        request_reconfigure();
     idx = ui->comboBox->currentIndex();
     reload_settings();
     if (idx < ui->comboBox->maxVisibleItems() && idx >= 0) {
@@ -532,6 +990,10 @@ void MainWindow::closeEvent(QCloseEvent * event)
 	}
         hideWindow();
         event->ignore();
+    } else if (this->vpn_thread != NULL) {
+        /* the last window; the session is logged off first */
+        event->ignore();
+        quit_app();
     }
 }
 
@@ -558,6 +1020,10 @@ void MainWindow::on_pushButton_3_clicked()
 void MainWindow::request_update_stats()
 {
     char cmd = OC_CMD_STATS;
+    QMutexLocker locker(&this->cmd_mutex);
+
+    /* the stats tick doubles as the clock of the PIN cache */
+    PinCache::instance()->expire();
     if (this->cmd_fd != INVALID_SOCKET) {
         int ret = pipe_write(this->cmd_fd, &cmd, 1);
         if (ret < 0) {
@@ -649,9 +1115,13 @@ void MainWindow::createTrayIcon()
 
 void MainWindow::setVisible(bool visible)
 {
-    minimizeAction->setEnabled(visible);
-    restoreAction->setEnabled(isMaximized() || !visible);
+    /* the tray actions are created after the window is first shown */
+    if (minimizeAction != NULL) {
+        minimizeAction->setEnabled(visible);
+        restoreAction->setEnabled(isMaximized() || !visible);
+    }
     QMainWindow::setVisible(visible);
+    update_blink_timer();
 }
 
 void MainWindow::iconActivated(QSystemTrayIcon::ActivationReason reason)
@@ -675,7 +1145,7 @@ void MainWindow::createActions()
     connect(restoreAction, SIGNAL(triggered()), this, SLOT(showNormal()));
 
     quitAction = new QAction(tr("&Quit"), this);
-    connect(quitAction, SIGNAL(triggered()), qApp, SLOT(quit()));
+    connect(quitAction, SIGNAL(triggered()), this, SLOT(quit_app()));
 }
 
 
@@ -24,11 +24,20 @@
 #include <QCoreApplication>
 #include <QSettings>
 #include <QFutureWatcher>
+#include <QFuture>
 #include <QMutex>
+#include <QThread>
+#include <QElapsedTimer>
 #include "common.h"
+#include "flowtable.h"
+#include "routetable.h"
+#include "packetring.h"
+#include "proxycache.h"
 #include <QTimer>
 #include <QMenu>
 #include <QSystemTrayIcon>
+#include <QPixmap>
+#include <QIcon>
 #ifndef _WIN32
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -47,13 +56,19 @@ extern "C" {
     STATUS_CONNECTED
 };
 
+class QNetworkConfigurationManager;
+
 class MainWindow:public QMainWindow {
  Q_OBJECT public:
      explicit MainWindow(QWidget * parent = 0);
     void updateProgressBar(QString str);
     void updateProgressBar(QString str, bool show);
     void set_settings(QSettings * s);
-    void updateStats(const struct oc_stats *stats, QString dtls);
+    void set_tls_init(QFuture < void >f) {
+        this->tls_init = f;
+    }
+    void updateStats(const struct oc_stats *stats, QString dtls,
+                     QString compression, QString dns_cache);
     void reload_settings();
     void toggleWindow();
     void hideWindow();
@@ -62,33 +77,70 @@ class MainWindow:public QMainWindow {
 
     ~MainWindow();
     void disable_cmd_fd() {
+        QMutexLocker locker(&this->cmd_mutex);
         cmd_fd = INVALID_SOCKET;
     };
 
+    /* called by the session thread when it replaces the session; fails
+     * once a disconnect was requested */
+    bool set_cmd_fd(SOCKET fd);
+    bool disconnect_requested();
+
     void vpn_status_changed(int connected) {
         emit vpn_status_changed_sig(connected);
     };
 
-    void vpn_status_changed(int connected, QString & dns, QString & ip,
-                            QString & ip6, QString & cstp_cipher,
-                            QString & dtls_cipher) {
-        this->dns = dns;
-        this->ip = ip;
-        this->ip6 = ip6;
-        this->dtls_cipher = dtls_cipher;
-        this->cstp_cipher = cstp_cipher;
-        emit vpn_status_changed_sig(connected);
-    };
+    /* starts measuring the time from a disconnect request to idle */
+    void disconnect_started() {
+        disconnect_timer.start();
+    }
 
     QStringList *get_log(void) {
         return &this->log;
     }
+
+    FlowTable *get_flows(void) {
+        return &this->flows;
+    }
+
+    RouteTable *get_routes(void) {
+        return &this->routes;
+    }
+
+    PacketRing *get_capture(void) {
+        return &this->capture;
+    }
+
+    ProxyCache *get_proxy_cache(void) {
+        return &this->proxy_cache;
+    }
+
+    /* the session thread still runs, and uses this window */
+    bool session_running();
+
+    /* requests handed over by a second instance; the replies are "ok"
+     * or "error: " and why */
+    void remote_show();
+    QString remote_connect(QString name);
+    void remote_disconnect();
+    QString status_text();
+
+    public slots:bool quit_app();
+
  private slots:
+    void deferred_init(void);
     void iconActivated(QSystemTrayIcon::ActivationReason reason);
-    void statsChanged(QString, QString, QString);
+    void statsChanged(QString, QString, QString, QString, QString);
     void writeProgressBar(QString str);
     void changeStatus(int);
 
+    void vpn_connecting();
+    void vpn_connected(QString dns, QString ip, QString ip6,
+                       QString cstp_cipher, QString dtls_cipher, QString mtu);
+    void vpn_disconnected(QString reason);
+    void vpn_thread_finished();
+    void shutdown_expired();
+
     void blink_ui(void);
     void clear_logdialog(void);
     void clear_log(void);
@@ -104,32 +156,78 @@ class MainWindow:public QMainWindow {
     void on_toolButton_2_clicked();
 
     void closeEvent(QCloseEvent * bar);
+    void changeEvent(QEvent * e);
 
     void on_pushButton_3_clicked();
 
+    void on_routeQuery_returnPressed();
+
+    void on_captureBox_toggled(bool checked);
+
+    void on_captureSnaplen_valueChanged(int value);
+
+    void on_captureSaveBtn_clicked();
+
+    void network_changed();
+
 signals:
     void log_changed(QString val);
-    void stats_changed_sig(QString, QString, QString);
+    void stats_changed_sig(QString, QString, QString, QString, QString);
     void vpn_status_changed_sig(int);
+    void reconfigure_sig();
     void timeout(void);
 
  private:
     void createTrayIcon();
+    void load_icons();
+    void watch_network();
+    void load_profiles();
+    bool start_session(QString & err);
+    void wait_for_tls();
+    void request_reconfigure();
+    void update_blink_timer();
+    void update_flows();
+    void update_routes();
     /* we keep the fd instead of a pointer to vpninfo to avoid
      * any multithread issues */
     SOCKET cmd_fd;
+    QMutex cmd_mutex;           // cmd_fd, against the session thread
+    bool cancel_requested;
+    bool quitting;              // the session is logged off, then we quit
     bool minimize_on_connect;
+    bool keep_session;          // detach instead of logging off on exit
     Ui::MainWindow * ui;
     QSettings *settings;
     QMutex progress_mutex;
     QStringList log;
     QTimer *timer;
     QTimer *blink_timer;
-    QFutureWatcher < void >futureWatcher;       // watches the vpninfo
+    int status;
+    QThread *vpn_thread;        // runs the session's VpnWorker
+    QElapsedTimer disconnect_timer;
+    QFuture < void >tls_init;   // gnutls/openconnect init, run in background
+
+    QString active_name;        // profile of the running session
+    bool profiles_loaded;
+
+    FlowTable flows;            // filled by the userspace tun pump
+    RouteTable routes;          // split-tunnel policy of the session
+    PacketRing capture;         // recent packet headers, if enabled
+    ProxyCache proxy_cache;     // system proxies per gateway host
+    QNetworkConfigurationManager *net_config;   // created on first connect
 
     QString dns, ip, ip6;
     QString cstp_cipher;
     QString dtls_cipher;
+    QString mtu;
+
+    /* decoded once and shared by the window and the tray icon */
+    QPixmap off_icon;
+    QPixmap on_icon;
+    QPixmap connecting_icon;
+    QPixmap connecting_icon2;
+    QIcon tray_off_icon;
+    QIcon tray_on_icon;
 
     QSystemTrayIcon *trayIcon;
     QMenu *trayIconMenu;
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mtuprobe.h"
+
+/* a lost probe is retried once before the size is given up; once a
+ * reply came back, a probe waits a few times its round trip */
+#define PROBE_TRIES 2
+#define PROBE_TIMEOUT 400       /* ms */
+#define PROBE_MIN_TIMEOUT 50
+#define PROBE_RTTS 4
+
+unsigned MtuProbe::search(unsigned low, unsigned high)
+{
+    unsigned mid;
+
+    if (high < low || probe(low) == false)
+        return 0;
+
+    if (probe(high) == true)
+        return high;
+
+    /* low passes and high fails */
+    while (high - low > 1) {
+        mid = low + (high - low) / 2;
+        if (probe(mid) == true)
+            low = mid;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+#ifdef USE_MTU_PROBE
+
+extern "C" {
+#include <netinet/in.h>
+#include <netinet/ip_icmp.h>
+#include <netinet/icmp6.h>
+#include <netdb.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+}
+
+IcmpMtuProbe::IcmpMtuProbe()
+{
+    fd = -1;
+    family = AF_INET;
+    addr_len = 0;
+    seq = 0;
+    timeout = PROBE_TIMEOUT;
+}
+
+IcmpMtuProbe::~IcmpMtuProbe()
+{
+    if (fd != -1)
+        close(fd);
+}
+
+int IcmpMtuProbe::open(const char *host, std::string & err)
+{
+    struct addrinfo hints, *res;
+    int ret, val;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_DGRAM;
+    ret = getaddrinfo(host, NULL, &hints, &res);
+    if (ret != 0) {
+        err = gai_strerror(ret);
+        return -1;
+    }
+
+    family = res->ai_family;
+    addr_len = res->ai_addrlen;
+    memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+
+    if (family == AF_INET6) {
+        fd = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_ICMPV6);
+        val = IPV6_PMTUDISC_PROBE;
+        if (fd != -1)
+            setsockopt(fd, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &val,
+                       sizeof(val));
+    } else {
+        fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_ICMP);
+        /* set DF but do not clamp to the cached path MTU */
+        val = IP_PMTUDISC_PROBE;
+        if (fd != -1)
+            setsockopt(fd, IPPROTO_IP, IP_MTU_DISCOVER, &val, sizeof(val));
+    }
+
+    if (fd != -1 && connect(fd, (struct sockaddr *)&addr, addr_len) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    return 0;
+}
+
+unsigned IcmpMtuProbe::kernel_mtu()
+{
+    int s, mtu = 0;
+    socklen_t len = sizeof(mtu);
+
+    s = socket(family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (s < 0)
+        return 0;
+
+    /* a connected UDP socket reports the route's path MTU; nothing is
+     * sent */
+    if (connect(s, (struct sockaddr *)&addr, addr_len) == 0) {
+        if (family == AF_INET6)
+            getsockopt(s, IPPROTO_IPV6, IPV6_MTU, &mtu, &len);
+        else
+            getsockopt(s, IPPROTO_IP, IP_MTU, &mtu, &len);
+    }
+    close(s);
+
+    if (mtu < 0)
+        return 0;
+    return mtu;
+}
+
+static int elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 +
+        (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+bool IcmpMtuProbe::probe(unsigned size)
+{
+    unsigned char buf[65536];
+    struct pollfd pfd;
+    struct timespec start;
+    unsigned hdr = get_header_size() - 8;       /* the IP header */
+    unsigned char reply_type;
+    unsigned short rseq;
+    int i, left;
+    ssize_t ret;
+
+    if (size <= get_header_size() || size > sizeof(buf))
+        return false;
+
+    reply_type = (family == AF_INET6) ? ICMP6_ECHO_REPLY : ICMP_ECHOREPLY;
+
+    for (i = 0; i < PROBE_TRIES; i++) {
+        seq++;
+
+        /* the kernel fills in the identifier and the checksum */
+        memset(buf, 0, size - hdr);
+        buf[0] = (family == AF_INET6) ? ICMP6_ECHO_REQUEST : ICMP_ECHO;
+        buf[6] = seq >> 8;
+        buf[7] = seq & 0xff;
+
+        if (send(fd, buf, size - hdr, 0) < 0) {
+            /* EMSGSIZE: larger than the local interface */
+            return false;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (;;) {
+            left = timeout - elapsed_ms(&start);
+            if (left <= 0)
+                break;
+
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, left) <= 0)
+                break;
+
+            ret = recv(fd, buf, sizeof(buf), 0);
+            if (ret < 8)
+                continue;
+
+            rseq = (buf[6] << 8) | buf[7];
+            if (buf[0] == reply_type && rseq == seq) {
+                if (timeout == PROBE_TIMEOUT) {
+                    timeout = PROBE_RTTS * elapsed_ms(&start);
+                    if (timeout < PROBE_MIN_TIMEOUT)
+                        timeout = PROBE_MIN_TIMEOUT;
+                    else if (timeout > PROBE_TIMEOUT)
+                        timeout = PROBE_TIMEOUT;
+                }
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+unsigned IcmpMtuProbe::run()
+{
+    unsigned high, low;
+
+    if (fd == -1)
+        return 0;
+
+    high = kernel_mtu();
+    if (high == 0)
+        high = 1500;
+    low = (family == AF_INET6) ? 1280 : 576;
+
+    return search(low, high);
+}
+
+#endif                          // USE_MTU_PROBE
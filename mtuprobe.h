@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MTUPROBE_H
+#define MTUPROBE_H
+
+#include "common.h"
+#include <string>
+
+/* Finds the largest packet size that crosses the path. The search only
+ * relies on probe(), so it can be driven by anything that drops packets
+ * above some size.
+ */
+class MtuProbe {
+ public:
+    virtual ~MtuProbe() {
+    }
+    /* the largest size in [low, high] that probe() accepts, or zero if
+     * not even low passes */
+    unsigned search(unsigned low, unsigned high);
+
+ protected:
+    virtual bool probe(unsigned size) = 0;
+};
+
+#ifdef USE_MTU_PROBE
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+}
+
+/* Probes with ICMP echo requests that may not be fragmented, sent over
+ * an unprivileged ping socket (see net.ipv4.ping_group_range), which the
+ * system may not allow.
+ */
+class IcmpMtuProbe:public MtuProbe {
+ public:
+    IcmpMtuProbe();
+    ~IcmpMtuProbe();
+
+    /* resolves the host; returns zero on success */
+    int open(const char *host, std::string & err);
+    /* probes the path up to the MTU of the route to it; zero if the
+     * probes do not get through */
+    unsigned run();
+
+    /* IP and ICMP header size */
+    unsigned get_header_size() {
+        return family == AF_INET6 ? 48 : 28;
+    }
+    bool is_ipv6() {
+        return family == AF_INET6;
+    }
+
+ protected:
+    bool probe(unsigned size);
+
+ private:
+    unsigned kernel_mtu();
+
+    int fd;
+    int family;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    unsigned short seq;
+    int timeout;                /* ms */
+};
+
+#endif                          // USE_MTU_PROBE
+
+#endif                          // MTUPROBE_H
@@ -0,0 +1,574 @@
+#include "netconfig.h"
+
+#ifdef USE_NETLINK
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_addr.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+}
+
+#define RESOLV_CONF "/etc/resolv.conf"
+#define RESOLV_TMP RESOLV_CONF ".openconnect-gui"
+/* the replaced file, kept until the session ends in case it does not
+ * end cleanly */
+#define RESOLV_BACKUP RESOLV_CONF ".openconnect-gui.orig"
+#define RESOLV_HEADER "# Generated by openconnect-gui\n"
+#define NL_BUFSIZE 32768
+#define NL_TIMEOUT 2            /* seconds to wait for the kernel's answers */
+
+typedef std::vector < uint8_t > msg_t;
+
+static void nl_begin(msg_t & m, uint16_t type, uint16_t flags)
+{
+    struct nlmsghdr *h;
+
+    m.assign(NLMSG_HDRLEN, 0);
+    h = (struct nlmsghdr *)&m[0];
+    h->nlmsg_type = type;
+    h->nlmsg_flags = flags;
+}
+
+static void nl_put(msg_t & m, const void *p, size_t len)
+{
+    size_t off = m.size();
+
+    m.resize(off + NLMSG_ALIGN(len), 0);
+    memcpy(&m[off], p, len);
+}
+
+static void nl_attr(msg_t & m, uint16_t type, const void *p, size_t len)
+{
+    struct rtattr a;
+    size_t off = m.size();
+
+    a.rta_type = type;
+    a.rta_len = RTA_LENGTH(len);
+    m.resize(off + RTA_ALIGN(a.rta_len), 0);
+    memcpy(&m[off], &a, sizeof(a));
+    memcpy(&m[off + RTA_LENGTH(0)], p, len);
+}
+
+static void nl_end(msg_t & m)
+{
+    ((struct nlmsghdr *)&m[0])->nlmsg_len = m.size();
+}
+
+/* the message that removes what m added */
+static msg_t nl_inverse(const msg_t & m, uint16_t type)
+{
+    msg_t r = m;
+    struct nlmsghdr *h = (struct nlmsghdr *)&r[0];
+
+    h->nlmsg_type = type;
+    h->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    return r;
+}
+
+static unsigned addr_len(int family)
+{
+    return family == AF_INET6 ? 16 : 4;
+}
+
+static void mask_addr(uint8_t * addr, int family, unsigned plen)
+{
+    unsigned i;
+
+    for (i = 0; i < addr_len(family); i++) {
+        if (plen >= 8)
+            plen -= 8;
+        else {
+            addr[i] &= 0xff << (8 - plen);
+            plen = 0;
+        }
+    }
+}
+
+static unsigned mask_len(const char *mask)
+{
+    struct in_addr a;
+    uint32_t m;
+    unsigned n = 0;
+
+    if (inet_pton(AF_INET, mask, &a) != 1)
+        return 32;
+    for (m = ntohl(a.s_addr); m & 0x80000000; m <<= 1)
+        n++;
+    return n;
+}
+
+/* parses "addr", "addr/len" or "addr/netmask" */
+static bool parse_subnet(const char *str, int *family, uint8_t * addr,
+                         unsigned *plen)
+{
+    char buf[INET6_ADDRSTRLEN + 20];
+    char *slash;
+
+    snprintf(buf, sizeof(buf), "%s", str);
+    slash = strchr(buf, '/');
+    if (slash)
+        *slash++ = 0;
+
+    if (inet_pton(AF_INET, buf, addr) == 1)
+        *family = AF_INET;
+    else if (inet_pton(AF_INET6, buf, addr) == 1)
+        *family = AF_INET6;
+    else
+        return false;
+
+    *plen = addr_len(*family) * 8;
+    if (slash && strchr(slash, '.'))
+        *plen = mask_len(slash);
+    else if (slash && atoi(slash) >= 0
+             && (unsigned)atoi(slash) <= addr_len(*family) * 8)
+        *plen = atoi(slash);
+
+    mask_addr(addr, *family, *plen);
+    return true;
+}
+
+NetConfig::NetConfig()
+{
+    fd = -1;
+    seq = 0;
+    resolv_changed = false;
+    resolv_existed = false;
+}
+
+NetConfig::~NetConfig()
+{
+    if (fd != -1)
+        close(fd);
+}
+
+/* Sends the messages as one datagram, which the kernel processes in
+ * order, and collects an answer for each; errors[i] is zero or the errno
+ * of message i. Returns the number of failed messages.
+ */
+int NetConfig::transact(std::vector < msg_t > &msgs,
+                        std::vector < int >&errors)
+{
+    std::vector < uint8_t > buf;
+    struct sockaddr_nl sa;
+    struct nlmsghdr *h;
+    struct nlmsgerr *e;
+    uint8_t rbuf[NL_BUFSIZE];
+    uint32_t base = seq + 1;
+    unsigned i, pending = msgs.size();
+    ssize_t len;
+    int failed = 0;
+
+    errors.assign(msgs.size(), ETIMEDOUT);
+    if (msgs.empty())
+        return 0;
+
+    for (i = 0; i < msgs.size(); i++) {
+        h = (struct nlmsghdr *)&msgs[i][0];
+        h->nlmsg_seq = ++seq;
+        buf.insert(buf.end(), msgs[i].begin(), msgs[i].end());
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    if (sendto(fd, &buf[0], buf.size(), 0, (struct sockaddr *)&sa,
+               sizeof(sa)) < 0) {
+        errors.assign(msgs.size(), errno);
+        return msgs.size();
+    }
+
+    while (pending > 0) {
+        len = recv(fd, rbuf, sizeof(rbuf), 0);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (h = (struct nlmsghdr *)rbuf; NLMSG_OK(h, (size_t) len);
+             h = NLMSG_NEXT(h, len)) {
+            if (h->nlmsg_type != NLMSG_ERROR || h->nlmsg_seq < base
+                || h->nlmsg_seq - base >= msgs.size())
+                continue;
+            e = (struct nlmsgerr *)NLMSG_DATA(h);
+            errors[h->nlmsg_seq - base] = -e->error;
+            pending--;
+        }
+    }
+
+    for (i = 0; i < errors.size(); i++) {
+        if (errors[i] != 0)
+            failed++;
+    }
+    return failed;
+}
+
+/* asks the kernel how dst is reached now */
+bool NetConfig::lookup_route(int family, const uint8_t * dst, uint8_t * gw,
+                             bool * has_gw, int *oif)
+{
+    msg_t m;
+    struct rtmsg rt;
+    struct sockaddr_nl sa;
+    struct nlmsghdr *h;
+    struct rtattr *a;
+    uint8_t rbuf[NL_BUFSIZE];
+    ssize_t len;
+    int alen;
+
+    memset(&rt, 0, sizeof(rt));
+    rt.rtm_family = family;
+    rt.rtm_dst_len = addr_len(family) * 8;
+
+    nl_begin(m, RTM_GETROUTE, NLM_F_REQUEST);
+    nl_put(m, &rt, sizeof(rt));
+    nl_attr(m, RTA_DST, dst, addr_len(family));
+    nl_end(m);
+    ((struct nlmsghdr *)&m[0])->nlmsg_seq = ++seq;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    if (sendto(fd, &m[0], m.size(), 0, (struct sockaddr *)&sa,
+               sizeof(sa)) < 0)
+        return false;
+
+    len = recv(fd, rbuf, sizeof(rbuf), 0);
+    if (len < 0)
+        return false;
+
+    *has_gw = false;
+    *oif = 0;
+    for (h = (struct nlmsghdr *)rbuf; NLMSG_OK(h, (size_t) len);
+         h = NLMSG_NEXT(h, len)) {
+        if (h->nlmsg_seq != seq || h->nlmsg_type != RTM_NEWROUTE)
+            continue;
+
+        alen = RTM_PAYLOAD(h);
+        for (a = RTM_RTA(NLMSG_DATA(h)); RTA_OK(a, alen);
+             a = RTA_NEXT(a, alen)) {
+            if (a->rta_type == RTA_OIF)
+                memcpy(oif, RTA_DATA(a), sizeof(*oif));
+            else if (a->rta_type == RTA_GATEWAY) {
+                memcpy(gw, RTA_DATA(a), addr_len(family));
+                *has_gw = true;
+            }
+        }
+    }
+    return *oif != 0;
+}
+
+void NetConfig::add_route(std::vector < msg_t > &msgs, int family,
+                          const uint8_t * dst, unsigned plen,
+                          const uint8_t * gw, int oif)
+{
+    msg_t m;
+    struct rtmsg rt;
+
+    memset(&rt, 0, sizeof(rt));
+    rt.rtm_family = family;
+    rt.rtm_dst_len = plen;
+    rt.rtm_table = RT_TABLE_MAIN;
+    rt.rtm_protocol = RTPROT_STATIC;
+    rt.rtm_scope = gw ? RT_SCOPE_UNIVERSE : RT_SCOPE_LINK;
+    rt.rtm_type = RTN_UNICAST;
+
+    nl_begin(m, RTM_NEWROUTE,
+             NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL);
+    nl_put(m, &rt, sizeof(rt));
+    if (plen > 0)
+        nl_attr(m, RTA_DST, dst, addr_len(family));
+    if (gw)
+        nl_attr(m, RTA_GATEWAY, gw, addr_len(family));
+    nl_attr(m, RTA_OIF, &oif, sizeof(oif));
+    nl_end(m);
+    msgs.push_back(m);
+}
+
+int NetConfig::apply(const struct oc_ip_info *info, const char *ifname,
+                     const char *gateway, const char *dns,
+                     std::string & err)
+{
+    struct oc_split_include *inc;
+    std::vector < msg_t > msgs;
+    std::vector < int >errors;
+    struct ifinfomsg ifi;
+    struct ifaddrmsg ifa;
+    uint8_t addr[16], gw[16];
+    unsigned plen, i, n4 = 0, n6 = 0;
+    bool has_gw;
+    int family, ifindex, oif;
+    uint32_t mtu;
+    msg_t m;
+
+    ifindex = if_nametoindex(ifname);
+    if (ifindex == 0) {
+        err = strerror(errno);
+        return -1;
+    }
+
+    if (fd == -1) {
+        struct timeval tv = { NL_TIMEOUT, 0 };
+        int size = 1024 * 1024;
+
+        fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (fd < 0) {
+            err = strerror(errno);
+            return -1;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    /* the link up, with the negotiated MTU */
+    memset(&ifi, 0, sizeof(ifi));
+    ifi.ifi_family = AF_UNSPEC;
+    ifi.ifi_index = ifindex;
+    ifi.ifi_flags = IFF_UP;
+    ifi.ifi_change = IFF_UP;
+    nl_begin(m, RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK);
+    nl_put(m, &ifi, sizeof(ifi));
+    if (info->mtu > 0) {
+        mtu = info->mtu;
+        nl_attr(m, IFLA_MTU, &mtu, sizeof(mtu));
+    }
+    nl_end(m);
+    msgs.push_back(m);
+
+    /* the addresses; the kernel adds the routes of their subnets */
+    for (i = 0; i < 2; i++) {
+        const char *a = i == 0 ? info->addr : info->addr6;
+
+        if (a == NULL || parse_subnet(a, &family, addr, &plen) == false)
+            continue;
+        /* undo the masking of the host part */
+        inet_pton(family, a, addr);
+        if (family == AF_INET)
+            plen = info->netmask ? mask_len(info->netmask) : 32;
+        else if (info->netmask6 && strchr(info->netmask6, '/'))
+            plen = atoi(strchr(info->netmask6, '/') + 1);
+        else
+            plen = 128;
+
+        memset(&ifa, 0, sizeof(ifa));
+        ifa.ifa_family = family;
+        ifa.ifa_prefixlen = plen;
+        ifa.ifa_flags = family == AF_INET6 ? IFA_F_NODAD : 0;
+        ifa.ifa_scope = RT_SCOPE_UNIVERSE;
+        ifa.ifa_index = ifindex;
+        nl_begin(m, RTM_NEWADDR,
+                 NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL);
+        nl_put(m, &ifa, sizeof(ifa));
+        nl_attr(m, IFA_LOCAL, addr, addr_len(family));
+        nl_attr(m, IFA_ADDRESS, addr, addr_len(family));
+        nl_end(m);
+        msgs.push_back(m);
+    }
+
+    /* the gateway stays reachable the way it is now */
+    if (gateway && parse_subnet(gateway, &family, addr, &plen)
+        && lookup_route(family, addr, gw, &has_gw, &oif) && oif != ifindex)
+        add_route(msgs, family, addr, plen, has_gw ? gw : NULL, oif);
+
+    for (inc = info->split_excludes; inc != NULL; inc = inc->next) {
+        if (parse_subnet(inc->route, &family, addr, &plen)
+            && lookup_route(family, addr, gw, &has_gw, &oif)
+            && oif != ifindex)
+            add_route(msgs, family, addr, plen, has_gw ? gw : NULL, oif);
+    }
+
+    for (inc = info->split_includes; inc != NULL; inc = inc->next) {
+        if (parse_subnet(inc->route, &family, addr, &plen) == false)
+            continue;
+        add_route(msgs, family, addr, plen, NULL, ifindex);
+        if (family == AF_INET)
+            n4++;
+        else
+            n6++;
+    }
+
+    /* without includes everything goes to the VPN; two halves take
+     * precedence over the default route without replacing it */
+    memset(addr, 0, sizeof(addr));
+    if (info->addr && n4 == 0) {
+        add_route(msgs, AF_INET, addr, 1, NULL, ifindex);
+        addr[0] = 0x80;
+        add_route(msgs, AF_INET, addr, 1, NULL, ifindex);
+        addr[0] = 0;
+    }
+    if (info->addr6 && n6 == 0) {
+        add_route(msgs, AF_INET6, addr, 1, NULL, ifindex);
+        addr[0] = 0x80;
+        add_route(msgs, AF_INET6, addr, 1, NULL, ifindex);
+    }
+
+    transact(msgs, errors);
+
+    /* the kernel went on past a failed message, so everything that
+     * succeeded is recorded before anything is reverted */
+    err.clear();
+    for (i = 0; i < msgs.size(); i++) {
+        uint16_t type = ((struct nlmsghdr *)&msgs[i][0])->nlmsg_type;
+
+        /* routes that exist already are left alone, and not removed */
+        if (errors[i] == EEXIST && type == RTM_NEWROUTE)
+            continue;
+        if (errors[i] != 0) {
+            if (err.empty())
+                err = strerror(errors[i]);
+            continue;
+        }
+        if (type == RTM_NEWADDR)
+            undo.push_back(nl_inverse(msgs[i], RTM_DELADDR));
+        else if (type == RTM_NEWROUTE)
+            undo.push_back(nl_inverse(msgs[i], RTM_DELROUTE));
+    }
+    if (err.empty() == false) {
+        revert();
+        return -1;
+    }
+
+    if (set_resolv(info, dns) == false) {
+        err = std::string(RESOLV_CONF ": ") + strerror(errno);
+        revert();
+        return -1;
+    }
+    return 0;
+}
+
+/* routes first, then the addresses; a device that is gone already has
+ * taken both with it */
+void NetConfig::revert()
+{
+    std::vector < msg_t > msgs(undo.rbegin(), undo.rend());
+    std::vector < int >errors;
+
+    if (fd != -1)
+        transact(msgs, errors);
+    undo.clear();
+
+    restore_resolv();
+}
+
+/* whether resolv.conf is the one written by set_resolv() */
+static bool resolv_is_ours(void)
+{
+    char line[512];
+    bool ours = false;
+    FILE *fp;
+
+    fp = fopen(RESOLV_CONF, "r");
+    if (fp != NULL) {
+        ours = fgets(line, sizeof(line), fp) != NULL
+            && strcmp(line, RESOLV_HEADER) == 0;
+        fclose(fp);
+    }
+    return ours;
+}
+
+/* A session that did not end cleanly left its resolv.conf and the
+ * backup of the one it replaced; the backup is put back unless the file
+ * was rewritten since.
+ */
+void NetConfig::recover()
+{
+    struct stat st;
+
+    if (lstat(RESOLV_BACKUP, &st) == 0) {
+        if (resolv_is_ours() == true)
+            rename(RESOLV_BACKUP, RESOLV_CONF);
+        else
+            unlink(RESOLV_BACKUP);
+    } else if (resolv_is_ours() == true) {
+        /* there was none before */
+        unlink(RESOLV_CONF);
+    }
+    unlink(RESOLV_TMP);
+}
+
+bool NetConfig::set_resolv(const struct oc_ip_info * info, const char *dns)
+{
+    char line[512];
+    std::string content, options;
+    struct stat st;
+    FILE *fp;
+    int i;
+
+    if (dns == NULL && info->dns[0] == NULL)
+        return true;
+
+    resolv_existed = lstat(RESOLV_CONF, &st) == 0;
+
+    fp = fopen(RESOLV_CONF, "r");
+    if (fp != NULL) {
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            if (strncmp(line, "options", 7) == 0)
+                options += line;
+        }
+        fclose(fp);
+    }
+
+    content = RESOLV_HEADER;
+    if (info->domain)
+        content += std::string("search ") + info->domain + "\n";
+    if (dns) {
+        content += std::string("nameserver ") + dns + "\n";
+    } else {
+        for (i = 0; i < 3; i++) {
+            if (info->dns[i])
+                content += std::string("nameserver ") + info->dns[i] + "\n";
+        }
+    }
+    content += options;
+
+    fp = fopen(RESOLV_TMP, "w");
+    if (fp == NULL)
+        return false;
+    if (fwrite(content.data(), 1, content.size(), fp) != content.size()) {
+        fclose(fp);
+        unlink(RESOLV_TMP);
+        return false;
+    }
+    fclose(fp);
+    chmod(RESOLV_TMP, 0644);
+
+    /* a second name for the file, or the symlink itself, survives the
+     * rename below and a crash of this process */
+    unlink(RESOLV_BACKUP);
+    if (resolv_existed && link(RESOLV_CONF, RESOLV_BACKUP) < 0) {
+        unlink(RESOLV_TMP);
+        return false;
+    }
+
+    /* replaces a symlink rather than writing through it */
+    if (rename(RESOLV_TMP, RESOLV_CONF) < 0) {
+        unlink(RESOLV_TMP);
+        unlink(RESOLV_BACKUP);
+        return false;
+    }
+    resolv_changed = true;
+    return true;
+}
+
+void NetConfig::restore_resolv()
+{
+    if (resolv_changed == false)
+        return;
+    resolv_changed = false;
+
+    if (resolv_existed == false)
+        unlink(RESOLV_CONF);
+    else
+        rename(RESOLV_BACKUP, RESOLV_CONF);
+}
+
+#endif                          // USE_NETLINK
@@ -0,0 +1,62 @@
+#ifndef NETCONFIG_H
+#define NETCONFIG_H
+
+#include "common.h"
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#ifdef USE_NETLINK
+
+extern "C" {
+#include <openconnect.h>
+}
+
+/* Configures the tun device of a session without the vpnc-script: the
+ * link, the addresses and the routes (full tunnel or split includes, and
+ * the excludes and the gateway through the previous route) are set over
+ * rtnetlink as a single batch of messages, and resolv.conf is rewritten.
+ * Every change that was made is recorded with the message that undoes
+ * it, so that revert() restores the previous state; the replaced
+ * resolv.conf is kept on disk until then.
+ */
+class NetConfig {
+ public:
+    NetConfig();
+    ~NetConfig();
+
+    /* dns, when given, replaces the VPN's DNS servers; returns zero on
+     * success, and on failure leaves nothing applied */
+    int apply(const struct oc_ip_info *info, const char *ifname,
+              const char *gateway, const char *dns, std::string & err);
+    void revert();
+    /* undoes what a session that did not end cleanly left behind */
+    static void recover();
+
+    unsigned get_changes() {
+        return undo.size() + (resolv_changed ? 1 : 0);
+    }
+
+ private:
+    typedef std::vector < uint8_t > msg_t;
+
+    int transact(std::vector < msg_t > &msgs, std::vector < int >&errors);
+    bool lookup_route(int family, const uint8_t * dst, uint8_t * gw,
+                      bool * has_gw, int *oif);
+    void add_route(std::vector < msg_t > &msgs, int family,
+                   const uint8_t * dst, unsigned plen, const uint8_t * gw,
+                   int oif);
+    bool set_resolv(const struct oc_ip_info *info, const char *dns);
+    void restore_resolv();
+
+    int fd;
+    uint32_t seq;
+    std::vector < msg_t > undo;
+
+    bool resolv_changed;
+    bool resolv_existed;
+};
+
+#endif                          // USE_NETLINK
+
+#endif                          // NETCONFIG_H
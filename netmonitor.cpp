@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "netmonitor.h"
+
+#ifdef USE_NETLINK
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_addr.h>
+#include <net/if.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <openconnect.h>
+}
+
+#define SUSPEND_GAP 2000        /* ms of sleep that count as a suspend */
+#define CHECK_INTERVAL 2000
+
+#ifndef CLOCK_BOOTTIME
+#define CLOCK_BOOTTIME 7
+#endif
+
+static uint64_t clock_ms(clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+NetMonitor::NetMonitor(int cmd_fd, int tun_ifindex)
+{
+    this->cmd_fd = cmd_fd;
+    this->tun_ifindex = tun_ifindex;
+    fd = -1;
+    stop_pipe[0] = stop_pipe[1] = -1;
+    pause_time = 0;
+    clock_gap = clock_ms(CLOCK_BOOTTIME) - clock_ms(CLOCK_MONOTONIC);
+}
+
+NetMonitor::~NetMonitor()
+{
+    stop();
+    if (fd != -1)
+        close(fd);
+    if (stop_pipe[0] != -1) {
+        close(stop_pipe[0]);
+        close(stop_pipe[1]);
+    }
+}
+
+int NetMonitor::setup(std::string & err)
+{
+    struct sockaddr_nl sa;
+
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                NETLINK_ROUTE);
+    if (fd < 0)
+        goto fail;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR |
+        RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+        goto fail;
+
+    if (pipe2(stop_pipe, O_CLOEXEC) < 0) {
+        stop_pipe[0] = stop_pipe[1] = -1;
+        goto fail;
+    }
+    return 0;
+
+ fail:
+    err = strerror(errno);
+    return -1;
+}
+
+void NetMonitor::stop()
+{
+    char c = 0;
+
+    if (this->isRunning() == false)
+        return;
+
+    if (write(stop_pipe[1], &c, 1) < 0)
+        return;
+    this->wait();
+}
+
+bool NetMonitor::restored(uint64_t * outage_ms, std::string & reason)
+{
+    QMutexLocker locker(&mutex);
+
+    if (pause_time == 0)
+        return false;
+
+    *outage_ms = clock_ms(CLOCK_MONOTONIC) - pause_time;
+    reason = pause_reason;
+    pause_time = 0;
+    return true;
+}
+
+bool NetMonitor::waiting()
+{
+    QMutexLocker locker(&mutex);
+
+    return pause_time != 0;
+}
+
+/* Returns what the messages announce if it is a new path, or NULL.
+ * Removals are not acted upon: the old path may come back before DPD
+ * notices, and a pause without a new path only ends the session sooner.
+ */
+const char *NetMonitor::relevant(const uint8_t * buf, size_t len)
+{
+    const struct nlmsghdr *h;
+    const char *what = NULL;
+    unsigned flags, old;
+    int alen, oif;
+
+    for (h = (const struct nlmsghdr *)buf; NLMSG_OK(h, len);
+         h = NLMSG_NEXT(h, len)) {
+        if (h->nlmsg_type == RTM_NEWLINK) {
+            const struct ifinfomsg *ifi =
+                (const struct ifinfomsg *)NLMSG_DATA(h);
+
+            if (ifi->ifi_index == tun_ifindex || (ifi->ifi_flags & IFF_LOOPBACK))
+                continue;
+            /* the first event of a link only gives its state; a new
+             * link is noticed by its address */
+            flags = ifi->ifi_flags & (IFF_UP | IFF_RUNNING);
+            old = link_flags.count(ifi->ifi_index) ?
+                link_flags[ifi->ifi_index] : flags;
+            link_flags[ifi->ifi_index] = flags;
+            if (flags == (IFF_UP | IFF_RUNNING) && old != flags && !what)
+                what = "link up";
+
+        } else if (h->nlmsg_type == RTM_NEWADDR) {
+            const struct ifaddrmsg *ifa =
+                (const struct ifaddrmsg *)NLMSG_DATA(h);
+
+            /* temporary IPv6 addresses come and go by themselves */
+            if (ifa->ifa_index == (unsigned)tun_ifindex
+                || ifa->ifa_scope != RT_SCOPE_UNIVERSE
+                || (ifa->ifa_flags & IFA_F_TEMPORARY) || what)
+                continue;
+            what = "new address";
+
+        } else if (h->nlmsg_type == RTM_NEWROUTE) {
+            const struct rtmsg *rt = (const struct rtmsg *)NLMSG_DATA(h);
+            struct rtattr *a;
+
+            if (rt->rtm_dst_len != 0 || rt->rtm_table != RT_TABLE_MAIN
+                || what)
+                continue;
+
+            oif = 0;
+            alen = RTM_PAYLOAD(h);
+            for (a = RTM_RTA(NLMSG_DATA(h)); RTA_OK(a, alen);
+                 a = RTA_NEXT(a, alen)) {
+                if (a->rta_type == RTA_OIF)
+                    memcpy(&oif, RTA_DATA(a), sizeof(oif));
+            }
+            if (oif == tun_ifindex)
+                continue;
+            what = "new default route";
+        }
+    }
+    return what;
+}
+
+/* the boot clock runs on during a suspend, the monotonic one does not */
+bool NetMonitor::resumed(uint64_t now)
+{
+    int64_t gap = clock_ms(CLOCK_BOOTTIME) - now;
+    bool ret = gap - clock_gap > SUSPEND_GAP;
+
+    clock_gap = gap;
+    return ret;
+}
+
+void NetMonitor::run()
+{
+    struct pollfd pfd[2];
+    uint8_t buf[8192];
+    const char *what, *reason = NULL;
+    uint64_t now, first = 0, last = 0, paused = 0, polled = 0;
+    char cmd = OC_CMD_PAUSE, stats = OC_CMD_STATS;
+    ssize_t len;
+    int timeout, ret;
+
+    pfd[0].fd = fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = stop_pipe[0];
+    pfd[1].events = POLLIN;
+
+    for (;;) {
+        timeout = CHECK_INTERVAL;
+        if (first != 0)
+            timeout = SETTLE_TIME / 4;
+        else if (paused != 0)
+            timeout = RESTORE_POLL;
+
+        ret = poll(pfd, 2, timeout);
+        if (ret < 0 && errno != EINTR)
+            break;
+        if (pfd[1].revents)
+            break;
+
+        now = clock_ms(CLOCK_MONOTONIC);
+        if (resumed(now) && first == 0) {
+            reason = "resume from suspend";
+            first = last = now;
+        }
+
+        if (ret > 0 && (pfd[0].revents & POLLIN)) {
+            while ((len = recv(fd, buf, sizeof(buf), 0)) > 0) {
+                what = relevant(buf, len);
+                if (what == NULL)
+                    continue;
+                if (first == 0) {
+                    reason = what;
+                    first = now;
+                }
+                last = now;
+            }
+        }
+
+        if (paused != 0 && first == 0) {
+            if (waiting() == false || now - paused >= RESTORE_MAX)
+                paused = 0;
+            else if (now - polled >= RESTORE_POLL) {
+                if (write(cmd_fd, &stats, 1) < 0)
+                    break;
+                polled = now;
+            }
+        }
+
+        if (first == 0)
+            continue;
+        if (now - last < SETTLE_TIME && now - first < SETTLE_MAX)
+            continue;
+
+        {
+            QMutexLocker locker(&mutex);
+            pause_reason = reason;
+            pause_time = first;
+        }
+        if (write(cmd_fd, &cmd, 1) < 0)
+            break;
+        first = 0;
+        paused = polled = now;
+    }
+}
+
+#endif                          // USE_NETLINK
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NETMONITOR_H
+#define NETMONITOR_H
+
+#include "common.h"
+#include <QThread>
+#include <QMutex>
+#include <map>
+#include <string>
+#include <stdint.h>
+
+#ifdef USE_NETLINK
+
+/* Watches for a new network path while a session is up: a link coming
+ * up, an address or a default route being added (outside the tunnel), or
+ * a resume from suspend, seen as CLOCK_BOOTTIME advancing further than
+ * CLOCK_MONOTONIC. Once the events have settled the session is paused
+ * through its command pipe; VpnInfo::mainloop() then reconnects at once
+ * instead of waiting for DPD to notice that the old path is gone.
+ */
+#define SETTLE_TIME 1000        /* ms without events before pausing */
+#define SETTLE_MAX 3000         /* ms after the first event at most */
+#define RESTORE_POLL 250        /* ms */
+#define RESTORE_MAX 30000       /* ms of polling at most */
+
+class NetMonitor:public QThread {
+ public:
+    /* events of the tun device tun_ifindex are ignored */
+    NetMonitor(int cmd_fd, int tun_ifindex);
+    ~NetMonitor();
+
+    /* subscribes to rtnetlink; returns zero on success */
+    int setup(std::string & err);
+    void stop();
+
+    /* called once the tunnel is up again: if it had been paused, gives
+     * the time since the network changed and why, and returns true.
+     * Until then stats are requested every RESTORE_POLL ms, so that the
+     * first packets received after the reconnect are seen early. */
+    bool restored(uint64_t * outage_ms, std::string & reason);
+
+ protected:
+    void run();
+
+ private:
+    const char *relevant(const uint8_t * buf, size_t len);
+    bool resumed(uint64_t now);
+    bool waiting();
+
+    int cmd_fd;
+    int tun_ifindex;
+    int fd;
+    int stop_pipe[2];
+    std::map < int, unsigned >link_flags;
+    int64_t clock_gap;          /* BOOTTIME - MONOTONIC, in ms */
+
+    QMutex mutex;
+    std::string pause_reason;
+    uint64_t pause_time;        /* when the event was seen, 0 if none */
+};
+
+#endif                          // USE_NETLINK
+
+#endif                          // NETMONITOR_H
@@ -27,7 +27,29 @@ SOURCES += main.cpp\
     cert.cpp \
     logdialog.cpp \
     gtdb.cpp \
-    cryptdata.cpp
+    cryptdata.cpp \
+    singleinstance.cpp \
+    vpnworker.cpp \
+    flowtable.cpp \
+    tunpump.cpp \
+    vpncscript.cpp \
+    routetable.cpp \
+    packetring.cpp \
+    mtuprobe.cpp \
+    dpdtuner.cpp \
+    linkstats.cpp \
+    transportlog.cpp \
+    dnsproxy.cpp \
+    domaintrie.cpp \
+    phasetimer.cpp \
+    scriptlog.cpp \
+    netconfig.cpp \
+    proxycache.cpp \
+    netmonitor.cpp \
+    backoff.cpp \
+    tokenjournal.cpp \
+    systemkeys.cpp \
+    pincache.cpp
 
 HEADERS  += mainwindow.h \
     vpninfo.h \
@@ -40,7 +62,29 @@ HEADERS  += mainwindow.h \
     logdialog.h \
     gtdb.h \
     dialogs.h \
-    cryptdata.h
+    cryptdata.h \
+    singleinstance.h \
+    vpnworker.h \
+    flowtable.h \
+    tunpump.h \
+    vpncscript.h \
+    routetable.h \
+    packetring.h \
+    mtuprobe.h \
+    dpdtuner.h \
+    linkstats.h \
+    transportlog.h \
+    dnsproxy.h \
+    domaintrie.h \
+    phasetimer.h \
+    scriptlog.h \
+    netconfig.h \
+    proxycache.h \
+    netmonitor.h \
+    backoff.h \
+    tokenjournal.h \
+    systemkeys.h \
+    pincache.h
 
 FORMS    += mainwindow.ui \
     editdialog.ui \
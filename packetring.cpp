@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "packetring.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <new>
+#include <vector>
+
+#define LINKTYPE_RAW 101
+
+/* keeps the plain reads of a slot before the second load of its sequence
+ * count; an acquire load only orders what comes after it */
+#ifdef __ATOMIC_ACQUIRE
+#define read_fence() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#else
+#define read_fence() __sync_synchronize()
+#endif
+
+PacketRing::PacketRing()
+{
+    slots = NULL;
+    data = NULL;
+    head = 0;
+}
+
+PacketRing::~PacketRing()
+{
+    disable();
+    delete[]slots;
+    delete[]data;
+}
+
+bool PacketRing::enable(unsigned len)
+{
+    if (len == 0 || len > RING_MAX_SNAPLEN)
+        len = RING_MAX_SNAPLEN;
+
+    /* the storage is never freed while the pump may use it */
+    if (slots == NULL) {
+        slots = new(std::nothrow) slot[RING_SLOTS];
+        data = new(std::nothrow) uint8_t[RING_SLOTS * RING_MAX_SNAPLEN];
+        if (slots == NULL || data == NULL) {
+            delete[]slots;
+            delete[]data;
+            slots = NULL;
+            data = NULL;
+            return false;
+        }
+        memset(data, 0, RING_SLOTS * RING_MAX_SNAPLEN);
+    }
+
+    snaplen.storeRelease(len);
+    enabled.storeRelease(1);
+    return true;
+}
+
+void PacketRing::disable()
+{
+    enabled.storeRelease(0);
+}
+
+static int64_t now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+void PacketRing::capture(const uint8_t * pkt, size_t len)
+{
+    struct slot *s;
+    unsigned idx, caplen;
+
+    if (enabled.loadAcquire() == 0)
+        return;
+
+    caplen = snaplen.loadAcquire();
+    if (caplen > len)
+        caplen = len;
+
+    idx = head & (RING_SLOTS - 1);
+    s = &slots[idx];
+
+    s->seq.fetchAndAddOrdered(1);       /* odd: being written */
+    s->len = len;
+    s->caplen = caplen;
+    s->ts = now_us();
+    memcpy(data + idx * RING_MAX_SNAPLEN, pkt, caplen);
+    s->seq.fetchAndAddOrdered(1);
+
+    head++;
+    published.storeRelease(head);
+}
+
+static void put32(std::vector < uint8_t > &b, uint32_t v)
+{
+    b.insert(b.end(), (uint8_t *) & v, (uint8_t *) & v + 4);
+}
+
+static void put16(std::vector < uint8_t > &b, uint16_t v)
+{
+    b.insert(b.end(), (uint8_t *) & v, (uint8_t *) & v + 2);
+}
+
+/* blocks are written in host byte order, as the byte order magic of the
+ * section header tells readers */
+static bool write_block(FILE * fp, uint32_t type,
+                        const std::vector < uint8_t > &body)
+{
+    uint32_t len = 12 + body.size();
+    static const uint8_t pad[4] = { 0, 0, 0, 0 };
+    unsigned padlen = (4 - (body.size() & 3)) & 3;
+
+    len += padlen;
+    if (fwrite(&type, 4, 1, fp) != 1 || fwrite(&len, 4, 1, fp) != 1)
+        return false;
+    if (body.size() > 0 && fwrite(&body[0], body.size(), 1, fp) != 1)
+        return false;
+    if (padlen > 0 && fwrite(pad, padlen, 1, fp) != 1)
+        return false;
+    return fwrite(&len, 4, 1, fp) == 1;
+}
+
+int PacketRing::save_pcapng(const char *filename, unsigned seconds)
+{
+    std::vector < uint8_t > b;
+    uint8_t pkt[RING_MAX_SNAPLEN];
+    struct slot *s;
+    uint32_t end, start, i, idx, caplen, len;
+    int seq;
+    int64_t ts, since;
+    int count = 0;
+    FILE *fp;
+
+    if (slots == NULL)
+        return 0;
+
+    fp = fopen(filename, "wb");
+    if (fp == NULL)
+        return -1;
+
+    /* section header */
+    put32(b, 0x1A2B3C4D);
+    put16(b, 1);
+    put16(b, 0);
+    put32(b, 0xffffffff);       /* section length unknown */
+    put32(b, 0xffffffff);
+    if (write_block(fp, 0x0A0D0D0A, b) == false)
+        goto fail;
+
+    /* interface description; the tun device carries bare IP packets and
+     * the default timestamp resolution is microseconds */
+    b.clear();
+    put16(b, LINKTYPE_RAW);
+    put16(b, 0);
+    put32(b, snaplen.loadAcquire());
+    if (write_block(fp, 1, b) == false)
+        goto fail;
+
+    end = published.loadAcquire();
+    start = end > RING_SLOTS ? end - RING_SLOTS : 0;
+    since = now_us() - (int64_t) seconds *1000000;
+
+    for (i = start; i != end; i++) {
+        idx = i & (RING_SLOTS - 1);
+        s = &slots[idx];
+
+        seq = s->seq.loadAcquire();
+        if (seq & 1)
+            continue;
+        len = s->len;
+        caplen = s->caplen;
+        ts = s->ts;
+        /* a torn length must not take the copy past the slot */
+        if (caplen > RING_MAX_SNAPLEN)
+            continue;
+        memcpy(pkt, data + idx * RING_MAX_SNAPLEN, caplen);
+        read_fence();
+        /* the pump overwrote the slot meanwhile */
+        if (s->seq.loadAcquire() != seq)
+            continue;
+
+        if (ts < since)
+            continue;
+
+        b.clear();
+        put32(b, 0);            /* interface id */
+        put32(b, (uint64_t) ts >> 32);
+        put32(b, (uint32_t) ts);
+        put32(b, caplen);
+        put32(b, len);
+        b.insert(b.end(), pkt, pkt + caplen);
+        if (write_block(fp, 6, b) == false)
+            goto fail;
+        count++;
+    }
+
+    if (fclose(fp) != 0)
+        return -1;
+    return count;
+
+ fail:
+    fclose(fp);
+    return -1;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PACKETRING_H
+#define PACKETRING_H
+
+#include <QAtomicInt>
+#include <stdint.h>
+#include <stddef.h>
+
+#define RING_SLOTS 4096         /* must be a power of two */
+#define RING_MAX_SNAPLEN 2048
+#define RING_DEFAULT_SNAPLEN 128
+
+/* A fixed ring of packet headers written by the tun pump. The pump is
+ * the only writer; every slot carries a sequence count that is odd while
+ * the slot is written, so readers copy slots out without taking a lock
+ * and the writer never waits for them. While capture is disabled, the
+ * pump only loads the enabled flag.
+ */
+class PacketRing {
+ public:
+    PacketRing();
+    ~PacketRing();
+
+    /* allocates the ring on first use; snaplen is capped at
+     * RING_MAX_SNAPLEN */
+    bool enable(unsigned snaplen);
+    void disable();
+    bool is_enabled() {
+        return enabled.loadAcquire() != 0;
+    }
+
+    /* called by the pump for every packet */
+    void capture(const uint8_t * pkt, size_t len);
+
+    /* writes the packets of the last seconds as pcapng; returns the
+     * number of packets written or -1 */
+    int save_pcapng(const char *filename, unsigned seconds);
+
+ private:
+    struct slot {
+        QAtomicInt seq;
+        uint32_t len;
+        uint32_t caplen;
+        int64_t ts;             /* microseconds since the epoch */
+    };
+
+    struct slot *slots;
+    uint8_t *data;
+    uint32_t head;              /* written by the pump only */
+    QAtomicInt published;       /* packets captured so far */
+    QAtomicInt enabled;
+    QAtomicInt snaplen;
+};
+
+#endif                          // PACKETRING_H
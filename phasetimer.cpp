@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "phasetimer.h"
+#include <QObject>
+
+PhaseTimer::PhaseTimer()
+{
+    last = 0;
+    wait_ms = 0;
+    phase_wait = 0;
+    attempts = 0;
+}
+
+void PhaseTimer::start()
+{
+    phases.clear();
+    timer.start();
+    last = 0;
+    wait_ms = 0;
+    phase_wait = 0;
+    attempts++;
+}
+
+void PhaseTimer::mark(const char *phase)
+{
+    int64_t now = timer.elapsed();
+    int64_t waited = wait_ms - phase_wait;
+
+    phases.push_back(std::make_pair(phase, now - last - waited));
+    last = now;
+    phase_wait = wait_ms;
+}
+
+int64_t PhaseTimer::get_total()
+{
+    return timer.elapsed() - wait_ms;
+}
+
+QString PhaseTimer::summary()
+{
+    QString str;
+    unsigned i;
+
+    str = QString::number(get_total()) + QObject::tr(" ms");
+    for (i = 0; i < phases.size(); i++) {
+        str += i == 0 ? QLatin1String(": ") : QLatin1String(", ");
+        str += QLatin1String(phases[i].first) + QLatin1String(" ") +
+            QString::number(phases[i].second) + QObject::tr(" ms");
+    }
+    if (wait_ms > 0)
+        str += QObject::tr(" (plus ") + QString::number(wait_ms) +
+            QObject::tr(" ms of user input)");
+    return str;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PHASETIMER_H
+#define PHASETIMER_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+/* Times the phases of a connection attempt. The time spent waiting for
+ * the user (in forms and certificate prompts) is counted separately, so
+ * that the latency of the gateway and the network can be told apart.
+ */
+class PhaseTimer {
+ public:
+    PhaseTimer();
+
+    /* starts a new attempt */
+    void start();
+    /* ends the current phase */
+    void mark(const char *phase);
+    void add_wait(int64_t ms) {
+        wait_ms += ms;
+    }
+
+    /* ms since the start, without the user's time */
+    int64_t get_total();
+    unsigned get_attempts() {
+        return attempts;
+    }
+    /* e.g. "1200 ms: auth 800 ms, CSTP 300 ms, ..." */
+    QString summary();
+
+ private:
+    QElapsedTimer timer;
+    std::vector < std::pair < const char *, int64_t > >phases;
+    int64_t last;
+    int64_t wait_ms;
+    int64_t phase_wait;
+    unsigned attempts;
+};
+
+/* adds the lifetime of the scope to the user's time */
+class WaitScope {
+ public:
+    explicit WaitScope(PhaseTimer * p) {
+        this->p = p;
+        t.start();
+    }
+    ~WaitScope() {
+        p->add_wait(t.elapsed());
+    }
+
+ private:
+    PhaseTimer * p;
+    QElapsedTimer t;
+};
+
+#endif                          // PHASETIMER_H
@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pincache.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+/* a store the compiler may not drop as dead */
+static void wipe_bytes(char *p, size_t n)
+{
+    volatile char *v = p;
+
+    while (n--)
+        *v++ = 0;
+}
+
+static char *alloc_locked(size_t size)
+{
+#ifdef _WIN32
+    char *p;
+
+    p = (char *)VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE,
+                             PAGE_READWRITE);
+    if (p != NULL && VirtualLock(p, size) == 0) {
+        VirtualFree(p, 0, MEM_RELEASE);
+        return NULL;
+    }
+    return p;
+#else
+    void *p;
+
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON,
+             -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    if (mlock(p, size) != 0) {
+        munmap(p, size);
+        return NULL;
+    }
+#ifdef MADV_DONTDUMP
+    madvise(p, size, MADV_DONTDUMP);
+#endif
+    return (char *)p;
+#endif
+}
+
+PinCache::PinCache()
+{
+    unsigned i;
+
+    this->buf = alloc_locked(PIN_CACHE_SLOTS * PIN_CACHE_MAX);
+    this->timeout = 0;
+    for (i = 0; i < PIN_CACHE_SLOTS; i++)
+        this->slots[i].len = 0;
+#ifdef ENABLE_PKCS11
+    this->held = NULL;
+#endif
+}
+
+/* created from main() before any session runs; it lives as long as the
+ * application */
+PinCache *PinCache::instance()
+{
+    static PinCache *cache = NULL;
+
+    if (cache == NULL)
+        cache = new PinCache();
+    return cache;
+}
+
+void PinCache::clear_slot(unsigned i)
+{
+    wipe_bytes(buf + i * PIN_CACHE_MAX, PIN_CACHE_MAX);
+    slots[i].len = 0;
+    slots[i].url.clear();
+    slots[i].age.invalidate();
+}
+
+void PinCache::set_timeout(unsigned secs)
+{
+    this->mutex.lock();
+    this->timeout = secs;
+    this->mutex.unlock();
+
+    if (secs == 0)
+        wipe();
+}
+
+bool PinCache::lookup(const char *token_url, char *pin, size_t pin_max)
+{
+    QMutexLocker locker(&this->mutex);
+    unsigned i;
+
+    if (buf == NULL || timeout == 0)
+        return false;
+
+    for (i = 0; i < PIN_CACHE_SLOTS; i++) {
+        if (slots[i].len == 0 || slots[i].url != QLatin1String(token_url))
+            continue;
+        if (slots[i].age.elapsed() >= (qint64) timeout * 1000) {
+            clear_slot(i);
+            return false;
+        }
+        if (slots[i].len >= pin_max)
+            return false;
+        memcpy(pin, buf + i * PIN_CACHE_MAX, slots[i].len);
+        pin[slots[i].len] = 0;
+        return true;
+    }
+    return false;
+}
+
+void PinCache::store(const char *token_url, const char *pin)
+{
+    QMutexLocker locker(&this->mutex);
+    size_t len = strlen(pin);
+    unsigned i, victim = PIN_CACHE_SLOTS;
+
+    if (buf == NULL || timeout == 0 || len == 0 || len >= PIN_CACHE_MAX)
+        return;
+
+    /* the token's own slot, else a free one, else the oldest */
+    for (i = 0; i < PIN_CACHE_SLOTS && victim == PIN_CACHE_SLOTS; i++) {
+        if (slots[i].len != 0 && slots[i].url == QLatin1String(token_url))
+            victim = i;
+    }
+    for (i = 0; i < PIN_CACHE_SLOTS && victim == PIN_CACHE_SLOTS; i++) {
+        if (slots[i].len == 0)
+            victim = i;
+    }
+    if (victim == PIN_CACHE_SLOTS) {
+        victim = 0;
+        for (i = 1; i < PIN_CACHE_SLOTS; i++) {
+            if (slots[i].age.elapsed() > slots[victim].age.elapsed())
+                victim = i;
+        }
+    }
+
+    clear_slot(victim);
+    memcpy(buf + victim * PIN_CACHE_MAX, pin, len);
+    slots[victim].len = len;
+    slots[victim].url = QLatin1String(token_url);
+    slots[victim].age.start();
+}
+
+void PinCache::forget(const char *token_url)
+{
+    QMutexLocker locker(&this->mutex);
+    unsigned i;
+
+    if (buf == NULL)
+        return;
+    for (i = 0; i < PIN_CACHE_SLOTS; i++) {
+        if (slots[i].len != 0 && slots[i].url == QLatin1String(token_url))
+            clear_slot(i);
+    }
+}
+
+void PinCache::expire()
+{
+    unsigned i;
+    bool old = false;
+
+    this->mutex.lock();
+    if (buf != NULL) {
+        for (i = 0; i < PIN_CACHE_SLOTS; i++) {
+            if (slots[i].len != 0
+                && slots[i].age.elapsed() >= (qint64) timeout * 1000)
+                clear_slot(i);
+        }
+    }
+#ifdef ENABLE_PKCS11
+    old = (held != NULL
+           && held_age.elapsed() >= (qint64) timeout * 1000);
+#endif
+    this->mutex.unlock();
+
+    if (old == true)
+        release();
+}
+
+void PinCache::wipe()
+{
+    unsigned i;
+
+    this->mutex.lock();
+    if (buf != NULL) {
+        for (i = 0; i < PIN_CACHE_SLOTS; i++)
+            clear_slot(i);
+    }
+    this->mutex.unlock();
+
+    release();
+}
+
+void PinCache::release()
+{
+#ifdef ENABLE_PKCS11
+    gnutls_pkcs11_privkey_t key;
+
+    this->mutex.lock();
+    key = held;
+    held = NULL;
+    held_url.clear();
+    this->mutex.unlock();
+
+    /* closing the last session of the token logs it out */
+    if (key != NULL)
+        gnutls_pkcs11_privkey_deinit(key);
+#endif
+}
+
+void PinCache::hold(QString key_url)
+{
+#ifdef ENABLE_PKCS11
+    gnutls_pkcs11_privkey_t key;
+
+    this->mutex.lock();
+    if (buf == NULL || timeout == 0 || held_url == key_url) {
+        this->mutex.unlock();
+        return;
+    }
+    this->mutex.unlock();
+
+    release();
+
+    /* the import may ask for the PIN, through the cache; the key keeps
+     * its session open while it exists (GnuTLS 3.4 or later) */
+    if (gnutls_pkcs11_privkey_init(&key) < 0)
+        return;
+    if (gnutls_pkcs11_privkey_import_url(key, key_url.toAscii().data(),
+                                         0) < 0) {
+        gnutls_pkcs11_privkey_deinit(key);
+        return;
+    }
+
+    this->mutex.lock();
+    held = key;
+    held_url = key_url;
+    held_age.start();
+    this->mutex.unlock();
+#else
+    (void)key_url;
+#endif
+}
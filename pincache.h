@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PINCACHE_H
+#define PINCACHE_H
+
+#include "common.h"
+#include <QMutex>
+#include <QString>
+#include <QElapsedTimer>
+#include <stddef.h>
+
+#ifdef ENABLE_PKCS11
+#include <gnutls/pkcs11.h>
+#endif
+
+#define PIN_CACHE_SLOTS 4
+#define PIN_CACHE_MAX 256
+
+/* Keeps the PINs of PKCS#11 tokens for a limited time, so that the
+ * retries and reconnects of a session do not ask for them again. The
+ * PINs are held in a page locked in memory (and kept out of core dumps
+ * where the system allows), and are overwritten when they time out, when
+ * the token refuses them and when the session ends; without locked
+ * memory nothing is kept.
+ * The key of the session can also be held open, which keeps the token
+ * logged in, so that reconnects skip the login itself.
+ */
+class PinCache {
+ public:
+    static PinCache *instance();
+
+    /* seconds a PIN is kept; zero disables the cache and wipes it */
+    void set_timeout(unsigned secs);
+    bool is_available() {
+        return buf != NULL;
+    }
+
+    bool lookup(const char *token_url, char *pin, size_t pin_max);
+    void store(const char *token_url, const char *pin);
+    /* forgets the PIN of a token, when it was refused */
+    void forget(const char *token_url);
+    /* wipes what timed out */
+    void expire();
+    void wipe();
+
+    /* keeps the key open, and its token logged in, until a wipe */
+    void hold(QString key_url);
+
+ private:
+    PinCache();
+    void clear_slot(unsigned i);
+    void release();
+
+    struct slot {
+        QString url;
+        size_t len;
+        QElapsedTimer age;
+    };
+
+    QMutex mutex;
+    char *buf;                  // PIN_CACHE_SLOTS * PIN_CACHE_MAX, locked
+    struct slot slots[PIN_CACHE_SLOTS];
+    unsigned timeout;
+
+#ifdef ENABLE_PKCS11
+    gnutls_pkcs11_privkey_t held;
+    QString held_url;
+    QElapsedTimer held_age;
+#endif
+};
+
+#endif                          // PINCACHE_H
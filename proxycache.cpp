@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "proxycache.h"
+#include <QtNetwork/QNetworkProxyFactory>
+#include <QtNetwork/QNetworkProxy>
+#include <QtNetwork/QNetworkProxyQuery>
+#include <QtNetwork/QTcpSocket>
+#include <QUrl>
+
+#define PROXY_CACHE_TIME (10 * 60 * 1000)
+
+static bool to_entry(const QNetworkProxy & p, proxy_entry & e)
+{
+    QString scheme;
+
+    e.url.clear();
+    e.host = p.hostName();
+    e.port = p.port();
+
+    if (p.type() == QNetworkProxy::NoProxy)
+        return true;
+    if (p.type() == QNetworkProxy::Socks5Proxy)
+        scheme = QLatin1String("socks5://");
+    else if (p.type() == QNetworkProxy::HttpCachingProxy
+             || p.type() == QNetworkProxy::HttpProxy)
+        scheme = QLatin1String("http://");
+    else
+        return false;
+
+    e.url = scheme;
+    if (p.user().isEmpty() == false)
+        e.url += p.user() + ":" + p.password() + "@";
+    e.url += p.hostName();
+    if (p.port() != 0)
+        e.url += ":" + QString::number(p.port());
+    return true;
+}
+
+QList < proxy_entry > ProxyCache::lookup(QString host, bool * cached)
+{
+    QList < QNetworkProxy > proxies;
+    QList < proxy_entry > list;
+    QNetworkProxyQuery query;
+    proxy_entry e;
+    int i;
+
+    {
+        QMutexLocker locker(&mutex);
+        QMap < QString, cache_entry >::iterator it = cache.find(host);
+
+        if (it != cache.end() && it->age.elapsed() < PROXY_CACHE_TIME) {
+            *cached = true;
+            return it->list;
+        }
+    }
+
+    *cached = false;
+    query.setUrl(QUrl(QLatin1String("https://") + host));
+    proxies = QNetworkProxyFactory::systemProxyForQuery(query);
+    for (i = 0; i < proxies.size(); i++) {
+        if (to_entry(proxies.at(i), e))
+            list.append(e);
+    }
+
+    QMutexLocker locker(&mutex);
+    cache_entry & c = cache[host];
+    c.list = list;
+    c.age.start();
+    return list;
+}
+
+void ProxyCache::invalidate()
+{
+    QMutexLocker locker(&mutex);
+    cache.clear();
+}
+
+int ProxyCache::pick(const QList < proxy_entry > &list, int timeout_ms)
+{
+    int i;
+
+    /* a single choice needs no probe */
+    if (list.size() < 2)
+        return 0;
+
+    for (i = 0; i < list.size(); i++) {
+        QTcpSocket s;
+
+        if (list.at(i).url.isEmpty())
+            return i;
+
+        /* else Qt would connect through the system proxy itself */
+        s.setProxy(QNetworkProxy::NoProxy);
+        s.connectToHost(list.at(i).host, list.at(i).port);
+        if (s.waitForConnected(timeout_ms))
+            return i;
+    }
+    return 0;
+}
+
+QString ProxyCache::display(const proxy_entry & e)
+{
+    QString str;
+
+    if (e.url.isEmpty())
+        return QLatin1String("direct");
+    str = e.url.left(e.url.indexOf("://") + 3) + e.host;
+    if (e.port != 0)
+        str += ":" + QString::number(e.port);
+    return str;
+}
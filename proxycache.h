@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROXYCACHE_H
+#define PROXYCACHE_H
+
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QList>
+#include <QMutex>
+#include <QElapsedTimer>
+
+struct proxy_entry {
+    QString url;                /* for openconnect; empty for no proxy */
+    QString host;
+    quint16 port;
+};
+
+/* The system proxies to use for each gateway host, as found by Qt (which
+ * may have to fetch and run a PAC script). The lookups run on the session
+ * thread; the results are kept until the network changes, or for at most
+ * PROXY_CACHE_TIME.
+ */
+class ProxyCache {
+ public:
+    /* the proxies for host in order of preference; cached is set when no
+     * lookup was needed */
+    QList < proxy_entry > lookup(QString host, bool * cached);
+    void invalidate();
+
+    /* the index of the first entry that is a direct connection or
+     * accepts a TCP connection, or zero if none does */
+    static int pick(const QList < proxy_entry > &list, int timeout_ms);
+    /* the URL without the credentials, for the log */
+    static QString display(const proxy_entry & e);
+
+ private:
+    struct cache_entry {
+        QList < proxy_entry > list;
+        QElapsedTimer age;
+    };
+
+    QMap < QString, cache_entry > cache;
+    QMutex mutex;
+};
+
+#endif                          // PROXYCACHE_H
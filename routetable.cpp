@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "routetable.h"
+#include <string.h>
+
+#define FAMILY_IDX(f) ((f) == 6 ? 1 : 0)
+#define FAMILY_BITS(f) ((f) == 6 ? 128 : 32)
+
+static inline unsigned addr_bit(const uint8_t * addr, unsigned i)
+{
+    return (addr[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+RouteTable::RouteTable()
+{
+    clear();
+}
+
+void RouteTable::clear()
+{
+    node root;
+    unsigned i;
+
+    QMutexLocker locker(&mutex);
+    root.child[0] = root.child[1] = 0;
+    root.route = -1;
+    for (i = 0; i < 2; i++) {
+        nodes[i].clear();
+        nodes[i].push_back(root);
+        has_includes[i] = false;
+    }
+    routes.clear();
+    domains.clear();
+}
+
+int RouteTable::add(const uint8_t * addr, unsigned family, unsigned plen,
+                    bool exclude)
+{
+    std::vector < node > &n = nodes[FAMILY_IDX(family)];
+    route_entry r;
+    unsigned i, cur = 0, b;
+
+    if (plen > FAMILY_BITS(family))
+        plen = FAMILY_BITS(family);
+
+    memset(&r, 0, sizeof(r));
+    memcpy(r.addr, addr, family == 6 ? 16 : 4);
+    r.family = family;
+    r.plen = plen;
+    r.exclude = exclude;
+
+    QMutexLocker locker(&mutex);
+    for (i = 0; i < plen; i++) {
+        b = addr_bit(addr, i);
+        if (n[cur].child[b] == 0) {
+            node child;
+            child.child[0] = child.child[1] = 0;
+            child.route = -1;
+            n.push_back(child);
+            n[cur].child[b] = n.size() - 1;
+        }
+        cur = n[cur].child[b];
+    }
+
+    routes.push_back(r);
+    if (exclude == false)
+        has_includes[FAMILY_IDX(family)] = true;
+
+    /* of equal prefixes the first is matched, as the first route the
+     * kernel got; an exclude wins over an include in either order */
+    if (n[cur].route == -1
+        || (exclude == true && routes[n[cur].route].exclude == false))
+        n[cur].route = routes.size() - 1;
+    return routes.size() - 1;
+}
+
+int RouteTable::find(const uint8_t * addr, unsigned family)
+{
+    const std::vector < node > &n = nodes[FAMILY_IDX(family)];
+    unsigned i, cur = 0, bits = FAMILY_BITS(family);
+    int best = n[0].route;
+
+    for (i = 0; i < bits; i++) {
+        cur = n[cur].child[addr_bit(addr, i)];
+        if (cur == 0)
+            break;
+        if (n[cur].route != -1)
+            best = n[cur].route;
+    }
+    return best;
+}
+
+int RouteTable::lookup(const uint8_t * addr, unsigned family)
+{
+    QMutexLocker locker(&mutex);
+    return find(addr, family);
+}
+
+bool RouteTable::via_vpn(const uint8_t * addr, unsigned family, int *route)
+{
+    int r;
+
+    QMutexLocker locker(&mutex);
+    r = find(addr, family);
+    if (route)
+        *route = r;
+
+    /* without split includes everything but the excludes is tunneled */
+    if (r == -1)
+        return has_includes[FAMILY_IDX(family)] == false;
+    return routes[r].exclude == false;
+}
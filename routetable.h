@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROUTETABLE_H
+#define ROUTETABLE_H
+
+#include <QMutex>
+#include <QStringList>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+struct route_entry {
+    uint8_t addr[16];
+    uint8_t family;             /* 4 or 6 */
+    uint8_t plen;
+    bool exclude;
+};
+
+/* The split-tunnel policy of the session compiled into a binary trie per
+ * address family. A lookup walks at most one node per address bit and
+ * returns the longest matching prefix.
+ */
+class RouteTable {
+ public:
+    RouteTable();
+
+    void clear();
+    /* returns the index of the new route; a prefix that is there
+     * already keeps its route, unless the new one is an exclude */
+    int add(const uint8_t * addr, unsigned family, unsigned plen,
+            bool exclude);
+
+    /* the longest matching route, or -1 */
+    int lookup(const uint8_t * addr, unsigned family);
+    /* whether the policy sends the address through the tunnel */
+    bool via_vpn(const uint8_t * addr, unsigned family, int *route = NULL);
+
+    /* a copy of the routes, indexed as the lookup results */
+    std::vector < route_entry > get_routes() {
+        QMutexLocker locker(&mutex);
+        return routes;
+    }
+
+    void set_domains(QStringList d) {
+        QMutexLocker locker(&mutex);
+        domains = d;
+    }
+    QStringList get_domains() {
+        QMutexLocker locker(&mutex);
+        return domains;
+    }
+
+ private:
+    struct node {
+        uint32_t child[2];      /* zero when absent; node 0 is the root */
+        int32_t route;
+    };
+
+    int find(const uint8_t * addr, unsigned family);
+
+    std::vector < node > nodes[2];
+    std::vector < route_entry > routes;
+    bool has_includes[2];
+    QStringList domains;
+    QMutex mutex;
+};
+
+#endif                          // ROUTETABLE_H
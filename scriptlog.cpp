@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "scriptlog.h"
+#include "mainwindow.h"
+
+QString script_log_line(int64_t ms, const QString & line)
+{
+    return QLatin1String("[+") + QString::number(ms / 1000.0, 'f', 3) +
+        QLatin1String(" s] ") + line;
+}
+
+#ifdef USE_SCRIPT_LOG
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+}
+
+/* the markers start with a byte the script does not print */
+#define MARK_START "\001start "
+#define MARK_END "\001end "
+#define MARK_TIMEOUT "\001timeout"
+#define MAX_LINE 4096
+
+ScriptLog::ScriptLog(MainWindow * m)
+{
+    this->m = m;
+    this->fd = -1;
+    this->timeout = 0;
+    stop_pipe[0] = stop_pipe[1] = -1;
+}
+
+ScriptLog::~ScriptLog()
+{
+    stop();
+    if (fd != -1)
+        close(fd);
+    if (stop_pipe[0] != -1) {
+        close(stop_pipe[0]);
+        close(stop_pipe[1]);
+    }
+    if (path.empty() == false)
+        unlink(path.c_str());
+    if (dir.empty() == false)
+        rmdir(dir.c_str());
+}
+
+int ScriptLog::setup(std::string & err)
+{
+    char tmpl[] = "/tmp/openconnect-gui-XXXXXX";
+
+    if (mkdtemp(tmpl) == NULL)
+        goto fail;
+    dir = tmpl;
+    path = dir + "/script.log";
+
+    if (mkfifo(path.c_str(), 0600) < 0) {
+        path.clear();
+        goto fail;
+    }
+
+    /* opened for writing too, so that the script never blocks on opening
+     * it and its exit does not end the stream */
+    fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        goto fail;
+
+    if (pipe2(stop_pipe, O_CLOEXEC) < 0) {
+        stop_pipe[0] = stop_pipe[1] = -1;
+        goto fail;
+    }
+    return 0;
+
+ fail:
+    err = strerror(errno);
+    return -1;
+}
+
+QByteArray ScriptLog::wrap(const QByteArray & cmd, unsigned timeout)
+{
+    QByteArray str;
+
+    this->timeout = timeout;
+
+    /* the path is ours and needs no quoting */
+    str = "exec >>" + QByteArray(path.c_str()) + " 2>&1; "
+        "printf '\\001start %s\\n' \"$reason\"; ";
+    if (timeout == 0) {
+        str += cmd + "; r=$?; ";
+    } else {
+        /* the watchdog kills its sleep when it is stopped, so that
+         * nothing outlives the script holding the log open; t covers a
+         * stop before $s is known */
+        str += cmd + " & p=$!; "
+            "( t=; trap 't=1; kill $s 2>/dev/null' TERM; "
+            "sleep " + QByteArray::number(timeout) + " & s=$!; "
+            "[ -z \"$t\" ] || kill $s; "
+            "wait $s && { printf '\\001timeout\\n'; kill $p; } ) & w=$!; "
+            "wait $p; r=$?; kill $w 2>/dev/null; wait $w 2>/dev/null; ";
+    }
+    str += "printf '\\001end %s\\n' $r; exit $r";
+    return str;
+}
+
+void ScriptLog::stop()
+{
+    char c = 0;
+
+    if (this->isRunning() == false)
+        return;
+
+    if (write(stop_pipe[1], &c, 1) < 0)
+        return;
+    this->wait();
+}
+
+void ScriptLog::handle_line(const std::string & line)
+{
+    if (line.compare(0, strlen(MARK_START), MARK_START) == 0) {
+        reason = line.substr(strlen(MARK_START));
+        timer.start();
+        return;
+    }
+
+    if (line.compare(0, strlen(MARK_TIMEOUT), MARK_TIMEOUT) == 0) {
+        m->updateProgressBar(QObject::tr("The vpnc-script (") +
+                             QString::fromLocal8Bit(reason.c_str()) +
+                             QObject::tr(") did not finish in ") +
+                             QString::number(timeout) +
+                             QObject::tr(" s and was stopped"));
+        return;
+    }
+
+    if (line.compare(0, strlen(MARK_END), MARK_END) == 0) {
+        m->updateProgressBar(QObject::tr("The vpnc-script (") +
+                             QString::fromLocal8Bit(reason.c_str()) +
+                             QObject::tr(") exited with status ") +
+                             QString::fromLocal8Bit(line.c_str() +
+                                                    strlen(MARK_END)) +
+                             QObject::tr(" after ") +
+                             QString::number(timer.elapsed()) +
+                             QObject::tr(" ms"), false);
+        reason.clear();
+        return;
+    }
+
+    m->updateProgressBar(script_log_line(reason.empty()? 0 :
+                                         timer.elapsed(),
+                                         QString::fromLocal8Bit(line.
+                                                                c_str())),
+                         false);
+}
+
+/* reads what is available and logs the complete lines */
+void ScriptLog::drain()
+{
+    char buf[1024];
+    size_t pos, start;
+    ssize_t len;
+
+    for (;;) {
+        len = read(fd, buf, sizeof(buf));
+        if (len <= 0)
+            break;
+        partial.append(buf, len);
+
+        start = 0;
+        while ((pos = partial.find('\n', start)) != std::string::npos) {
+            if (pos > start)
+                handle_line(partial.substr(start, pos - start));
+            start = pos + 1;
+        }
+        partial.erase(0, start);
+
+        /* a script that never prints a newline */
+        if (partial.size() > MAX_LINE) {
+            handle_line(partial);
+            partial.clear();
+        }
+    }
+}
+
+void ScriptLog::run()
+{
+    struct pollfd pfd[2];
+    int ret;
+
+    pfd[0].fd = fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = stop_pipe[0];
+    pfd[1].events = POLLIN;
+
+    for (;;) {
+        ret = poll(pfd, 2, -1);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (pfd[0].revents & POLLIN)
+            drain();
+        if (pfd[1].revents)
+            break;
+    }
+    drain();
+}
+
+#endif                          // USE_SCRIPT_LOG
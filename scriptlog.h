@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCRIPTLOG_H
+#define SCRIPTLOG_H
+
+#include "common.h"
+#include <QThread>
+#include <QElapsedTimer>
+#include <QByteArray>
+#include <string>
+#include <stdint.h>
+
+/* formats a line of script output with its time since the script started */
+QString script_log_line(int64_t ms, const QString & line);
+
+#ifdef USE_SCRIPT_LOG
+
+/* Streams the output of the vpnc-script runs made by openconnect into the
+ * log as it is written. The script command is wrapped so that its output
+ * goes to a FIFO read by this thread, framed by markers that give the
+ * reason, the exit status and the wall time of each run; a run that
+ * exceeds the timeout is killed.
+ */
+class ScriptLog:public QThread {
+ public:
+    ScriptLog(class MainWindow * m);
+    ~ScriptLog();
+
+    /* creates the FIFO; returns zero on success */
+    int setup(std::string & err);
+    /* the shell command that runs cmd with its output logged; a timeout
+     * of zero seconds means none */
+    QByteArray wrap(const QByteArray & cmd, unsigned timeout);
+    /* logs what is left in the FIFO and stops the thread */
+    void stop();
+
+ protected:
+    void run();
+
+ private:
+    void drain();
+    void handle_line(const std::string & line);
+
+    MainWindow *m;
+    std::string dir;
+    std::string path;
+    std::string partial;
+    std::string reason;
+    unsigned timeout;
+    int fd;
+    int stop_pipe[2];
+    QElapsedTimer timer;
+};
+
+#endif                          // USE_SCRIPT_LOG
+
+#endif                          // SCRIPTLOG_H
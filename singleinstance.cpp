@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "singleinstance.h"
+#include "mainwindow.h"
+#include "common.h"
+#include <QLocalSocket>
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#endif
+
+#define CMD_TIMEOUT 2000
+#define PROBE_TIMEOUT 500
+
+SingleInstance::SingleInstance(QObject * parent):QObject(parent)
+{
+    this->w = NULL;
+    this->lock_fd = -1;
+    this->server = new QLocalServer(this);
+    connect(server, SIGNAL(newConnection()), this, SLOT(new_connection()));
+}
+
+SingleInstance::~SingleInstance()
+{
+    server->close();
+#ifndef _WIN32
+    if (lock_fd != -1)
+        close(lock_fd);
+#endif
+}
+
+QString SingleInstance::server_name()
+{
+    QString name = QLatin1String(APP_NAME "-");
+#ifdef _WIN32
+    name += QString::fromLocal8Bit(qgetenv("USERNAME"));
+#else
+    name += QString::number(getuid());
+#endif
+    return name;
+}
+
+bool SingleInstance::alive()
+{
+    QLocalSocket socket;
+
+    socket.connectToServer(server_name());
+    if (socket.waitForConnected(PROBE_TIMEOUT) == false)
+        return false;
+    socket.disconnectFromServer();
+    return true;
+}
+
+int SingleInstance::listen()
+{
+#ifndef _WIN32
+    /* two launches at the same time could both find the socket stale
+     * and remove each other's; the lock is dropped by the kernel when
+     * the holder exits, so it cannot go stale itself */
+    QString lock = QDir::tempPath() + QLatin1String("/") + server_name() +
+        QLatin1String(".lock");
+
+    lock_fd = open(QFile::encodeName(lock).constData(),
+                   O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lock_fd != -1 && flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+        close(lock_fd);
+        lock_fd = -1;
+        return -1;
+    }
+#endif
+
+#if QT_VERSION >= 0x050000
+    /* the GUI usually runs as root; other users must not drive it */
+    server->setSocketOptions(QLocalServer::UserAccessOption);
+#endif
+
+    if (server->listen(server_name()) == false) {
+        if (server->serverError() != QAbstractSocket::AddressInUseError)
+            return -2;
+
+        /* only a crashed instance leaves a socket nobody answers on */
+        if (alive() == true)
+            return -1;
+        QLocalServer::removeServer(server_name());
+        if (server->listen(server_name()) == false)
+            return -2;
+    }
+#if QT_VERSION < 0x050000 && !defined(_WIN32)
+    QFile::setPermissions(server->fullServerName(),
+                          QFile::ReadOwner | QFile::WriteOwner);
+#endif
+    return 0;
+}
+
+int SingleInstance::forward(QString cmd, QString & reply)
+{
+    QLocalSocket socket;
+    QByteArray line;
+
+    socket.connectToServer(server_name());
+    if (socket.waitForConnected(CMD_TIMEOUT) == false)
+        return -1;
+
+    socket.write(cmd.toUtf8() + "\n");
+    if (socket.waitForBytesWritten(CMD_TIMEOUT) == false)
+        return -1;
+
+    while (socket.canReadLine() == false) {
+        if (socket.waitForReadyRead(CMD_TIMEOUT) == false)
+            return -1;
+    }
+
+    line = socket.readLine();
+    reply = QString::fromUtf8(line).trimmed();
+    socket.disconnectFromServer();
+    return 0;
+}
+
+void SingleInstance::new_connection()
+{
+    QLocalSocket *socket;
+
+    while ((socket = server->nextPendingConnection()) != NULL) {
+        connect(socket, SIGNAL(readyRead()), this, SLOT(read_command()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        if (socket->canReadLine())
+            QMetaObject::invokeMethod(this, "read_command",
+                                      Qt::QueuedConnection);
+    }
+}
+
+void SingleInstance::read_command()
+{
+    QList < QLocalSocket * >sockets = server->findChildren < QLocalSocket * >();
+
+    for (int i = 0; i < sockets.size(); i++) {
+        QLocalSocket *socket = sockets.at(i);
+        QString cmd, reply;
+
+        if (socket->canReadLine() == false)
+            continue;
+
+        cmd = QString::fromUtf8(socket->readLine()).trimmed();
+        reply = handle(cmd);
+
+        socket->write(reply.toUtf8() + "\n");
+        socket->flush();
+        socket->disconnectFromServer();
+    }
+}
+
+QString SingleInstance::handle(QString cmd)
+{
+    if (w == NULL)
+        return QLatin1String("error: still starting");
+
+    if (cmd == QLatin1String("show")) {
+        w->remote_show();
+        return QLatin1String("ok");
+    } else if (cmd.startsWith(QLatin1String("connect "))) {
+        return w->remote_connect(cmd.mid(8));
+    } else if (cmd == QLatin1String("disconnect")) {
+        w->remote_disconnect();
+        return QLatin1String("ok");
+    } else if (cmd == QLatin1String("status")) {
+        return w->status_text();
+    }
+
+    return QLatin1String("error: unknown command ") + cmd;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SINGLEINSTANCE_H
+#define SINGLEINSTANCE_H
+
+#include <QObject>
+#include <QString>
+#include <QLocalServer>
+
+class MainWindow;
+
+/* Makes sure a single GUI runs per user. Later invocations connect to the
+ * running instance over a local socket, hand it their request (one line
+ * per command) and print the one line reply.
+ */
+class SingleInstance:public QObject {
+ Q_OBJECT public:
+    explicit SingleInstance(QObject * parent = 0);
+    ~SingleInstance();
+
+    /* returns zero when this process is the only instance until it
+     * exits, -1 if another instance is alive and -2 if commands cannot
+     * be served */
+    int listen();
+    void set_window(MainWindow * w) {
+        this->w = w;
+    }
+
+    /* returns zero if a running instance handled the command */
+    static int forward(QString cmd, QString & reply);
+    static QString server_name();
+
+ private slots:
+    void new_connection();
+    void read_command();
+
+ private:
+    QString handle(QString cmd);
+    static bool alive();
+
+    MainWindow *w;
+    QLocalServer *server;
+    int lock_fd;
+};
+
+#endif                          // SINGLEINSTANCE_H
@@ -20,6 +20,9 @@
 #include <storage.h>
 #include <stdio.h>
 #include <cryptdata.h>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QCryptographicHash>
 
 StoredServer::~StoredServer(void)
 {
@@ -29,6 +32,25 @@ StoredServer::~StoredServer(void)
 StoredServer::StoredServer(QSettings * settings)
 {
     this->server_hash_algo = 0;
+    this->userspace_tun = false;
+    this->mtu_probe = false;
+    this->path_mtu = 0;
+    this->dpd = 0;
+    this->reconnect_timeout = DEFAULT_RECONNECT_TIMEOUT;
+    this->adaptive_dpd = false;
+    this->compression = COMPRESSION_STATELESS;
+    this->dtls_attempt_period = DEFAULT_DTLS_ATTEMPT_PERIOD;
+    this->script_timeout = DEFAULT_SCRIPT_TIMEOUT;
+    this->native_config = false;
+    this->net_monitor = true;
+    this->auto_reconnect = false;
+    this->keep_session = false;
+    this->pin_cache = 0;
+    this->session_time = 0;
+    this->dns_cache = false;
+    this->split_dns = false;
+    this->link_rate = 0;
+    this->link_cpu_rate = 0;
     this->settings = settings;
     set_window(NULL);
 };
@@ -52,6 +74,20 @@ QStringList get_server_list(QSettings * settings)
     return res;
 }
 
+/* next to the settings, in a file named after the profile; the settings
+ * themselves may be in the registry */
+static QString journal_file(QSettings * settings, QString & label)
+{
+    QSettings ini(QSettings::IniFormat, QSettings::UserScope,
+                  settings->organizationName(), settings->applicationName());
+    QByteArray hash =
+        QCryptographicHash::hash(label.toUtf8(), QCryptographicHash::Sha1);
+
+    return QFileInfo(ini.fileName()).absolutePath() + "/" +
+        settings->applicationName() + "-token-" +
+        QString::fromLatin1(hash.toHex().left(16)) + ".journal";
+}
+
 void remove_server(QSettings * settings, QString server)
 {
     QStringList keys = settings->allKeys();
@@ -64,6 +100,7 @@ void remove_server(QSettings * settings, QString server)
             settings->remove(keys.at(i));
         }
     }
+    QFile::remove(journal_file(settings, server));
     return;
 }
 
@@ -174,14 +211,49 @@ void StoredServer::get_server_hash(QString & hash)
     }
 }
 
+int StoredServer::update_token_str(QString str)
+{
+    this->token_str = str;
+    this->seen_token = str;
+    return journal.append(CryptData::encode(this->servername, str));
+}
+
+void StoredServer::set_session(QString cookie, QString url, QString addr)
+{
+    this->session_cookie = cookie;
+    this->session_url = url;
+    this->session_addr = addr;
+    this->session_time = QDateTime::currentDateTime().toTime_t();
+}
+
+void StoredServer::clear_session()
+{
+    this->session_cookie.clear();
+    this->session_url.clear();
+    this->session_addr.clear();
+    this->session_time = 0;
+}
+
+unsigned StoredServer::get_session_age()
+{
+    unsigned now = QDateTime::currentDateTime().toTime_t();
+
+    if (this->session_time == 0 || now < this->session_time)
+        return (unsigned)-1;
+    return now - this->session_time;
+}
+
 int StoredServer::load(QString & name)
 {
+    QVariantMap map;
+    QVariantMap::iterator it;
     QByteArray data;
     QString str;
     bool ret;
     int rval = 0;
 
     this->label = name;
+    this->journal.set_file(journal_file(settings, name));
     settings->beginGroup(PREFIX + name);
 
     this->servername = settings->value("server").toString();
@@ -192,8 +264,34 @@ int StoredServer::load(QString & name)
     this->batch_mode = settings->value("batch").toBool();
     this->proxy = settings->value("proxy").toBool();
     this->disable_udp = settings->value("disable-udp").toBool();
+    this->userspace_tun = settings->value("userspace-tun").toBool();
+    this->mtu_probe = settings->value("mtu-probe").toBool();
+    this->path_mtu = settings->value("path-mtu").toInt();
+    this->dpd = settings->value("dpd").toInt();
+    this->reconnect_timeout =
+        settings->value("reconnect-timeout",
+                        DEFAULT_RECONNECT_TIMEOUT).toInt();
+    this->adaptive_dpd = settings->value("adaptive-dpd").toBool();
+    this->compression =
+        settings->value("compression", COMPRESSION_STATELESS).toInt();
+    this->link_rate = settings->value("link-rate").toUInt();
+    this->dtls_attempt_period =
+        settings->value("dtls-attempt-period",
+                        DEFAULT_DTLS_ATTEMPT_PERIOD).toInt();
+    this->script_timeout =
+        settings->value("script-timeout", DEFAULT_SCRIPT_TIMEOUT).toInt();
+    this->native_config = settings->value("native-config").toBool();
+    this->net_monitor = settings->value("net-monitor", true).toBool();
+    this->auto_reconnect = settings->value("auto-reconnect").toBool();
+    this->keep_session = settings->value("keep-session").toBool();
+    this->pin_cache = settings->value("pin-cache").toUInt();
+
+    this->dns_cache = settings->value("dns-cache").toBool();
+    this->split_dns = settings->value("split-dns").toBool();
+    this->link_cpu_rate = settings->value("link-cpu-rate").toUInt();
     this->minimize_on_connect = settings->value("minimize-on-connect").toBool();
 
+    this->form_answers.clear();
     if (this->batch_mode == true) {
         this->groupname = settings->value("groupname").toString();
         ret =
@@ -202,6 +300,23 @@ int StoredServer::load(QString & name)
                               this->password);
         if (ret == false)
             rval = -1;
+
+        map = settings->value("form-answers").toMap();
+        for (it = map.begin(); it != map.end(); ++it) {
+            if (CryptData::decode(this->servername,
+                                  it.value().toByteArray(), str) == true)
+                this->form_answers.insert(it.key(), str);
+        }
+    }
+
+    if (this->keep_session == true) {
+        this->session_url = settings->value("session-url").toString();
+        this->session_addr = settings->value("session-addr").toString();
+        this->session_time = settings->value("session-time").toUInt();
+        if (CryptData::decode(this->servername,
+                              settings->value("session-cookie").toByteArray(),
+                              this->session_cookie) == false)
+            this->session_cookie.clear();
     }
 
     data = settings->value("ca-cert").toByteArray();
@@ -239,23 +354,126 @@ int StoredServer::load(QString & name)
     if (ret == false)
         rval = -1;
 
+    /* token states used since the last save */
+    if (this->journal.last(data) == true)
+        CryptData::decode(this->servername, data, this->token_str);
+    this->seen_token = this->token_str;
+    this->journal_label = name;
+
     this->token_type = settings->value("token-type").toInt();
 
     settings->endGroup();
     return rval;
 }
 
+/* Copies what the profile editor sets from another copy of the profile,
+ * e.g. one just loaded. What a session updates itself (credentials and
+ * answers given to forms, the peer's key, measured link properties and
+ * the stored gateway session) is kept.
+ */
+void StoredServer::copy_options(StoredServer & from)
+{
+    QByteArray data, ours;
+    QString str;
+
+    this->servername = from.servername;
+    this->username = from.username;
+    this->batch_mode = from.batch_mode;
+    this->minimize_on_connect = from.minimize_on_connect;
+    this->proxy = from.proxy;
+    this->disable_udp = from.disable_udp;
+    this->userspace_tun = from.userspace_tun;
+    this->mtu_probe = from.mtu_probe;
+    this->dpd = from.dpd;
+    this->reconnect_timeout = from.reconnect_timeout;
+    this->adaptive_dpd = from.adaptive_dpd;
+    this->compression = from.compression;
+    this->dtls_attempt_period = from.dtls_attempt_period;
+    this->script_timeout = from.script_timeout;
+    this->native_config = from.native_config;
+    this->net_monitor = from.net_monitor;
+    this->auto_reconnect = from.auto_reconnect;
+    this->keep_session = from.keep_session;
+    this->pin_cache = from.pin_cache;
+    this->dns_cache = from.dns_cache;
+    this->split_dns = from.split_dns;
+    /* the answers were forgotten in the editor, or are no longer kept */
+    if (from.form_answers.isEmpty() == true || from.batch_mode == false)
+        this->form_answers.clear();
+    /* loading replays the journal, so this is the latest state */
+    this->token_str = from.token_str;
+    this->seen_token = from.token_str;
+    this->token_type = from.token_type;
+
+    from.ca_cert.data_export(data);
+    this->ca_cert.data_export(ours);
+    if (data != ours) {
+        this->ca_cert.clear();
+        if (data.isEmpty() == false)
+            this->ca_cert.import_pem(data);
+    }
+
+    from.client.cert_export(data);
+    this->client.cert_export(ours);
+    if (data != ours) {
+        this->client.cert.clear();
+        if (data.isEmpty() == false)
+            this->client.cert.import_pem(data);
+    }
+
+    from.client.key_export(data);
+    this->client.key_export(ours);
+    if (data != ours) {
+        this->client.key.clear();
+        str = QString::fromLatin1(data);
+        if (is_url(str) == true)
+            this->client.key.import_file(str);
+        else if (data.isEmpty() == false)
+            this->client.key.import_pem(data);
+    }
+}
+
 int StoredServer::save()
 {
     QString empty = "";
     QString str;
-    QByteArray data;
+    QByteArray data, seen;
+    QVariantMap map;
+    QMap < QString, QString >::iterator it;
+    bool journaled, edited;
+
+    /* another copy of the profile (the session's) may have used the token
+     * since this one was loaded; its state wins unless the token was
+     * changed here */
+    edited = (this->token_str != this->seen_token);
+    journaled = this->journal.last(seen);
+    if (journaled == true && edited == false)
+        CryptData::decode(this->servername, seen, this->token_str);
 
     settings->beginGroup(PREFIX + this->label);
     settings->setValue("server", this->servername);
     settings->setValue("batch", this->batch_mode);
     settings->setValue("proxy", this->proxy);
     settings->setValue("disable-udp", this->disable_udp);
+    settings->setValue("userspace-tun", this->userspace_tun);
+    settings->setValue("mtu-probe", this->mtu_probe);
+    settings->setValue("path-mtu", this->path_mtu);
+    settings->setValue("dpd", this->dpd);
+    settings->setValue("reconnect-timeout", this->reconnect_timeout);
+    settings->setValue("adaptive-dpd", this->adaptive_dpd);
+    settings->setValue("compression", this->compression);
+    settings->setValue("dtls-attempt-period", this->dtls_attempt_period);
+    settings->setValue("script-timeout", this->script_timeout);
+    settings->setValue("native-config", this->native_config);
+    settings->setValue("net-monitor", this->net_monitor);
+    settings->setValue("auto-reconnect", this->auto_reconnect);
+    settings->setValue("keep-session", this->keep_session);
+    settings->setValue("pin-cache", this->pin_cache);
+
+    settings->setValue("dns-cache", this->dns_cache);
+    settings->setValue("split-dns", this->split_dns);
+    settings->setValue("link-rate", this->link_rate);
+    settings->setValue("link-cpu-rate", this->link_cpu_rate);
     settings->setValue("minimize-on-connect", this->minimize_on_connect);
     settings->setValue("username", this->username);
 
@@ -263,6 +481,31 @@ int StoredServer::save()
         settings->setValue("password",
                            CryptData::encode(this->servername, this->password));
         settings->setValue("groupname", this->groupname);
+
+        for (it = this->form_answers.begin(); it != this->form_answers.end();
+             ++it)
+            map.insert(it.key(),
+                       CryptData::encode(this->servername, it.value()));
+    }
+    /* like the password, the answers are only kept in batch mode */
+    if (map.isEmpty() == false)
+        settings->setValue("form-answers", map);
+    else
+        settings->remove("form-answers");
+
+    /* the cookie is as good as the password while the session lasts */
+    if (this->keep_session == true && this->session_cookie.isEmpty() == false) {
+        settings->setValue("session-cookie",
+                           CryptData::encode(this->servername,
+                                             this->session_cookie));
+        settings->setValue("session-url", this->session_url);
+        settings->setValue("session-addr", this->session_addr);
+        settings->setValue("session-time", this->session_time);
+    } else {
+        settings->remove("session-cookie");
+        settings->remove("session-url");
+        settings->remove("session-addr");
+        settings->remove("session-time");
     }
 
     this->ca_cert.data_export(data);
@@ -283,5 +526,29 @@ int StoredServer::save()
     settings->setValue("token-type", this->token_type);
 
     settings->endGroup();
+
+    /* saved under a new name: the profile under the old one stays, and
+     * gets the state its journal held, as the journal moves along */
+    if (journaled == true && this->journal_label.isEmpty() == false
+        && this->journal_label != this->label
+        && settings->contains(PREFIX + this->journal_label + "/server")) {
+        settings->setValue(PREFIX + this->journal_label + "/token-str", seen);
+    }
+
+    /* the journal goes only once its state is on disk in the profile, and
+     * only if nothing was appended to it meanwhile */
+    if (journaled == true || this->journal.exists() == true) {
+        settings->sync();
+        if (settings->status() == QSettings::NoError) {
+            if (edited == true)
+                this->journal.clear();
+            else
+                this->journal.clear_upto(seen);
+        }
+    }
+
+    this->journal.set_file(journal_file(settings, this->label));
+    this->journal_label = this->label;
+    this->seen_token = this->token_str;
     return 0;
 }
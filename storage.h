@@ -24,8 +24,23 @@
 #include <QStringList>
 #include <QCoreApplication>
 #include <QSettings>
+#include <QMap>
 #include <gnutls/gnutls.h>
 #include "keypair.h"
+#include "tokenjournal.h"
+
+/* seconds to keep trying to reconnect a dropped session */
+#define DEFAULT_RECONNECT_TIMEOUT 15
+/* seconds between attempts to bring DTLS up */
+#define DEFAULT_DTLS_ATTEMPT_PERIOD 60
+/* seconds a vpnc-script run may take before it is killed */
+#define DEFAULT_SCRIPT_TIMEOUT 30
+
+/* oc_compression_mode_t, plus a choice made from the last session */
+#define COMPRESSION_NONE 0
+#define COMPRESSION_STATELESS 1
+#define COMPRESSION_ALL 2
+#define COMPRESSION_AUTO 3
 
 QStringList get_server_list(QSettings * settings);
 void remove_server(QSettings * settings, QString server);
@@ -55,6 +70,10 @@ class StoredServer {
         return this->label;
     }
 
+    QSettings *get_settings(void) {
+        return this->settings;
+    }
+
     void set_servername(QString name) {
         this->servername = name;
     }
@@ -138,6 +157,9 @@ class StoredServer {
     void set_token_str(QString str) {
         this->token_str = str;
     }
+    /* records a token state that advanced during use (the HOTP counter)
+     * in the journal, without rewriting the profile */
+    int update_token_str(QString str);
 
     int get_token_type() {
         return this->token_type;
@@ -147,6 +169,187 @@ class StoredServer {
         return this->disable_udp;
     }
 
+    bool get_userspace_tun() {
+        return this->userspace_tun;
+    }
+
+    void set_userspace_tun(bool t) {
+        this->userspace_tun = t;
+    }
+
+    bool get_mtu_probe() {
+        return this->mtu_probe;
+    }
+
+    void set_mtu_probe(bool t) {
+        this->mtu_probe = t;
+    }
+
+    /* the last path MTU found to the gateway, or zero */
+    int get_path_mtu() {
+        return this->path_mtu;
+    }
+
+    void set_path_mtu(int mtu) {
+        this->path_mtu = mtu;
+    }
+
+    /* seconds; zero leaves dead peer detection to the server */
+    int get_dpd() {
+        return this->dpd;
+    }
+
+    void set_dpd(int secs) {
+        this->dpd = secs;
+    }
+
+    int get_reconnect_timeout() {
+        return this->reconnect_timeout;
+    }
+
+    void set_reconnect_timeout(int secs) {
+        this->reconnect_timeout = secs;
+    }
+
+    bool get_adaptive_dpd() {
+        return this->adaptive_dpd;
+    }
+
+    void set_adaptive_dpd(bool t) {
+        this->adaptive_dpd = t;
+    }
+
+    int get_dtls_attempt_period() {
+        return this->dtls_attempt_period;
+    }
+
+    void set_dtls_attempt_period(int secs) {
+        this->dtls_attempt_period = secs;
+    }
+
+    /* answers to login form fields, by "form id:field name" */
+    bool get_form_answer(QString key, QString & value) {
+        if (this->form_answers.contains(key) == false)
+            return false;
+        value = this->form_answers.value(key);
+        return true;
+    }
+    void set_form_answer(QString key, QString value) {
+        this->form_answers.insert(key, value);
+    }
+    void forget_form_answer(QString key) {
+        this->form_answers.remove(key);
+    }
+    void clear_form_answers() {
+        this->form_answers.clear();
+    }
+    int get_form_answer_count() {
+        return this->form_answers.size();
+    }
+
+    /* seconds to keep token PINs for, zero for not at all */
+    unsigned get_pin_cache() {
+        return this->pin_cache;
+    }
+
+    void set_pin_cache(unsigned secs) {
+        this->pin_cache = secs;
+    }
+
+    bool get_keep_session() {
+        return this->keep_session;
+    }
+
+    void set_keep_session(bool t) {
+        this->keep_session = t;
+    }
+
+    /* the gateway session left behind by a detached GUI */
+    void set_session(QString cookie, QString url, QString addr);
+    void clear_session();
+    QString & get_session_cookie() {
+        return this->session_cookie;
+    }
+    QString & get_session_url() {
+        return this->session_url;
+    }
+    QString & get_session_addr() {
+        return this->session_addr;
+    }
+    /* seconds since the session was stored */
+    unsigned get_session_age();
+
+    bool get_auto_reconnect() {
+        return this->auto_reconnect;
+    }
+
+    void set_auto_reconnect(bool t) {
+        this->auto_reconnect = t;
+    }
+
+    bool get_net_monitor() {
+        return this->net_monitor;
+    }
+
+    void set_net_monitor(bool t) {
+        this->net_monitor = t;
+    }
+
+    bool get_native_config() {
+        return this->native_config;
+    }
+
+    void set_native_config(bool t) {
+        this->native_config = t;
+    }
+
+    int get_script_timeout() {
+        return this->script_timeout;
+    }
+
+    void set_script_timeout(int secs) {
+        this->script_timeout = secs;
+    }
+
+    bool get_dns_cache() {
+        return this->dns_cache;
+    }
+
+    void set_dns_cache(bool t) {
+        this->dns_cache = t;
+    }
+
+    bool get_split_dns() {
+        return this->split_dns;
+    }
+
+    void set_split_dns(bool t) {
+        this->split_dns = t;
+    }
+
+    int get_compression() {
+        return this->compression;
+    }
+
+    void set_compression(int mode) {
+        this->compression = mode;
+    }
+
+    /* measured by the last session, for the automatic compression mode:
+     * the link rate and the payload rate the CPU time allowed, bytes/s */
+    void set_link_stats(unsigned rate, unsigned cpu_rate) {
+        this->link_rate = rate;
+        this->link_cpu_rate = cpu_rate;
+    }
+
+    unsigned get_link_rate() {
+        return this->link_rate;
+    }
+
+    unsigned get_link_cpu_rate() {
+        return this->link_cpu_rate;
+    }
+
     void set_token_type(int type) {
         this->token_type = type;
     }
@@ -164,6 +367,8 @@ class StoredServer {
     void get_server_hash(QString & hash);
 
     int save();
+    /* takes over the settings of the profile editor from another copy */
+    void copy_options(StoredServer & from);
 
     QString last_err;
 
@@ -172,11 +377,39 @@ class StoredServer {
     bool minimize_on_connect;
     bool proxy;
     bool disable_udp;
+    bool userspace_tun;
+    bool mtu_probe;
+    int path_mtu;
+    int dpd;
+    int reconnect_timeout;
+    bool adaptive_dpd;
+    int compression;
+    int dtls_attempt_period;
+    int script_timeout;
+    bool native_config;
+    bool net_monitor;
+    bool auto_reconnect;
+    bool keep_session;
+    unsigned pin_cache;
+    QMap < QString, QString > form_answers;
+    QString session_cookie;
+    QString session_url;
+    QString session_addr;
+    unsigned session_time;
+    bool dns_cache;
+    bool split_dns;
+    unsigned link_rate;
+    unsigned link_cpu_rate;
     QString username;
     QString password;
     QString groupname;
     QString servername;
     QString token_str;
+    TokenJournal journal;
+    /* the token state as loaded or last recorded by this copy, and the
+     * profile the journal belongs to */
+    QString seen_token;
+    QString journal_label;
     QString label;
     int token_type;
     QByteArray server_hash;
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "systemkeys.h"
+
+#ifdef USE_SYSTEM_KEYS
+#include <gnutls/system-keys.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+SystemKeys::SystemKeys()
+{
+    this->stamp = 0;
+    this->valid = false;
+}
+
+/* shared by all editors; it lives as long as the application */
+SystemKeys *SystemKeys::instance()
+{
+    static SystemKeys *keys = NULL;
+
+    if (keys == NULL)
+        keys = new SystemKeys();
+    return keys;
+}
+
+/* the time the user's certificate store was last written to, zero when
+ * unknown; certificates of inserted smart cards are propagated there */
+static uint64_t store_stamp()
+{
+#ifdef _WIN32
+    HKEY key;
+    FILETIME ft;
+    LONG ret;
+
+    if (RegOpenKeyExW(HKEY_CURRENT_USER,
+                      L"Software\\Microsoft\\SystemCertificates\\MY\\Certificates",
+                      0, KEY_READ, &key) != ERROR_SUCCESS)
+        return 0;
+    ret = RegQueryInfoKeyW(key, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                           NULL, NULL, NULL, &ft);
+    RegCloseKey(key);
+    if (ret != ERROR_SUCCESS)
+        return 0;
+    return ((uint64_t) ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+#else
+    return 0;
+#endif
+}
+
+std::vector < win_cert_st > SystemKeys::get_entries()
+{
+    QMutexLocker locker(&this->mutex);
+
+    return this->entries;
+}
+
+void SystemKeys::refresh()
+{
+    uint64_t now = store_stamp();
+
+    this->mutex.lock();
+    if (this->valid == true && now != 0 && now == this->stamp) {
+        this->mutex.unlock();
+        return;
+    }
+    this->mutex.unlock();
+
+    if (this->isRunning() == false)
+        this->start(QThread::LowPriority);
+}
+
+void SystemKeys::run()
+{
+#ifdef USE_SYSTEM_KEYS
+    gnutls_system_key_iter_t iter = NULL;
+    std::vector < win_cert_st > list;
+    char *label;
+    char *cert_url;
+    char *key_url;
+    uint64_t before;
+    int ret;
+
+    /* taken first: a change during the walk is seen by the next refresh */
+    before = store_stamp();
+
+    do {
+        ret =
+            gnutls_system_key_iter_get_info(&iter, GNUTLS_CRT_X509, &cert_url,
+                                            &key_url, &label, NULL, 0);
+        if (ret >= 0) {
+            win_cert_st st;
+
+            if (label != NULL)
+                st.label = QString::fromUtf8(label);
+            else
+                st.label = QString::fromUtf8(cert_url);
+            st.key_url = QString::fromUtf8(key_url);
+            st.cert_url = QString::fromUtf8(cert_url);
+            list.push_back(st);
+
+            gnutls_free(label);
+            gnutls_free(cert_url);
+            gnutls_free(key_url);
+
+            emit found(st.label, st.cert_url, st.key_url);
+        }
+    } while (ret >= 0);
+    gnutls_system_key_iter_deinit(iter);
+
+    this->mutex.lock();
+    this->entries = list;
+    this->stamp = before;
+    this->valid = true;
+    this->mutex.unlock();
+
+    emit done();
+#endif
+}
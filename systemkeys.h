@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SYSTEMKEYS_H
+#define SYSTEMKEYS_H
+
+#include "common.h"
+#include <QThread>
+#include <QMutex>
+#include <QString>
+#include <vector>
+#include <stdint.h>
+
+struct win_cert_st {
+    QString label;
+    QString key_url;
+    QString cert_url;
+};
+
+/* Enumerates the keys of the system store (gnutls system keys) on a
+ * thread of its own, so that a slow store or smart card does not hold up
+ * the profile editor. The last complete enumeration is kept for the
+ * next editor; it is redone when the store changed since, as far as a
+ * cheap stamp tells, and always when there is no stamp.
+ */
+class SystemKeys:public QThread {
+ Q_OBJECT public:
+    static SystemKeys *instance();
+
+    /* the entries of the last complete enumeration */
+    std::vector < win_cert_st > get_entries();
+    /* starts an enumeration, unless the store is known not to have
+     * changed or one is running */
+    void refresh();
+
+ signals:
+    /* an entry of the running enumeration */
+    void found(QString label, QString cert_url, QString key_url);
+    /* the enumeration is complete; get_entries() has its result */
+    void done();
+
+ protected:
+    void run();
+
+ private:
+    SystemKeys();
+
+    QMutex mutex;
+    std::vector < win_cert_st > entries;
+    uint64_t stamp;
+    bool valid;
+};
+
+#endif                          // SYSTEMKEYS_H
@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dnsproxy.h"
+#include <QThread>
+#include <set>
+#include <vector>
+#include <string>
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+}
+
+/* Runs the DNS stub against a stand-in server in a network namespace of
+ * its own (as root, since both listen on port 53):
+ *
+ * - forwarded queries must leave from distinct source ports with ids
+ *   that are not sequential
+ * - a name whose answer is truncated over UDP must be resolvable over
+ *   TCP through the stub, with the client's id
+ */
+
+#define UPSTREAM "127.0.3.1"
+#define QUERIES 200
+#define BIG_RECORDS 100         /* too many for a UDP answer */
+
+static uint16_t get16(const uint8_t * p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static size_t make_query(uint8_t * buf, uint16_t id, const char *name)
+{
+    size_t off = 12, n;
+    const char *dot;
+
+    memset(buf, 0, 12);
+    buf[0] = id >> 8;
+    buf[1] = id & 0xff;
+    buf[2] = 0x01;              /* recursion desired */
+    buf[5] = 1;
+    while (*name) {
+        dot = strchr(name, '.');
+        n = dot ? (size_t)(dot - name) : strlen(name);
+        buf[off++] = n;
+        memcpy(buf + off, name, n);
+        off += n;
+        name += n + (dot ? 1 : 0);
+    }
+    buf[off++] = 0;
+    buf[off++] = 0;
+    buf[off++] = 1;             /* A */
+    buf[off++] = 0;
+    buf[off++] = 1;             /* IN */
+    return off;
+}
+
+/* answers the query in q with records A records, or truncated */
+static std::vector < uint8_t > make_answer(const uint8_t * q, size_t len,
+                                           unsigned records, bool tc)
+{
+    std::vector < uint8_t > a(q, q + len);
+    static const uint8_t rr[] = { 0xc0, 0x0c, 0, 1, 0, 1, 0, 0, 0, 60,
+        0, 4, 10, 0, 0, 0
+    };
+    unsigned i;
+
+    a[2] = 0x81 | (tc ? 0x02 : 0);
+    a[3] = 0x80;
+    if (tc)
+        records = 0;
+    a[6] = records >> 8;
+    a[7] = records & 0xff;
+    for (i = 0; i < records; i++) {
+        a.insert(a.end(), rr, rr + sizeof(rr));
+        a[a.size() - 1] = i;
+    }
+    return a;
+}
+
+class Upstream:public QThread {
+ public:
+    Upstream() {
+        struct sockaddr_in sa;
+        int one = 1;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons(53);
+        inet_pton(AF_INET, UPSTREAM, &sa.sin_addr);
+
+        udp = socket(AF_INET, SOCK_DGRAM, 0);
+        tcp = socket(AF_INET, SOCK_STREAM, 0);
+        setsockopt(tcp, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(udp, (struct sockaddr *)&sa, sizeof(sa)) < 0
+            || bind(tcp, (struct sockaddr *)&sa, sizeof(sa)) < 0
+            || listen(tcp, 4) < 0 || pipe(stop_pipe) < 0) {
+            perror("upstream");
+            exit(1);
+        }
+        tcp_queries = 0;
+    }
+
+    void stop() {
+        char c = 0;
+
+        if (write(stop_pipe[1], &c, 1) == 1)
+            wait();
+    }
+
+    std::set < unsigned >ports;
+    std::vector < uint16_t > ids;
+    unsigned tcp_queries;
+
+ protected:
+    void run() {
+        struct pollfd pfd[3];
+
+        pfd[0].fd = udp;
+        pfd[1].fd = tcp;
+        pfd[2].fd = stop_pipe[0];
+        pfd[0].events = pfd[1].events = pfd[2].events = POLLIN;
+        for (;;) {
+            if (poll(pfd, 3, -1) < 0 || pfd[2].revents)
+                return;
+            if (pfd[0].revents & POLLIN)
+                serve_udp();
+            if (pfd[1].revents & POLLIN)
+                serve_tcp();
+        }
+    }
+
+ private:
+    void serve_udp() {
+        uint8_t buf[512];
+        struct sockaddr_in from;
+        socklen_t flen = sizeof(from);
+        std::vector < uint8_t > a;
+        ssize_t len;
+
+        len = recvfrom(udp, buf, sizeof(buf), 0, (struct sockaddr *)&from,
+                       &flen);
+        if (len < 12)
+            return;
+        ports.insert(ntohs(from.sin_port));
+        ids.push_back(get16(buf));
+
+        a = make_answer(buf, len, 1, memcmp(buf + 13, "big", 3) == 0);
+        sendto(udp, &a[0], a.size(), 0, (struct sockaddr *)&from, flen);
+    }
+
+    void serve_tcp() {
+        uint8_t buf[514];
+        std::vector < uint8_t > a;
+        uint8_t hdr[2];
+        ssize_t len;
+        int fd;
+
+        fd = accept(tcp, NULL, NULL);
+        if (fd < 0)
+            return;
+        if (recv(fd, hdr, 2, MSG_WAITALL) == 2) {
+            len = recv(fd, buf, get16(hdr), MSG_WAITALL);
+            if (len == get16(hdr) && len >= 12) {
+                tcp_queries++;
+                a = make_answer(buf, len, BIG_RECORDS, false);
+                hdr[0] = a.size() >> 8;
+                hdr[1] = a.size() & 0xff;
+                a.insert(a.begin(), hdr, hdr + 2);
+                if (send(fd, &a[0], a.size(), 0) < 0)
+                    perror("send");
+            }
+        }
+        close(fd);
+    }
+
+    int udp;
+    int tcp;
+    int stop_pipe[2];
+};
+
+static struct sockaddr_in stub_addr(void)
+{
+    struct sockaddr_in sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(53);
+    inet_pton(AF_INET, DNS_PROXY_ADDR, &sa.sin_addr);
+    return sa;
+}
+
+static int udp_queries(void)
+{
+    struct sockaddr_in sa = stub_addr();
+    struct timeval tv = { 2, 0 };
+    uint8_t buf[512];
+    char name[64];
+    size_t len;
+    unsigned i;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    for (i = 0; i < QUERIES; i++) {
+        snprintf(name, sizeof(name), "host%u.example.com", i);
+        len = make_query(buf, i, name);
+        sendto(fd, buf, len, 0, (struct sockaddr *)&sa, sizeof(sa));
+        if (recv(fd, buf, sizeof(buf), 0) < 12 || get16(buf) != i) {
+            fprintf(stderr, "no answer for %s\n", name);
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+/* a UDP query for the big name, then the same over TCP */
+static int tcp_query(void)
+{
+    struct sockaddr_in sa = stub_addr();
+    struct timeval tv = { 2, 0 };
+    uint8_t buf[4096];
+    size_t len;
+    ssize_t ret;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    len = make_query(buf, 4321, "big.example.com");
+    sendto(fd, buf, len, 0, (struct sockaddr *)&sa, sizeof(sa));
+    ret = recv(fd, buf, sizeof(buf), 0);
+    close(fd);
+    if (ret < 12 || (buf[2] & 0x02) == 0) {
+        fprintf(stderr, "no truncated answer over UDP\n");
+        return -1;
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        perror("TCP connect to the stub");
+        close(fd);
+        return -1;
+    }
+    len = make_query(buf + 2, 4322, "big.example.com");
+    buf[0] = len >> 8;
+    buf[1] = len & 0xff;
+    if (send(fd, buf, len + 2, 0) < 0
+        || recv(fd, buf, 2, MSG_WAITALL) != 2
+        || (ret = recv(fd, buf + 2, get16(buf), MSG_WAITALL)) != get16(buf)
+        || get16(buf + 2) != 4322 || get16(buf + 2 + 6) != BIG_RECORDS) {
+        fprintf(stderr, "no full answer over TCP\n");
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    printf("%-28s %u records, %u bytes\n", "TCP after truncation",
+           BIG_RECORDS, (unsigned)ret);
+    return 0;
+}
+
+int main(void)
+{
+    struct dns_stats s;
+    std::string err;
+    unsigned i, sequential = 0;
+    int ret = 0;
+
+    if (getuid() != 0 || unshare(CLONE_NEWNET) != 0) {
+        printf("skipped: needs root for a network namespace\n");
+        return 0;
+    }
+    if (system("ip link set lo up") != 0)
+        return 1;
+
+    Upstream up;
+    up.start();
+
+    DnsProxy proxy;
+    proxy.add_server(UPSTREAM);
+    if (proxy.setup(err) != 0) {
+        fprintf(stderr, "setup: %s\n", err.c_str());
+        return 1;
+    }
+    proxy.start();
+
+    if (udp_queries() != 0)
+        ret = 1;
+    for (i = 1; i < up.ids.size(); i++) {
+        if (up.ids[i] == (uint16_t) (up.ids[i - 1] + 1))
+            sequential++;
+    }
+    printf("%-28s %u queries, %u source ports, %u sequential ids\n",
+           "forwarded over UDP", (unsigned)up.ids.size(),
+           (unsigned)up.ports.size(), sequential);
+    if (up.ids.size() != QUERIES || up.ports.size() < QUERIES * 9 / 10
+        || sequential > 2)
+        ret = 1;
+
+    if (tcp_query() != 0 || up.tcp_queries != 1)
+        ret = 1;
+
+    proxy.get_stats(&s);
+    printf("%-28s %u queries, %u forwarded, %u failed\n", "stub",
+           s.queries, s.forwarded, s.failed);
+    if (s.failed != 0)
+        ret = 1;
+
+    proxy.stop();
+    up.stop();
+    return ret;
+}
@@ -0,0 +1,23 @@
+# The DNS stub against a stand-in server in a network namespace of its
+# own; needs root, and is skipped without.
+
+QMAKE_CXXFLAGS += -O2 -g
+
+QT       += core
+QT       -= gui
+
+TARGET = dnsproxy
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += dnsproxy.cpp \
+    ../../dnsproxy.cpp \
+    ../../domaintrie.cpp
+
+HEADERS += ../../dnsproxy.h \
+    ../../domaintrie.h
+
+LIBS += -lgnutls
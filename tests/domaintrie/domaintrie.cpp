@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "domaintrie.h"
+#include <set>
+#include <vector>
+#include <string>
+
+extern "C" {
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+}
+
+/* Checks the split-DNS domain list and times it; runs as any user.
+ *
+ * - a name matches a domain it equals or lies below, label by label, and
+ *   neither a parent of a domain nor a name merely ending in its text
+ * - case, and leading or trailing dots, do not matter on either side
+ * - match_wire() refuses names that run past the buffer, labels longer
+ *   than 63 bytes, compression pointers and too many labels
+ * - over DOMAINS random domains both matchers agree with a set of the
+ *   names' suffixes, and the time per lookup is reported for each
+ */
+
+#define DOMAINS 100000
+#define LOOKUPS 1000000
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* a dotted name in DNS wire format, with the root label */
+static size_t to_wire(uint8_t * buf, const char *name)
+{
+    size_t off = 0, n;
+    const char *dot;
+
+    while (*name) {
+        dot = strchr(name, '.');
+        n = dot ? (size_t)(dot - name) : strlen(name);
+        buf[off++] = n;
+        memcpy(buf + off, name, n);
+        off += n;
+        name += n + (dot ? 1 : 0);
+    }
+    buf[off++] = 0;
+    return off;
+}
+
+static int failures = 0;
+
+static void expect(DomainTrie * t, const char *name, bool match)
+{
+    uint8_t wire[512];
+    size_t len;
+
+    if (t->match(name) != match) {
+        fprintf(stderr, "%s: %s, expected %s\n", name,
+                match ? "no match" : "matched", match ? "a match" : "none");
+        failures++;
+    }
+
+    /* the wire form has no leading dot to skip */
+    if (name[0] == '.')
+        return;
+    len = to_wire(wire, name);
+    if (t->match_wire(wire, len) != match) {
+        fprintf(stderr, "%s (wire): %s, expected %s\n", name,
+                match ? "no match" : "matched", match ? "a match" : "none");
+        failures++;
+    }
+}
+
+static void expect_wire(DomainTrie * t, const char *what,
+                        const uint8_t * wire, size_t len, bool match)
+{
+    if (t->match_wire(wire, len) != match) {
+        fprintf(stderr, "%s: %s, expected %s\n", what,
+                match ? "no match" : "matched", match ? "a match" : "none");
+        failures++;
+    }
+}
+
+static void check_names(void)
+{
+    DomainTrie t;
+
+    expect(&t, "example.com", false);
+
+    t.add("example.com");
+    expect(&t, "example.com", true);
+    expect(&t, "www.example.com", true);
+    expect(&t, "a.b.c.example.com", true);
+    expect(&t, "com", false);
+    expect(&t, "notexample.com", false);
+    expect(&t, "ample.com", false);
+    expect(&t, "example.com.evil.net", false);
+    expect(&t, "example.org", false);
+
+    /* a domain below another does not match its parent */
+    t.add("corp.example.net");
+    expect(&t, "corp.example.net", true);
+    expect(&t, "host.corp.example.net", true);
+    expect(&t, "example.net", false);
+    expect(&t, "other.example.net", false);
+    t.add("example.net");
+    expect(&t, "other.example.net", true);
+
+    /* case folding, on both sides */
+    t.add("Intranet.EXAMPLE.org");
+    expect(&t, "intranet.example.org", true);
+    expect(&t, "WWW.INTRANET.Example.Org", true);
+    expect(&t, "WWW.EXAMPLE.COM", true);
+
+    /* leading and trailing dots, on both sides */
+    t.add(".lan");
+    t.add("home.arpa.");
+    expect(&t, "printer.lan", true);
+    expect(&t, "lan.", true);
+    expect(&t, ".printer.lan", true);
+    expect(&t, "x.home.arpa", true);
+    expect(&t, "www.example.com.", true);
+    expect(&t, "arpa", false);
+    expect(&t, ".", false);
+    expect(&t, "", false);
+
+    /* neither an empty domain nor a repeated one counts */
+    t.add("");
+    t.add(".");
+    t.add("EXAMPLE.com.");
+    if (t.size() != 6) {
+        fprintf(stderr, "%u domains, expected 6\n", t.size());
+        failures++;
+    }
+    expect(&t, "unrelated.test", false);
+
+    t.clear();
+    expect(&t, "www.example.com", false);
+    if (t.size() != 0) {
+        fprintf(stderr, "%u domains after clear\n", t.size());
+        failures++;
+    }
+}
+
+static void check_wire(void)
+{
+    DomainTrie t;
+    uint8_t wire[1024];
+    size_t len, off, i;
+
+    t.add("example.com");
+    len = to_wire(wire, "www.example.com");
+    expect_wire(&t, "whole name", wire, len, true);
+    expect_wire(&t, "no root label", wire, len - 1, false);
+    expect_wire(&t, "cut in a label", wire, len - 3, false);
+    expect_wire(&t, "empty buffer", wire, 0, false);
+
+    /* a label length beyond the buffer */
+    wire[4] = 200;
+    expect_wire(&t, "label past the end", wire, len, false);
+
+    /* labels are 63 bytes at most; 64 and up is a pointer or reserved */
+    memset(wire, 'a', sizeof(wire));
+    wire[0] = 63;
+    len = 64 + to_wire(wire + 64, "example.com");
+    expect_wire(&t, "63 byte label", wire, len, true);
+    wire[0] = 64;
+    memmove(wire + 65, wire + 64, len - 64);
+    wire[64] = 'a';
+    expect_wire(&t, "64 byte label", wire, len + 1, false);
+
+    /* a compression pointer to the domain is not followed */
+    off = to_wire(wire, "example.com");
+    wire[off] = 3;
+    memcpy(wire + off + 1, "www", 3);
+    wire[off + 4] = 0xc0;
+    wire[off + 5] = 0;
+    expect_wire(&t, "compressed", wire + off, 6, false);
+
+    /* more labels than a name can have are refused, not stored */
+    off = 0;
+    for (i = 0; i < 200; i++) {
+        wire[off++] = 1;
+        wire[off++] = 'a';
+    }
+    off += to_wire(wire + off, "example.com");
+    expect_wire(&t, "200 labels", wire, off, false);
+    std::string dotted;
+    for (i = 0; i < 200; i++)
+        dotted += "a.";
+    dotted += "example.com";
+    if (t.match(dotted.c_str()) == true) {
+        fprintf(stderr, "200 labels: matched\n");
+        failures++;
+    }
+}
+
+static std::string random_label(void)
+{
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789-";
+    unsigned i, n = 1 + rand() % 12;
+    std::string s;
+
+    for (i = 0; i < n; i++)
+        s += chars[rand() % (sizeof(chars) - 1)];
+    return s;
+}
+
+static const char *tlds[] = { "com", "net", "org", "example", "corp" };
+
+static std::string random_domain(void)
+{
+    std::string s = tlds[rand() % 5];
+    unsigned i, n = 1 + rand() % 3;
+
+    for (i = 0; i < n; i++)
+        s = random_label() + "." + s;
+    return s;
+}
+
+/* whether the name or one of its parents is in the set */
+static bool reference(const std::set < std::string > &domains,
+                      const std::string & name)
+{
+    size_t pos = 0;
+
+    while (true) {
+        if (domains.count(name.substr(pos)) != 0)
+            return true;
+        pos = name.find('.', pos);
+        if (pos == std::string::npos)
+            return false;
+        pos++;
+    }
+}
+
+static void benchmark(void)
+{
+    DomainTrie t;
+    std::set < std::string > set;
+    std::vector < std::string > list, names;
+    std::vector < uint8_t > wire(LOOKUPS * 64);
+    std::vector < size_t > wire_len(LOOKUPS);
+    uint64_t t0, build, dotted, on_wire, in_set;
+    unsigned i, hits = 0, mismatches = 0;
+    volatile unsigned sink = 0;
+
+    srand(1);
+    for (i = 0; i < DOMAINS; i++)
+        list.push_back(random_domain());
+    t0 = now_ns();
+    for (i = 0; i < DOMAINS; i++)
+        t.add(list[i].c_str());
+    build = now_ns() - t0;
+    set.insert(list.begin(), list.end());
+
+    /* half of the names lie below a listed domain */
+    for (i = 0; i < LOOKUPS; i++) {
+        if (i % 2 == 0)
+            names.push_back(random_label() + "." + list[rand() % DOMAINS]);
+        else
+            names.push_back(random_label() + "." + random_domain());
+        wire_len[i] = to_wire(&wire[i * 64], names[i].c_str());
+    }
+
+    t0 = now_ns();
+    for (i = 0; i < LOOKUPS; i++)
+        sink += t.match(names[i].c_str());
+    dotted = now_ns() - t0;
+
+    t0 = now_ns();
+    for (i = 0; i < LOOKUPS; i++)
+        sink += t.match_wire(&wire[i * 64], wire_len[i]);
+    on_wire = now_ns() - t0;
+
+    t0 = now_ns();
+    for (i = 0; i < LOOKUPS; i++)
+        sink += reference(set, names[i]);
+    in_set = now_ns() - t0;
+
+    for (i = 0; i < LOOKUPS; i++) {
+        bool r = reference(set, names[i]);
+
+        if (r)
+            hits++;
+        if (t.match(names[i].c_str()) != r
+            || t.match_wire(&wire[i * 64], wire_len[i]) != r)
+            mismatches++;
+    }
+
+    printf("%-28s %u domains in %llu ms\n", "built", t.size(),
+           (unsigned long long)(build / 1000000));
+    printf("%-28s %.0f ns per lookup\n", "match", (double)dotted / LOOKUPS);
+    printf("%-28s %.0f ns per lookup\n", "match_wire",
+           (double)on_wire / LOOKUPS);
+    printf("%-28s %.0f ns per lookup\n", "suffixes in a set",
+           (double)in_set / LOOKUPS);
+    printf("%-28s %u of %u matched, %u differ\n", "trie against the set",
+           hits, LOOKUPS, mismatches);
+    if (mismatches != 0 || hits < LOOKUPS / 2)
+        failures++;
+}
+
+int main(void)
+{
+    check_names();
+    check_wire();
+    benchmark();
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+# Matching of the split-DNS domain list, dotted and in wire format,
+# checked against a set of suffixes and timed over 100k domains; runs as
+# any user.
+
+QMAKE_CXXFLAGS += -O2 -g
+
+QT       += core
+QT       -= gui
+
+TARGET = domaintrie
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += domaintrie.cpp \
+    ../../domaintrie.cpp
+
+HEADERS += ../../domaintrie.h
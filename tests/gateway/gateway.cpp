@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mockgateway.h"
+#include "mainwindow.h"
+#include "vpninfo.h"
+#include "storage.h"
+#include "gtdb.h"
+#include <QApplication>
+#include <QSettings>
+#include <QStringList>
+#include <QThread>
+#include <string>
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <gnutls/gnutls.h>
+#include <openconnect.h>
+}
+
+/* Connects the client to the stand-in gateway through the code the GUI
+ * uses, in a network namespace of its own (as root, for the tun device):
+ * VpnInfo::connect() with its form and certificate callbacks, then
+ * dtls_connect() and the mainloop on a thread, as the worker runs them.
+ *
+ * - the login form is answered from the profile, its domain field from
+ *   the stored form answers, and the gateway's key is checked against
+ *   the one stored in it
+ * - packets are sent both ways through the tunnel, over DTLS
+ * - the gateway then ends the session and the client logs in again, as
+ *   the worker does, this time without DTLS
+ *
+ * It reports the connect and re-auth latency and the throughput of the
+ * tunnel over loopback.
+ */
+
+#define PROFILE "mock"
+#define USER "tester"
+#define PASSWORD "secret"
+#define DOMAIN "example"
+
+#define PACKET_SIZE GW_MTU
+#define SINK_PORT 9
+#define FLOOD_PORT 5001
+#define FLOOD_PACKETS 20000
+#define SEND_TIME 1000          /* ms of sending to the gateway */
+#define IDLE_TIME 1000          /* ms without packets that end a transfer */
+#define DTLS_WAIT 5000          /* ms for the DTLS handshake */
+#define END_WAIT 5000           /* ms for the mainloop to return */
+
+/* the application's main.cpp has this */
+void startup_mark(const char *phase)
+{
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* the session thread of the worker */
+class Session:public QThread {
+ public:
+    explicit Session(VpnInfo * vpn) {
+        this->vpn = vpn;
+        this->ret = 0;
+    }
+    int ret;
+
+ protected:
+    void run() {
+        ret = vpn->mainloop();
+    }
+
+ private:
+    VpnInfo * vpn;
+};
+
+/* receives what the gateway sends to the client */
+class Receiver:public QThread {
+ public:
+    explicit Receiver(int fd) {
+        this->fd = fd;
+        this->packets = 0;
+        this->bytes = 0;
+        this->first = 0;
+        this->last = 0;
+    }
+    unsigned packets;
+    uint64_t bytes;
+    uint64_t first;
+    uint64_t last;
+
+ protected:
+    void run() {
+        struct pollfd pfd;
+        char buf[2048];
+        ssize_t len;
+
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        while (poll(&pfd, 1, packets == 0 ? END_WAIT : IDLE_TIME) > 0) {
+            len = recv(fd, buf, sizeof(buf), 0);
+            if (len <= 0)
+                break;
+            last = now_ms();
+            if (packets++ == 0)
+                first = last;
+            bytes += len;
+        }
+    }
+
+ private:
+    int fd;
+};
+
+static void run(const char *cmd)
+{
+    if (system(cmd) != 0) {
+        fprintf(stderr, "failed: %s\n", cmd);
+        exit(1);
+    }
+}
+
+static void print_log(MainWindow * w)
+{
+    QStringList *log = w->get_log();
+    int i;
+
+    for (i = 0; i < log->size(); i++)
+        fprintf(stderr, "  %s\n", log->at(i).toLocal8Bit().data());
+}
+
+/* a profile for the gateway, with the answers to its forms and its key
+ * known already, so that no prompt is shown */
+static int make_profile(QSettings * settings, MockGateway * gw)
+{
+    StoredServer ss(settings);
+    gnutls_datum_t raw;
+    char server[64];
+    int ret;
+
+    snprintf(server, sizeof(server), "127.0.0.1:%u", gw->get_port());
+    ss.set_label(QLatin1String(PROFILE));
+    ss.set_servername(QLatin1String(server));
+    ss.set_username(QLatin1String(USER));
+    ss.set_password(QLatin1String(PASSWORD));
+    ss.set_batch_mode(true);
+    ss.set_form_answer(QLatin1String("main:domain"), QLatin1String(DOMAIN));
+    ss.set_native_config(true);
+    ss.set_net_monitor(false);
+    ss.set_dns_cache(false);
+    ss.set_split_dns(false);
+
+    gtdb tdb(&ss);
+    raw.data = const_cast < unsigned char *>(&gw->get_cert()[0]);
+    raw.size = gw->get_cert().size();
+    ret = gnutls_store_pubkey(reinterpret_cast < const char *>(&tdb),
+                              tdb.tdb, "", "", GNUTLS_CRT_X509, &raw, 0, 0);
+    if (ret < 0) {
+        fprintf(stderr, "storing the key: %s\n", gnutls_strerror(ret));
+        return -1;
+    }
+    ss.save();
+    return 0;
+}
+
+static void set_dtls(QSettings * settings, bool enabled)
+{
+    StoredServer ss(settings);
+    QString name = QLatin1String(PROFILE);
+
+    ss.load(name);
+    ss.set_disable_udp(enabled == false);
+    ss.save();
+}
+
+/* logs in and sets up the tunnel as the worker does; start is when the
+ * attempt began */
+static VpnInfo *connect_vpn(MainWindow * w, QSettings * settings,
+                            const char *what, uint64_t start)
+{
+    StoredServer *ss = new StoredServer(settings);
+    QString name = QLatin1String(PROFILE);
+    VpnInfo *vpn;
+
+    if (ss->load(name) < 0) {
+        fprintf(stderr, "%s: could not load the profile\n", what);
+        delete ss;
+        return NULL;
+    }
+
+    /* ss is now deallocated by vpn */
+    vpn = new VpnInfo(QLatin1String("openconnect-gui test"), ss, w);
+    vpn->parse_url(ss->get_servername().toLocal8Bit().data());
+    if (vpn->connect() != 0) {
+        fprintf(stderr, "%s: %s\n", what, vpn->last_err.toLocal8Bit().data());
+        delete vpn;
+        return NULL;
+    }
+    vpn->dtls_connect();
+
+    printf("%-28s %u ms (%s)\n", what, (unsigned)(now_ms() - start),
+           vpn->timing.summary().toLocal8Bit().data());
+    return vpn;
+}
+
+/* waits for the mainloop to return; false if it does not */
+static bool end_session(Session * s, VpnInfo * vpn, bool cancel)
+{
+    char cmd = OC_CMD_CANCEL;
+
+    if (cancel == true && write(vpn->get_cmd_fd(), &cmd, 1) != 1)
+        return false;
+    return s->wait(END_WAIT);
+}
+
+static bool wait_dtls(MockGateway * gw, unsigned handshakes)
+{
+    struct gw_stats st;
+    uint64_t start = now_ms();
+
+    while (now_ms() - start < DTLS_WAIT) {
+        gw->get_stats(&st);
+        if (st.dtls >= handshakes)
+            return true;
+        usleep(50 * 1000);
+    }
+    return false;
+}
+
+/* sends to the host behind the gateway for a while; returns the rate at
+ * which the packets arrived there, in kB/s */
+static unsigned send_through(MockGateway * gw, const char *what)
+{
+    struct sockaddr_in sa;
+    struct gw_stats before, after;
+    char buf[PACKET_SIZE];
+    uint64_t start;
+    unsigned sent = 0, rate = 0;
+    int fd;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(SINK_PORT);
+    inet_pton(AF_INET, GW_REMOTE_ADDR, &sa.sin_addr);
+    memset(buf, 0, sizeof(buf));
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    gw->get_stats(&before);
+    start = now_ms();
+    while (now_ms() - start < SEND_TIME) {
+        /* the IP and UDP headers make up the packet size */
+        if (sendto(fd, buf, PACKET_SIZE - 28, 0, (struct sockaddr *)&sa,
+                   sizeof(sa)) > 0)
+            sent++;
+        else if (errno != ENOBUFS)
+            break;
+    }
+    close(fd);
+    usleep(IDLE_TIME * 1000);
+    gw->get_stats(&after);
+
+    if (after.rx_last > start)
+        rate = (after.rx_bytes - before.rx_bytes) / (after.rx_last - start);
+    printf("%-28s %u kB/s, %u of %u packets\n", what, rate,
+           (unsigned)(after.rx_packets - before.rx_packets), sent);
+    return rate;
+}
+
+/* has the gateway send to the client; returns the rate at which the
+ * packets arrived, in kB/s */
+static unsigned receive_through(MockGateway * gw, const char *what)
+{
+    struct sockaddr_in sa;
+    int size = 4 * 1024 * 1024;
+    unsigned rate = 0;
+    int fd;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(FLOOD_PORT);
+    inet_pton(AF_INET, GW_CLIENT_ADDR, &sa.sin_addr);
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        perror("bind");
+        close(fd);
+        return 0;
+    }
+
+    Receiver r(fd);
+    r.start();
+    if (gw->flood(FLOOD_PACKETS, PACKET_SIZE, FLOOD_PORT) != 0)
+        fprintf(stderr, "%s: no tunnel to send on\n", what);
+    r.wait();
+    close(fd);
+
+    if (r.last > r.first)
+        rate = r.bytes / (r.last - r.first);
+    printf("%-28s %u kB/s, %u of %u packets\n", what, rate, r.packets,
+           FLOOD_PACKETS);
+    return rate;
+}
+
+int main(int argc, char *argv[])
+{
+    struct gw_stats st;
+    std::string err;
+    char dir[] = "/tmp/gateway-XXXXXX";
+    VpnInfo *vpn;
+    Session *session;
+    uint64_t start;
+    int ret = 0;
+
+    if (getuid() != 0 || access("/dev/net/tun", R_OK | W_OK) != 0
+        || unshare(CLONE_NEWNET) != 0) {
+        printf("skipped: needs root for a network namespace and tun\n");
+        return 0;
+    }
+    run("ip link set lo up");
+
+    /* no window system, and no proxy between the client and the gateway */
+    setenv("QT_QPA_PLATFORM", "offscreen", 0);
+    unsetenv("http_proxy");
+    unsetenv("https_proxy");
+    unsetenv("HTTP_PROXY");
+    unsetenv("HTTPS_PROXY");
+    unsetenv("all_proxy");
+
+    QApplication app(argc, argv);
+    gnutls_global_init();
+    openconnect_init_ssl();
+
+    MockGateway gw;
+    gw.set_login(USER, PASSWORD, DOMAIN);
+    gw.set_dtls(true);
+    if (gw.setup(err) != 0) {
+        fprintf(stderr, "setup: %s\n", err.c_str());
+        return 1;
+    }
+    gw.start();
+
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    QSettings settings(QLatin1String(dir) + QLatin1String("/profiles.ini"),
+                       QSettings::IniFormat);
+    if (make_profile(&settings, &gw) != 0)
+        return 1;
+
+    MainWindow w;
+
+    /* the first session: the form, the key, DTLS */
+    vpn = connect_vpn(&w, &settings, "connected", now_ms());
+    if (vpn == NULL) {
+        print_log(&w);
+        return 1;
+    }
+    session = new Session(vpn);
+    session->start();
+
+    if (wait_dtls(&gw, 1) == false) {
+        fprintf(stderr, "DTLS did not come up\n");
+        ret = 1;
+    }
+    if (send_through(&gw, "to the gateway, DTLS") == 0
+        || receive_through(&gw, "from the gateway, DTLS") == 0)
+        ret = 1;
+
+    /* the gateway ends it; the worker would log in again */
+    set_dtls(&settings, false);
+    start = now_ms();
+    if (gw.kick() != 0 || end_session(session, vpn, false) == false) {
+        fprintf(stderr, "the session did not end with the gateway's\n");
+        print_log(&w);
+        return 1;
+    }
+    delete session;
+    delete vpn;
+
+    vpn = connect_vpn(&w, &settings, "re-authenticated", start);
+    if (vpn == NULL) {
+        print_log(&w);
+        return 1;
+    }
+    session = new Session(vpn);
+    session->start();
+
+    if (send_through(&gw, "to the gateway, CSTP") == 0
+        || receive_through(&gw, "from the gateway, CSTP") == 0)
+        ret = 1;
+
+    if (end_session(session, vpn, true) == false) {
+        fprintf(stderr, "the session did not end on cancel\n");
+        print_log(&w);
+        return 1;
+    }
+    delete session;
+    delete vpn;
+
+    gw.get_stats(&st);
+    if (st.logins != 2 || st.refused != 0 || st.tunnels != 2 || st.dtls != 1) {
+        fprintf(stderr, "gateway: %u logins, %u refused, %u tunnels, "
+                "%u DTLS sessions\n", st.logins, st.refused, st.tunnels,
+                st.dtls);
+        ret = 1;
+    }
+    if (ret != 0)
+        print_log(&w);
+
+    gw.stop();
+    QFile::remove(settings.fileName());
+    rmdir(dir);
+    return ret;
+}
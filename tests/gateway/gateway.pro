@@ -0,0 +1,96 @@
+# The client's connect path, as the GUI runs it, against a stand-in
+# AnyConnect gateway on loopback in a network namespace of its own;
+# needs root and a tun device, and is skipped without.
+
+QMAKE_CXXFLAGS += -O2 -g
+
+QT       += core gui network
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = gateway
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += gateway.cpp \
+    mockgateway.cpp \
+    ../../mainwindow.cpp \
+    ../../vpninfo.cpp \
+    ../../storage.cpp \
+    ../../editdialog.cpp \
+    ../../keypair.cpp \
+    ../../key.cpp \
+    ../../cert.cpp \
+    ../../logdialog.cpp \
+    ../../gtdb.cpp \
+    ../../cryptdata.cpp \
+    ../../singleinstance.cpp \
+    ../../vpnworker.cpp \
+    ../../flowtable.cpp \
+    ../../tunpump.cpp \
+    ../../vpncscript.cpp \
+    ../../routetable.cpp \
+    ../../packetring.cpp \
+    ../../mtuprobe.cpp \
+    ../../dpdtuner.cpp \
+    ../../linkstats.cpp \
+    ../../transportlog.cpp \
+    ../../dnsproxy.cpp \
+    ../../domaintrie.cpp \
+    ../../phasetimer.cpp \
+    ../../scriptlog.cpp \
+    ../../netconfig.cpp \
+    ../../proxycache.cpp \
+    ../../netmonitor.cpp \
+    ../../backoff.cpp \
+    ../../tokenjournal.cpp \
+    ../../systemkeys.cpp \
+    ../../pincache.cpp
+
+HEADERS += mockgateway.h \
+    ../../mainwindow.h \
+    ../../vpninfo.h \
+    ../../storage.h \
+    ../../editdialog.h \
+    ../../common.h \
+    ../../keypair.h \
+    ../../key.h \
+    ../../cert.h \
+    ../../logdialog.h \
+    ../../gtdb.h \
+    ../../dialogs.h \
+    ../../cryptdata.h \
+    ../../singleinstance.h \
+    ../../vpnworker.h \
+    ../../flowtable.h \
+    ../../tunpump.h \
+    ../../vpncscript.h \
+    ../../routetable.h \
+    ../../packetring.h \
+    ../../mtuprobe.h \
+    ../../dpdtuner.h \
+    ../../linkstats.h \
+    ../../transportlog.h \
+    ../../dnsproxy.h \
+    ../../domaintrie.h \
+    ../../phasetimer.h \
+    ../../scriptlog.h \
+    ../../netconfig.h \
+    ../../proxycache.h \
+    ../../netmonitor.h \
+    ../../backoff.h \
+    ../../tokenjournal.h \
+    ../../systemkeys.h \
+    ../../pincache.h
+
+FORMS += ../../mainwindow.ui \
+    ../../editdialog.ui \
+    ../../logdialog.ui
+
+RESOURCES += ../../resources.qrc
+
+unix: LIBS += -L/usr/local/lib
+LIBS += -lopenconnect -lgnutls
@@ -0,0 +1,890 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mockgateway.h"
+
+extern "C" {
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <time.h>
+#include <gnutls/x509.h>
+#include <gnutls/crypto.h>
+#include <gnutls/dtls.h>
+}
+
+/* CSTP framing and the packet types of both transports */
+#define CSTP_HDR 8
+#define AC_PKT_DATA 0
+#define AC_PKT_DPD_OUT 3
+#define AC_PKT_DPD_RESP 4
+#define AC_PKT_DISCONN 5
+#define AC_PKT_KEEPALIVE 7
+#define AC_PKT_COMPRESSED 8
+#define AC_PKT_TERM_SERVER 9
+
+/* what openconnect offers as AES128-SHA; the session is resumed from
+ * the master secret the client sent with CONNECT */
+#define DTLS_PRIORITY "NONE:+VERS-DTLS0.9:+COMP-NULL:+AES-128-CBC:+SHA1:+RSA:%COMPAT"
+#define DTLS_CIPHER "AES128-SHA"
+#define DTLS_MASTER_LEN 48
+
+#define IO_TIMEOUT 5            /* seconds, for a client that stalls */
+#define HTTP_MAX (64*1024)
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static std::string hex(const uint8_t * data, size_t len)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    std::string s;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        s += digits[data[i] >> 4];
+        s += digits[data[i] & 0xf];
+    }
+    return s;
+}
+
+static bool unhex(const std::string & s, std::vector < uint8_t > &out)
+{
+    unsigned v;
+    size_t i;
+
+    out.clear();
+    if (s.size() % 2 != 0)
+        return false;
+    for (i = 0; i < s.size(); i += 2) {
+        if (sscanf(s.c_str() + i, "%2x", &v) != 1)
+            return false;
+        out.push_back(v);
+    }
+    return true;
+}
+
+/* the value of a request header, or empty */
+static std::string header(const std::string & head, const char *name)
+{
+    size_t pos = 0, end, colon;
+
+    while ((end = head.find("\r\n", pos)) != std::string::npos) {
+        colon = head.find(':', pos);
+        if (colon != std::string::npos && colon < end
+            && colon - pos == strlen(name)
+            && strncasecmp(head.c_str() + pos, name, colon - pos) == 0) {
+            colon++;
+            while (colon < end && head[colon] == ' ')
+                colon++;
+            return head.substr(colon, end - colon);
+        }
+        pos = end + 2;
+    }
+    return std::string();
+}
+
+/* the text of the first <name> element, or empty */
+static std::string xml_text(const std::string & xml, const char *name)
+{
+    std::string open = std::string("<") + name + ">";
+    std::string close = std::string("</") + name + ">";
+    size_t start, end;
+
+    start = xml.find(open);
+    if (start == std::string::npos)
+        return std::string();
+    start += open.size();
+    end = xml.find(close, start);
+    if (end == std::string::npos)
+        return std::string();
+    return xml.substr(start, end - start);
+}
+
+static uint16_t ip_checksum(const uint8_t * hdr, size_t len)
+{
+    uint32_t sum = 0;
+    size_t i;
+
+    for (i = 0; i < len; i += 2)
+        sum += (hdr[i] << 8) | hdr[i + 1];
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum;
+}
+
+MockGateway::MockGateway()
+{
+    this->use_dtls = false;
+    this->cred = NULL;
+    this->port = 0;
+    this->listen_fd = -1;
+    this->udp_fd = -1;
+    this->cmd_pipe[0] = this->cmd_pipe[1] = -1;
+    this->reply_pipe[0] = this->reply_pipe[1] = -1;
+    this->tunnel = NULL;
+    this->dtls = NULL;
+    this->dtls_up = false;
+    this->dtls_peer_len = 0;
+    this->flood_count = 0;
+    this->flood_size = 0;
+    this->flood_port = 0;
+    memset(&this->stats, 0, sizeof(this->stats));
+}
+
+MockGateway::~MockGateway()
+{
+    while (conns.empty() == false)
+        close_conn(conns.size() - 1);
+    dtls_reset();
+    if (listen_fd != -1)
+        close(listen_fd);
+    if (udp_fd != -1)
+        close(udp_fd);
+    if (cmd_pipe[0] != -1) {
+        close(cmd_pipe[0]);
+        close(cmd_pipe[1]);
+    }
+    if (reply_pipe[0] != -1) {
+        close(reply_pipe[0]);
+        close(reply_pipe[1]);
+    }
+    if (cred != NULL)
+        gnutls_certificate_free_credentials(cred);
+}
+
+void MockGateway::set_login(const char *user, const char *password,
+                            const char *domain)
+{
+    this->user = user;
+    this->password = password;
+    this->domain = domain ? domain : "";
+}
+
+/* a self-signed certificate for 127.0.0.1, with a new key */
+static int make_cert(gnutls_certificate_credentials_t * cred,
+                     std::vector < uint8_t > &der, std::string & err)
+{
+    gnutls_x509_privkey_t key = NULL;
+    gnutls_x509_crt_t crt = NULL;
+    gnutls_datum_t out = { NULL, 0 };
+    unsigned char serial[8];
+    time_t now = time(NULL);
+    int ret;
+
+    if ((ret = gnutls_x509_privkey_init(&key)) < 0
+        || (ret = gnutls_x509_privkey_generate(key, GNUTLS_PK_RSA, 2048, 0)) < 0
+        || (ret = gnutls_x509_crt_init(&crt)) < 0
+        || (ret = gnutls_rnd(GNUTLS_RND_NONCE, serial, sizeof(serial))) < 0)
+        goto fail;
+
+    serial[0] &= 0x7f;
+    if ((ret = gnutls_x509_crt_set_version(crt, 3)) < 0
+        || (ret = gnutls_x509_crt_set_serial(crt, serial, sizeof(serial))) < 0
+        || (ret = gnutls_x509_crt_set_activation_time(crt, now - 3600)) < 0
+        || (ret = gnutls_x509_crt_set_expiration_time(crt, now + 86400)) < 0
+        || (ret = gnutls_x509_crt_set_dn_by_oid(crt, GNUTLS_OID_X520_COMMON_NAME,
+                                                0, "127.0.0.1", 9)) < 0
+        || (ret = gnutls_x509_crt_set_key(crt, key)) < 0
+        || (ret = gnutls_x509_crt_set_key_usage(crt,
+                                                GNUTLS_KEY_DIGITAL_SIGNATURE |
+                                                GNUTLS_KEY_KEY_ENCIPHERMENT)) <
+        0 || (ret = gnutls_x509_crt_sign2(crt, crt, key, GNUTLS_DIG_SHA256,
+                                          0)) < 0
+        || (ret = gnutls_x509_crt_export2(crt, GNUTLS_X509_FMT_DER, &out)) < 0
+        || (ret = gnutls_certificate_allocate_credentials(cred)) < 0
+        || (ret = gnutls_certificate_set_x509_key(*cred, &crt, 1, key)) < 0)
+        goto fail;
+
+    der.assign(out.data, out.data + out.size);
+    gnutls_free(out.data);
+    gnutls_x509_crt_deinit(crt);
+    gnutls_x509_privkey_deinit(key);
+    return 0;
+
+ fail:
+    err = std::string("certificate: ") + gnutls_strerror(ret);
+    gnutls_free(out.data);
+    if (crt != NULL)
+        gnutls_x509_crt_deinit(crt);
+    if (key != NULL)
+        gnutls_x509_privkey_deinit(key);
+    return -1;
+}
+
+int MockGateway::setup(std::string & err)
+{
+    struct sockaddr_in sa;
+    socklen_t len = sizeof(sa);
+    int one = 1;
+
+    if (make_cert(&cred, cert_der, err) != 0)
+        return -1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0
+        || setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one,
+                      sizeof(one)) < 0
+        || bind(listen_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0
+        || listen(listen_fd, 8) < 0
+        || getsockname(listen_fd, (struct sockaddr *)&sa, &len) < 0) {
+        err = std::string("listen: ") + strerror(errno);
+        return -1;
+    }
+    port = ntohs(sa.sin_port);
+
+    /* DTLS on the same port, as the real ones do */
+    udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (udp_fd < 0 || bind(udp_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        err = std::string("UDP: ") + strerror(errno);
+        return -1;
+    }
+
+    if (pipe(cmd_pipe) < 0 || pipe(reply_pipe) < 0) {
+        err = std::string("pipe: ") + strerror(errno);
+        return -1;
+    }
+    return 0;
+}
+
+void MockGateway::get_stats(struct gw_stats *s)
+{
+    QMutexLocker locker(&mutex);
+    *s = stats;
+}
+
+/* hands a request to the gateway thread and waits for its result */
+int MockGateway::command(char c)
+{
+    char r;
+
+    if (write(cmd_pipe[1], &c, 1) != 1 || read(reply_pipe[0], &r, 1) != 1)
+        return -1;
+    return r == 0 ? 0 : -1;
+}
+
+int MockGateway::flood(unsigned count, unsigned size, uint16_t port)
+{
+    QMutexLocker locker(&cmd_mutex);
+
+    flood_count = count;
+    flood_size = size;
+    flood_port = port;
+    return command('f');
+}
+
+int MockGateway::kick()
+{
+    QMutexLocker locker(&cmd_mutex);
+    return command('k');
+}
+
+void MockGateway::stop()
+{
+    QMutexLocker locker(&cmd_mutex);
+
+    if (command('q') == 0)
+        wait();
+}
+
+void MockGateway::run()
+{
+    std::vector < struct pollfd >pfd;
+    struct pollfd p;
+    bool pending;
+    size_t i;
+    char c, r;
+
+    while (1) {
+        pfd.clear();
+        p.events = POLLIN;
+        p.revents = 0;
+        p.fd = cmd_pipe[0];
+        pfd.push_back(p);
+        p.fd = listen_fd;
+        pfd.push_back(p);
+        p.fd = udp_fd;
+        pfd.push_back(p);
+
+        pending = false;
+        for (i = 0; i < conns.size(); i++) {
+            p.fd = conns[i]->fd;
+            pfd.push_back(p);
+            if (gnutls_record_check_pending(conns[i]->tls) > 0)
+                pending = true;
+        }
+
+        if (poll(&pfd[0], pfd.size(), pending ? 0 : -1) < 0
+            && errno != EINTR)
+            return;
+
+        for (i = 0; i < conns.size(); i++) {
+            if (conns[i]->closing == false
+                && (pfd[i + 3].revents
+                    || gnutls_record_check_pending(conns[i]->tls) > 0)
+                && conn_read(conns[i]) == false)
+                conns[i]->closing = true;
+        }
+        close_marked();
+
+        if (pfd[1].revents & POLLIN)
+            accept_conn();
+        if (pfd[2].revents & POLLIN)
+            dtls_datagram();
+
+        if (pfd[0].revents & POLLIN) {
+            if (read(cmd_pipe[0], &c, 1) != 1)
+                return;
+            r = 0;
+            if (c == 'f') {
+                if (tunnel == NULL)
+                    r = 1;
+                else
+                    do_flood();
+            } else if (c == 'k') {
+                if (tunnel == NULL) {
+                    r = 1;
+                } else {
+                    send_cstp(AC_PKT_TERM_SERVER, NULL, 0);
+                    cookie.clear();
+                    tunnel->closing = true;
+                    close_marked();
+                }
+            }
+            if (write(reply_pipe[1], &r, 1) != 1 || c == 'q')
+                return;
+        }
+    }
+}
+
+void MockGateway::accept_conn()
+{
+    struct timeval tv = { IO_TIMEOUT, 0 };
+    conn *c;
+    int fd, ret;
+
+    fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0)
+        return;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    c = new conn;
+    c->fd = fd;
+    c->stage = 0;
+    c->tunnel = false;
+    c->closing = false;
+    gnutls_init(&c->tls, GNUTLS_SERVER);
+    gnutls_priority_set_direct(c->tls, "NORMAL:%COMPAT", NULL);
+    gnutls_credentials_set(c->tls, GNUTLS_CRD_CERTIFICATE, cred);
+    gnutls_transport_set_int(c->tls, fd);
+    gnutls_handshake_set_timeout(c->tls, IO_TIMEOUT * 1000);
+
+    do {
+        ret = gnutls_handshake(c->tls);
+    } while (ret < 0 && gnutls_error_is_fatal(ret) == 0);
+    if (ret < 0) {
+        gnutls_deinit(c->tls);
+        close(fd);
+        delete c;
+        return;
+    }
+    conns.push_back(c);
+}
+
+void MockGateway::close_conn(size_t i)
+{
+    conn *c = conns[i];
+
+    if (c == tunnel) {
+        tunnel = NULL;
+        dtls_reset();
+    }
+    gnutls_deinit(c->tls);
+    close(c->fd);
+    delete c;
+    conns.erase(conns.begin() + i);
+}
+
+void MockGateway::close_marked()
+{
+    size_t i;
+
+    for (i = conns.size(); i > 0; i--) {
+        if (conns[i - 1]->closing == true)
+            close_conn(i - 1);
+    }
+}
+
+/* returns false when the connection is to be closed */
+bool MockGateway::conn_read(conn * c)
+{
+    char buf[16384];
+    std::string head, body;
+    size_t end;
+    ssize_t n;
+    int len;
+
+    n = gnutls_record_recv(c->tls, buf, sizeof(buf));
+    if (n == GNUTLS_E_AGAIN || n == GNUTLS_E_INTERRUPTED)
+        return true;
+    if (n <= 0)
+        return false;
+    c->in.append(buf, n);
+
+    while (c->tunnel == false) {
+        end = c->in.find("\r\n\r\n");
+        if (end == std::string::npos)
+            return c->in.size() < HTTP_MAX;
+        head = c->in.substr(0, end + 2);
+        len = atoi(header(head, "Content-Length").c_str());
+        if (len < 0 || len > HTTP_MAX)
+            return false;
+        if (c->in.size() < end + 4 + len)
+            return true;
+        body = c->in.substr(end + 4, len);
+        c->in.erase(0, end + 4 + len);
+        if (http_request(c, head, body) == false)
+            return false;
+    }
+    return tunnel_frames(c);
+}
+
+static bool send_all(gnutls_session_t s, const std::string & data)
+{
+    size_t off = 0;
+    ssize_t n;
+
+    while (off < data.size()) {
+        n = gnutls_record_send(s, data.data() + off, data.size() - off);
+        if (n == GNUTLS_E_AGAIN || n == GNUTLS_E_INTERRUPTED)
+            continue;
+        if (n < 0)
+            return false;
+        off += n;
+    }
+    return true;
+}
+
+static std::string response(const char *status, const std::string & headers,
+                            const std::string & body)
+{
+    char len[32];
+
+    snprintf(len, sizeof(len), "%u", (unsigned)body.size());
+    return std::string("HTTP/1.1 ") + status + "\r\n" +
+        "Connection: Keep-Alive\r\n" + headers +
+        "Content-Length: " + len + "\r\n\r\n" + body;
+}
+
+#define XML_HEAD "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+#define XML_TYPE "Content-Type: text/xml\r\nX-Transcend-Version: 1\r\n"
+
+/* the login form, with the domain field when one is asked for; error is
+ * shown above it */
+static std::string form(bool domain, const char *error)
+{
+    std::string s = XML_HEAD
+        "<config-auth client=\"vpn\" type=\"auth-request\">\n"
+        "<version who=\"sg\">0.1(1)</version>\n"
+        "<auth id=\"main\">\n"
+        "<message>Please enter your username and password.</message>\n";
+
+    if (error != NULL)
+        s += std::string("<error id=\"main\" param1=\"\" param2=\"\">")
+            + error + "</error>\n";
+    s += "<form method=\"post\" action=\"/auth\">\n"
+        "<input type=\"text\" name=\"username\" label=\"Username:\" />\n"
+        "<input type=\"password\" name=\"password\" label=\"Password:\" />\n";
+    if (domain == true)
+        s += "<input type=\"text\" name=\"domain\" label=\"Domain:\" />\n";
+    s += "</form></auth>\n</config-auth>\n";
+    return s;
+}
+
+bool MockGateway::http_request(conn * c, const std::string & head,
+                               const std::string & body)
+{
+    if (head.compare(0, 8, "CONNECT ") == 0)
+        return start_tunnel(c, head);
+
+    if (head.compare(0, 5, "POST ") != 0)
+        return send_all(c->tls, response("404 Not Found", "", ""));
+
+    if (body.find("type=\"auth-reply\"") == std::string::npos
+        || c->stage == 0) {
+        c->stage = 1;
+        return send_all(c->tls, response("200 OK", XML_TYPE,
+                                         form(domain.empty() == false, NULL)));
+    }
+
+    login(c, body);
+    return true;
+}
+
+/* checks the answers to the form last sent */
+void MockGateway::login(conn * c, const std::string & body)
+{
+    uint8_t token[16];
+    bool ok;
+
+    ok = (xml_text(body, "username") == user
+          && xml_text(body, "password") == password
+          && (domain.empty() == true || xml_text(body, "domain") == domain));
+
+    if (ok == false) {
+        {
+            QMutexLocker locker(&mutex);
+            stats.refused++;
+        }
+        send_all(c->tls, response("200 OK", XML_TYPE,
+                                  form(domain.empty() == false,
+                                       "Login failed.")));
+        return;
+    }
+
+    c->stage = 0;
+    gnutls_rnd(GNUTLS_RND_NONCE, token, sizeof(token));
+    cookie = hex(token, sizeof(token));
+    {
+        QMutexLocker locker(&mutex);
+        stats.logins++;
+    }
+    send_all(c->tls, response("200 OK", std::string(XML_TYPE) +
+                              "Set-Cookie: webvpn=" + cookie + "; Secure\r\n",
+                              XML_HEAD
+                              "<config-auth client=\"vpn\" type=\"complete\">\n"
+                              "<version who=\"sg\">0.1(1)</version>\n"
+                              "<auth id=\"success\">\n"
+                              "<title>SSL VPN Service</title></auth>\n"
+                              "</config-auth>\n"));
+}
+
+bool MockGateway::start_tunnel(conn * c, const std::string & head)
+{
+    std::string h, cookies = header(head, "Cookie");
+    char buf[64];
+
+    if (cookie.empty() == true
+        || cookies.find("webvpn=" + cookie) == std::string::npos)
+        return send_all(c->tls, response("401 Unauthorized", "", ""));
+
+    /* one tunnel at a time; the old one goes once this is handled */
+    if (tunnel != NULL) {
+        tunnel->closing = true;
+        tunnel = NULL;
+        dtls_reset();
+    }
+
+    h = "HTTP/1.1 200 CONNECTED\r\n"
+        "X-CSTP-Version: 1\r\n"
+        "X-CSTP-Server-Name: mockgateway\r\n"
+        "X-CSTP-Address: " GW_CLIENT_ADDR "\r\n"
+        "X-CSTP-Netmask: " GW_NETMASK "\r\n"
+        "X-CSTP-Split-Include: " GW_SPLIT "\r\n";
+    snprintf(buf, sizeof(buf), "X-CSTP-MTU: %u\r\n", GW_MTU);
+    h += buf;
+    snprintf(buf, sizeof(buf), "X-CSTP-Base-MTU: %u\r\n", GW_MTU);
+    h += buf;
+    snprintf(buf, sizeof(buf), "X-CSTP-DPD: %u\r\n", GW_DPD);
+    h += buf;
+    h += "X-CSTP-Keepalive: 20\r\n";
+
+    c->master.clear();
+    if (use_dtls == true
+        && unhex(header(head, "X-DTLS-Master-Secret"), c->master) == true
+        && c->master.size() == DTLS_MASTER_LEN) {
+        gnutls_rnd(GNUTLS_RND_NONCE, dtls_id, sizeof(dtls_id));
+        h += "X-DTLS-Session-ID: " + hex(dtls_id, sizeof(dtls_id)) + "\r\n";
+        snprintf(buf, sizeof(buf), "X-DTLS-Port: %u\r\n", port);
+        h += buf;
+        snprintf(buf, sizeof(buf), "X-DTLS-DPD: %u\r\n", GW_DPD);
+        h += buf;
+        h += "X-DTLS-Keepalive: 20\r\n"
+            "X-DTLS-CipherSuite: " DTLS_CIPHER "\r\n";
+    } else {
+        c->master.clear();
+    }
+    h += "\r\n";
+
+    if (send_all(c->tls, h) == false)
+        return false;
+
+    c->tunnel = true;
+    tunnel = c;
+    QMutexLocker locker(&mutex);
+    stats.tunnels++;
+    return true;
+}
+
+/* handles the complete frames received; false on a disconnect */
+bool MockGateway::tunnel_frames(conn * c)
+{
+    const uint8_t *p;
+    unsigned len;
+
+    while (c->in.size() >= CSTP_HDR) {
+        p = reinterpret_cast < const uint8_t * >(c->in.data());
+        if (p[0] != 'S' || p[1] != 'T' || p[2] != 'F' || p[3] != 1)
+            return false;
+        len = (p[4] << 8) | p[5];
+        if (c->in.size() < CSTP_HDR + len)
+            break;
+
+        switch (p[6]) {
+        case AC_PKT_DATA:
+        case AC_PKT_COMPRESSED:
+            received(p + CSTP_HDR, len);
+            break;
+        case AC_PKT_DPD_OUT:
+            send_cstp(AC_PKT_DPD_RESP, NULL, 0);
+            break;
+        case AC_PKT_DISCONN:
+            return false;
+        default:
+            break;
+        }
+        c->in.erase(0, CSTP_HDR + len);
+    }
+    return true;
+}
+
+void MockGateway::received(const uint8_t * pkt, size_t len)
+{
+    QMutexLocker locker(&mutex);
+    uint64_t now = now_ms();
+
+    if (stats.rx_packets == 0)
+        stats.rx_first = now;
+    stats.rx_last = now;
+    stats.rx_packets++;
+    stats.rx_bytes += len;
+}
+
+/* to the tunnel's client, over DTLS when it is up */
+int MockGateway::send_packet(uint8_t type, const uint8_t * data, size_t len)
+{
+    if (tunnel == NULL)
+        return -1;
+    if (dtls_up == true)
+        return send_dtls(type, data, len);
+    return send_cstp(type, data, len);
+}
+
+int MockGateway::send_cstp(uint8_t type, const uint8_t * data, size_t len)
+{
+    uint8_t hdr[CSTP_HDR];
+    std::string frame;
+
+    if (tunnel == NULL || len > 65535)
+        return -1;
+
+    hdr[0] = 'S';
+    hdr[1] = 'T';
+    hdr[2] = 'F';
+    hdr[3] = 1;
+    hdr[4] = len >> 8;
+    hdr[5] = len & 0xff;
+    hdr[6] = type;
+    hdr[7] = 0;
+    frame.assign((char *)hdr, CSTP_HDR);
+    if (len > 0)
+        frame.append((const char *)data, len);
+    return send_all(tunnel->tls, frame) ? 0 : -1;
+}
+
+int MockGateway::send_dtls(uint8_t type, const uint8_t * data, size_t len)
+{
+    std::vector < uint8_t > rec(len + 1);
+    ssize_t ret;
+
+    if (dtls_up == false)
+        return -1;
+
+    rec[0] = type;
+    if (len > 0)
+        memcpy(&rec[1], data, len);
+    do {
+        ret = gnutls_record_send(dtls, &rec[0], rec.size());
+    } while (ret == GNUTLS_E_AGAIN || ret == GNUTLS_E_INTERRUPTED);
+    return ret < 0 ? -1 : 0;
+}
+
+/* IPv4/UDP packets from the remote host to the client */
+void MockGateway::do_flood()
+{
+    uint8_t pkt[65536];
+    unsigned i, size = flood_size;
+
+    if (size < 28 || size > sizeof(pkt))
+        return;
+
+    memset(pkt, 0, size);
+    pkt[0] = 0x45;
+    pkt[2] = size >> 8;
+    pkt[3] = size & 0xff;
+    pkt[6] = 0x40;              /* don't fragment */
+    pkt[8] = 64;
+    pkt[9] = IPPROTO_UDP;
+    inet_pton(AF_INET, GW_REMOTE_ADDR, pkt + 12);
+    inet_pton(AF_INET, GW_CLIENT_ADDR, pkt + 16);
+    pkt[10] = ip_checksum(pkt, 20) >> 8;
+    pkt[11] = ip_checksum(pkt, 20) & 0xff;
+    pkt[20] = 9 >> 8;
+    pkt[21] = 9 & 0xff;
+    pkt[22] = flood_port >> 8;
+    pkt[23] = flood_port & 0xff;
+    pkt[24] = (size - 20) >> 8;
+    pkt[25] = (size - 20) & 0xff;
+
+    for (i = 0; i < flood_count; i++) {
+        if (send_packet(AC_PKT_DATA, pkt, size) != 0)
+            return;
+    }
+}
+
+void MockGateway::dtls_reset()
+{
+    if (dtls != NULL)
+        gnutls_deinit(dtls);
+    dtls = NULL;
+    dtls_up = false;
+    dtls_peer_len = 0;
+}
+
+/* A datagram on the DTLS port. A ClientHello from a new address starts
+ * a session, resumed from the master secret of the tunnel; there is no
+ * full handshake.
+ */
+void MockGateway::dtls_datagram()
+{
+    uint8_t buf[65536];
+    struct sockaddr_storage from;
+    socklen_t from_len = sizeof(from);
+    gnutls_datum_t master, id;
+    ssize_t n;
+
+    n = recvfrom(udp_fd, buf, sizeof(buf), 0, (struct sockaddr *)&from,
+                 &from_len);
+    if (n <= 0 || tunnel == NULL || tunnel->master.empty() == true)
+        return;
+
+    if (dtls == NULL || from_len != dtls_peer_len
+        || memcmp(&from, &dtls_peer, from_len) != 0) {
+        /* a handshake record */
+        if (buf[0] != 22)
+            return;
+        dtls_reset();
+        memcpy(&dtls_peer, &from, from_len);
+        dtls_peer_len = from_len;
+
+        master.data = &tunnel->master[0];
+        master.size = tunnel->master.size();
+        id.data = dtls_id;
+        id.size = sizeof(dtls_id);
+        if (gnutls_init(&dtls, GNUTLS_SERVER | GNUTLS_DATAGRAM |
+                        GNUTLS_NONBLOCK) < 0) {
+            dtls = NULL;
+            return;
+        }
+        if (gnutls_priority_set_direct(dtls, DTLS_PRIORITY, NULL) < 0
+            || gnutls_session_set_premaster(dtls, GNUTLS_SERVER,
+                                            GNUTLS_DTLS0_9, GNUTLS_KX_RSA,
+                                            GNUTLS_CIPHER_AES_128_CBC,
+                                            GNUTLS_MAC_SHA1, GNUTLS_COMP_NULL,
+                                            &master, &id) < 0) {
+            dtls_reset();
+            return;
+        }
+        gnutls_transport_set_ptr(dtls, this);
+        gnutls_transport_set_push_function(dtls, dtls_push);
+        gnutls_transport_set_pull_function(dtls, dtls_pull);
+        gnutls_transport_set_pull_timeout_function(dtls, dtls_pull_timeout);
+        gnutls_dtls_set_mtu(dtls, GW_MTU + 100);
+    }
+
+    dgram.assign(buf, buf + n);
+    if (dtls_up == false) {
+        n = gnutls_handshake(dtls);
+        if (n == 0) {
+            dtls_up = true;
+            QMutexLocker locker(&mutex);
+            stats.dtls++;
+        } else if (gnutls_error_is_fatal(n) != 0) {
+            dtls_reset();
+        }
+        return;
+    }
+
+    while ((n = gnutls_record_recv(dtls, buf, sizeof(buf))) > 0) {
+        if (buf[0] == AC_PKT_DATA || buf[0] == AC_PKT_COMPRESSED)
+            received(buf + 1, n - 1);
+        else if (buf[0] == AC_PKT_DPD_OUT)
+            send_dtls(AC_PKT_DPD_RESP, NULL, 0);
+    }
+    if (n < 0 && gnutls_error_is_fatal(n) != 0)
+        dtls_reset();
+}
+
+ssize_t MockGateway::dtls_push(gnutls_transport_ptr_t p, const void *data,
+                               size_t len)
+{
+    MockGateway *gw = static_cast < MockGateway * >(p);
+
+    return sendto(gw->udp_fd, data, len, 0,
+                  (struct sockaddr *)&gw->dtls_peer, gw->dtls_peer_len);
+}
+
+/* gnutls reads the datagram received, once */
+ssize_t MockGateway::dtls_pull(gnutls_transport_ptr_t p, void *data,
+                               size_t len)
+{
+    MockGateway *gw = static_cast < MockGateway * >(p);
+
+    if (gw->dgram.empty() == true) {
+        gnutls_transport_set_errno(gw->dtls, EAGAIN);
+        return -1;
+    }
+    if (len > gw->dgram.size())
+        len = gw->dgram.size();
+    memcpy(data, &gw->dgram[0], len);
+    gw->dgram.clear();
+    return len;
+}
+
+int MockGateway::dtls_pull_timeout(gnutls_transport_ptr_t p, unsigned ms)
+{
+    MockGateway *gw = static_cast < MockGateway * >(p);
+
+    return gw->dgram.empty() ? 0 : 1;
+}
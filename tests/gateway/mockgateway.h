@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MOCKGATEWAY_H
+#define MOCKGATEWAY_H
+
+#include <QThread>
+#include <QMutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <gnutls/gnutls.h>
+}
+
+/* the tunnel: the client's address, and the host behind the gateway
+ * that the client's packets go to */
+#define GW_CLIENT_ADDR "10.10.0.2"
+#define GW_REMOTE_ADDR "10.10.0.1"
+#define GW_NETMASK "255.255.255.0"
+#define GW_SPLIT "10.10.0.0/255.255.255.0"
+#define GW_MTU 1400
+#define GW_DPD 30                /* seconds */
+
+struct gw_stats {
+    unsigned logins;            /* cookies handed out */
+    unsigned refused;           /* wrong answers to a form */
+    unsigned tunnels;           /* CSTP channels set up */
+    unsigned dtls;              /* DTLS handshakes completed */
+    uint64_t rx_packets;        /* of the client, over either transport */
+    uint64_t rx_bytes;
+    uint64_t rx_first;          /* ms, when the first and the last of */
+    uint64_t rx_last;           /* them arrived */
+};
+
+/* A stand-in AnyConnect gateway on 127.0.0.1, for driving the client
+ * without a server. It has a self-signed certificate made at setup, a
+ * login over XML POST with a form asking for the username, password and
+ * optionally a domain, and serves a CSTP tunnel with legacy
+ * DTLS on the same port when enabled.
+ *
+ * One tunnel is served at a time; a new one replaces it. The client's
+ * packets are counted and dropped, and packets to the client are sent
+ * on request. One thread does all the TLS; requests of other threads
+ * are carried out by it.
+ */
+class MockGateway:public QThread {
+ public:
+    MockGateway();
+    ~MockGateway();
+
+    /* the form asks for a domain too unless it is NULL */
+    void set_login(const char *user, const char *password,
+                   const char *domain);
+    void set_dtls(bool d) {
+        use_dtls = d;
+    }
+    /* makes the certificate and listens; returns zero on success */
+    int setup(std::string & err);
+    void stop();
+
+    unsigned get_port() {
+        return port;
+    }
+    /* the certificate, DER encoded */
+    const std::vector < uint8_t > &get_cert() {
+        return cert_der;
+    }
+    void get_stats(struct gw_stats *s);
+
+    /* sends the client count UDP packets of size bytes to port, over
+     * DTLS if it is up; returns once they are sent, or -1 without a
+     * tunnel */
+    int flood(unsigned count, unsigned size, uint16_t port);
+    /* ends the tunnel as a server does, and forgets the cookie */
+    int kick();
+
+ protected:
+    void run();
+
+ private:
+    struct conn {
+        int fd;
+        gnutls_session_t tls;
+        std::string in;         /* received, not yet handled */
+        int stage;              /* of the login */
+        bool tunnel;
+        bool closing;
+        std::vector < uint8_t > master;     /* of the client, for DTLS */
+    };
+
+    int command(char c);
+    void do_flood();
+    void accept_conn();
+    bool conn_read(conn * c);
+    bool http_request(conn * c, const std::string & head,
+                      const std::string & body);
+    void login(conn * c, const std::string & body);
+    bool start_tunnel(conn * c, const std::string & head);
+    bool tunnel_frames(conn * c);
+    void received(const uint8_t * pkt, size_t len);
+    int send_packet(uint8_t type, const uint8_t * data, size_t len);
+    int send_cstp(uint8_t type, const uint8_t * data, size_t len);
+    int send_dtls(uint8_t type, const uint8_t * data, size_t len);
+    void close_conn(size_t i);
+    void close_marked();
+
+    void dtls_datagram();
+    void dtls_reset();
+    static ssize_t dtls_push(gnutls_transport_ptr_t p, const void *data,
+                             size_t len);
+    static ssize_t dtls_pull(gnutls_transport_ptr_t p, void *data,
+                             size_t len);
+    static int dtls_pull_timeout(gnutls_transport_ptr_t p, unsigned ms);
+
+    std::string user;
+    std::string password;
+    std::string domain;
+    std::string cookie;         /* of the last login */
+    bool use_dtls;
+
+    gnutls_certificate_credentials_t cred;
+    std::vector < uint8_t > cert_der;
+    unsigned port;
+    int listen_fd;
+    int udp_fd;
+    int cmd_pipe[2];
+    int reply_pipe[2];
+
+    std::vector < conn * >conns;
+    conn *tunnel;
+
+    /* the DTLS session of the tunnel */
+    gnutls_session_t dtls;
+    bool dtls_up;
+    uint8_t dtls_id[32];
+    struct sockaddr_storage dtls_peer;
+    socklen_t dtls_peer_len;
+    std::vector < uint8_t > dgram;  /* the datagram being read */
+
+    QMutex cmd_mutex;           /* one request at a time */
+    unsigned flood_count;
+    unsigned flood_size;
+    uint16_t flood_port;
+
+    QMutex mutex;               /* protects stats */
+    struct gw_stats stats;
+};
+
+#endif                          // MOCKGATEWAY_H
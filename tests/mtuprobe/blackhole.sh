@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# Runs the ICMP path MTU probe of the client across a path that silently
+# drops packets larger than $MTU: a router namespace forwards to the far
+# end over a link with that MTU, and sends no "fragmentation needed"
+# errors. Needs root and iproute2.
+#
+#   blackhole.sh [path to the mtuprobe binary]
+
+PROG=${1:-./mtuprobe}
+MTU=1400
+NEAR=octest-near
+MID=octest-mid
+FAR=octest-far
+
+cleanup() {
+	for ns in $NEAR $MID $FAR; do
+		ip netns del $ns 2>/dev/null || true
+	done
+}
+trap cleanup EXIT
+
+set -e
+cleanup
+for ns in $NEAR $MID $FAR; do
+	ip netns add $ns
+done
+ip link add octn netns $NEAR type veth peer name octm0 netns $MID
+ip link add octm1 netns $MID type veth peer name octf netns $FAR
+
+ip -n $NEAR addr add 10.199.0.1/24 dev octn
+ip -n $NEAR link set octn up
+ip -n $NEAR route add default via 10.199.0.2
+
+ip -n $MID addr add 10.199.0.2/24 dev octm0
+ip -n $MID addr add 10.199.1.1/24 dev octm1
+ip -n $MID link set octm0 up
+ip -n $MID link set octm1 mtu $MTU up
+ip netns exec $MID sysctl -qw net.ipv4.ip_forward=1
+ip netns exec $MID sysctl -qw net.ipv4.icmp_msgs_per_sec=0
+ip netns exec $MID sysctl -qw net.ipv4.icmp_msgs_burst=0
+
+ip -n $FAR addr add 10.199.1.2/24 dev octf
+ip -n $FAR link set octf mtu $MTU up
+ip -n $FAR route add default via 10.199.1.1
+
+# the probe uses an unprivileged ping socket
+ip netns exec $NEAR sysctl -qw net.ipv4.ping_group_range="0 2147483647"
+
+ip netns exec $NEAR "$PROG" 10.199.1.2 $MTU
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mtuprobe.h"
+#include <QThread>
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+}
+
+/* The path MTU search against local stand-ins for a path that silently
+ * drops packets above some size.
+ *
+ * Without arguments, the stand-in is a UDP echo responder on loopback
+ * that drops datagrams larger than its limit, and the search is checked
+ * for several limits. With HOST and EXPECTED, the ICMP probe of the
+ * client is run against HOST, which must be behind such a path; see
+ * blackhole.sh, which sets one up with network namespaces.
+ */
+
+#define REPLY_TIMEOUT 100       /* ms */
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+class Responder:public QThread {
+ public:
+    Responder() {
+        struct sockaddr_in sin;
+        socklen_t len = sizeof(sin);
+
+        limit = 0;
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+            || getsockname(fd, (struct sockaddr *)&sin, &len) < 0) {
+            perror("responder");
+            exit(1);
+        }
+        port = sin.sin_port;
+    }
+    ~Responder() {
+        close(fd);
+    }
+
+    unsigned short port;
+    volatile unsigned limit;
+
+ protected:
+    void run() {
+        unsigned char buf[65536];
+        struct sockaddr_in from;
+        socklen_t len;
+        ssize_t ret;
+
+        for (;;) {
+            len = sizeof(from);
+            ret = recvfrom(fd, buf, sizeof(buf), 0,
+                           (struct sockaddr *)&from, &len);
+            if (ret <= 0)
+                break;
+            if (ret == 1 && buf[0] == 'q')
+                break;
+            if ((unsigned)ret > limit)
+                continue;
+            sendto(fd, buf, ret, 0, (struct sockaddr *)&from, len);
+        }
+    }
+
+ private:
+    int fd;
+};
+
+/* drives the search over the responder; sizes are datagram payloads */
+class UdpProbe:public MtuProbe {
+ public:
+    UdpProbe(unsigned short port) {
+        struct sockaddr_in sin;
+
+        probes = 0;
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sin.sin_port = port;
+        if (fd < 0 || connect(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+            perror("probe");
+            exit(1);
+        }
+    }
+    ~UdpProbe() {
+        close(fd);
+    }
+
+    void quit() {
+        send(fd, "q", 1, 0);
+    }
+
+    unsigned probes;
+
+ protected:
+    bool probe(unsigned size) {
+        unsigned char buf[65536];
+        struct pollfd pfd;
+
+        probes++;
+        memset(buf, 0, size);
+        if (send(fd, buf, size, 0) < 0)
+            return false;
+
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, REPLY_TIMEOUT) <= 0)
+            return false;
+        return recv(fd, buf, sizeof(buf), 0) == (ssize_t) size;
+    }
+
+ private:
+    int fd;
+};
+
+static int search_test(void)
+{
+    static const unsigned limits[] = { 500, 576, 577, 1000, 1280, 1400,
+        1499, 1500, 9000
+    };
+    Responder r;
+    UdpProbe p(r.port);
+    unsigned i, want, got;
+    uint64_t start;
+    int ret = 0;
+
+    r.start();
+    for (i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+        r.limit = limits[i];
+        want = limits[i] < 576 ? 0 : limits[i] > 1500 ? 1500 : limits[i];
+
+        p.probes = 0;
+        start = now_ms();
+        got = p.search(576, 1500);
+        printf("limit %4u: found %4u in %2u probes, %4u ms\n", limits[i],
+               got, p.probes, (unsigned)(now_ms() - start));
+        if (got != want) {
+            fprintf(stderr, "expected %u\n", want);
+            ret = 1;
+        }
+    }
+    p.quit();
+    r.wait();
+    return ret;
+}
+
+static int icmp_test(const char *host, unsigned want)
+{
+    IcmpMtuProbe p;
+    std::string err;
+    unsigned got;
+    uint64_t start;
+
+    if (p.open(host, err) != 0) {
+        fprintf(stderr, "%s: %s\n", host, err.c_str());
+        return 1;
+    }
+
+    start = now_ms();
+    got = p.run();
+    printf("%s: path MTU %u in %u ms\n", host, got,
+           (unsigned)(now_ms() - start));
+    if (got != want) {
+        fprintf(stderr, "expected %u\n", want);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 3)
+        return icmp_test(argv[1], atoi(argv[2]));
+    if (argc != 1) {
+        fprintf(stderr, "usage: %s [HOST EXPECTED-MTU]\n", argv[0]);
+        return 2;
+    }
+    return search_test();
+}
@@ -0,0 +1,19 @@
+# The path MTU search against a stand-in path that drops large packets;
+# blackhole.sh runs the ICMP probe across network namespaces (as root).
+
+QMAKE_CXXFLAGS += -O2 -g
+
+QT       += core
+QT       -= gui
+
+TARGET = mtuprobe
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += mtuprobe.cpp \
+    ../../mtuprobe.cpp
+
+HEADERS += ../../mtuprobe.h
@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "netconfig.h"
+#include <string>
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mount.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <openconnect.h>
+}
+
+/* Applies and reverts the configuration of a session on a tun device in
+ * a network and mount namespace of its own (as root, with iproute2;
+ * /etc is a tmpfs there, so the system's resolv.conf is not touched):
+ *
+ * - NetConfig must add the addresses, the split routes, the excludes and
+ *   the gateway route through the physical interface, and resolv.conf,
+ *   and remove all of them again
+ * - when a message of the batch fails, the ones after it that the kernel
+ *   applied must be removed too
+ * - a session that is not reverted (a crash) must leave a backup of
+ *   resolv.conf that recover() puts back
+ *
+ * The time to connect and disconnect is reported for NetConfig and, when
+ * it is installed (or VPNC_SCRIPT names one), for the vpnc-script with
+ * the same configuration.
+ */
+
+#define TUNDEV "tun0"
+#define PHYS_ADDR "192.0.2.2/24"
+#define PHYS_GATEWAY "192.0.2.1"
+#define GATEWAY "198.51.100.1"
+#define INCLUDES 100
+#define EXCLUDES 4
+#define ROUNDS 10
+#define OLD_RESOLV "nameserver 192.0.2.53\noptions edns0\n"
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void run(const char *cmd)
+{
+    if (system(cmd) != 0) {
+        fprintf(stderr, "failed: %s\n", cmd);
+        exit(1);
+    }
+}
+
+/* the number of lines cmd prints */
+static unsigned count(const char *cmd)
+{
+    char line[512];
+    unsigned n = 0;
+    FILE *fp;
+
+    fp = popen(cmd, "r");
+    if (fp == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), fp) != NULL)
+        n++;
+    pclose(fp);
+    return n;
+}
+
+static std::string read_file(const char *name)
+{
+    std::string s;
+    char buf[4096];
+    size_t len;
+    FILE *fp;
+
+    fp = fopen(name, "r");
+    if (fp == NULL)
+        return s;
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+        s.append(buf, len);
+    fclose(fp);
+    return s;
+}
+
+static void write_file(const char *name, const std::string & s, int mode)
+{
+    FILE *fp;
+
+    fp = fopen(name, "w");
+    if (fp == NULL || fwrite(s.data(), 1, s.size(), fp) != s.size()) {
+        perror(name);
+        exit(1);
+    }
+    fclose(fp);
+    chmod(name, mode);
+}
+
+static struct oc_split_include *add_split(struct oc_split_include *list,
+                                          const char *route)
+{
+    struct oc_split_include *inc = new struct oc_split_include;
+
+    inc->route = strdup(route);
+    inc->next = list;
+    return inc;
+}
+
+/* a session with a full set of split routes */
+static void make_info(struct oc_ip_info *info)
+{
+    char route[64];
+    unsigned i;
+
+    memset(info, 0, sizeof(*info));
+    info->addr = "10.20.0.2";
+    info->netmask = "255.255.0.0";
+    info->addr6 = "fd00:20::2";
+    info->netmask6 = "fd00:20::2/64";
+    info->dns[0] = "10.20.0.53";
+    info->domain = "example.com";
+    info->mtu = 1400;
+
+    for (i = 0; i < INCLUDES; i++) {
+        snprintf(route, sizeof(route), "10.%u.%u.0/255.255.255.0",
+                 100 + i / 250, i % 250);
+        info->split_includes = add_split(info->split_includes, route);
+    }
+    info->split_includes = add_split(info->split_includes, "fd00:30::/48");
+    for (i = 0; i < EXCLUDES; i++) {
+        snprintf(route, sizeof(route), "203.0.113.%u/32", i + 1);
+        info->split_excludes = add_split(info->split_excludes, route);
+    }
+}
+
+/* the routes of the session: through the tun device, and the excludes
+ * and the gateway through the physical interface */
+static unsigned tun_routes(void)
+{
+    return count("ip -4 route show dev " TUNDEV)
+        + count("ip -6 route show dev " TUNDEV " | grep -v '^fe80'");
+}
+
+static unsigned phys_routes(void)
+{
+    return count("ip route show dev veth0 | grep -v '^default'");
+}
+
+static bool resolv_is_old(void)
+{
+    struct stat st;
+
+    return read_file("/etc/resolv.conf") == OLD_RESOLV
+        && stat("/etc/resolv.conf.openconnect-gui.orig", &st) != 0;
+}
+
+static int check_netconfig(const struct oc_ip_info *info)
+{
+    uint64_t t0, apply_us = 0, revert_us = 0;
+    unsigned base_phys = phys_routes(), i;
+    std::string err;
+    int ret = 0;
+
+    for (i = 0; i < ROUNDS; i++) {
+        NetConfig net;
+
+        t0 = now_us();
+        if (net.apply(info, TUNDEV, GATEWAY, NULL, err) != 0) {
+            fprintf(stderr, "apply: %s\n", err.c_str());
+            return 1;
+        }
+        apply_us += now_us() - t0;
+
+        /* the split includes and their addresses' subnets */
+        if (tun_routes() < INCLUDES + 1
+            || phys_routes() != base_phys + EXCLUDES + 1
+            || read_file("/etc/resolv.conf").find("nameserver 10.20.0.53")
+            == std::string::npos) {
+            fprintf(stderr, "not applied: %u tun routes, %u other routes\n",
+                    tun_routes(), phys_routes() - base_phys);
+            ret = 1;
+        }
+
+        t0 = now_us();
+        net.revert();
+        revert_us += now_us() - t0;
+
+        if (tun_routes() != 0 || phys_routes() != base_phys
+            || count("ip addr show dev " TUNDEV " | grep inet") != 0
+            || resolv_is_old() == false) {
+            fprintf(stderr, "not reverted: %u tun routes, %u other routes\n",
+                    tun_routes(), phys_routes() - base_phys);
+            ret = 1;
+        }
+    }
+
+    printf("%-28s %u us, %u us to revert\n", "NetConfig",
+           (unsigned)(apply_us / ROUNDS), (unsigned)(revert_us / ROUNDS));
+    return ret;
+}
+
+/* with IPv6 disabled on the device the IPv6 address fails, after the
+ * IPv4 address and before the routes, which the kernel applies anyway */
+static int check_partial(const struct oc_ip_info *info)
+{
+    unsigned base_phys = phys_routes();
+    std::string err;
+    NetConfig net;
+    int ret = 0;
+
+    run("sysctl -q -w net.ipv6.conf." TUNDEV ".disable_ipv6=1");
+    if (net.apply(info, TUNDEV, GATEWAY, NULL, err) == 0) {
+        fprintf(stderr, "applied without IPv6\n");
+        net.revert();
+        ret = 1;
+    } else if (count("ip -4 route show dev " TUNDEV) != 0
+               || phys_routes() != base_phys || net.get_changes() != 0
+               || resolv_is_old() == false) {
+        fprintf(stderr, "left behind on failure: %u tun routes, "
+                "%u other routes\n", count("ip -4 route show dev " TUNDEV),
+                phys_routes() - base_phys);
+        ret = 1;
+    }
+    run("sysctl -q -w net.ipv6.conf." TUNDEV ".disable_ipv6=0");
+
+    printf("%-28s %s\n", "failed batch", ret == 0 ? "reverted" : "leaked");
+    return ret;
+}
+
+/* a process that is killed does not revert */
+static int check_recover(const struct oc_ip_info *info)
+{
+    std::string err;
+    NetConfig *net = new NetConfig();
+    int ret = 0;
+
+    if (net->apply(info, TUNDEV, GATEWAY, NULL, err) != 0) {
+        fprintf(stderr, "apply: %s\n", err.c_str());
+        delete net;
+        return 1;
+    }
+    delete net;
+
+    if (resolv_is_old() == true) {
+        fprintf(stderr, "resolv.conf not replaced\n");
+        ret = 1;
+    }
+    NetConfig::recover();
+    if (resolv_is_old() == false) {
+        fprintf(stderr, "resolv.conf not recovered\n");
+        ret = 1;
+    }
+
+    /* what the kernel holds goes with the tun device */
+    run("ip tuntap del dev " TUNDEV " mode tun");
+    run("ip tuntap add dev " TUNDEV " mode tun");
+
+    printf("%-28s %s\n", "resolv.conf after a crash",
+           ret == 0 ? "recovered" : "lost");
+    return ret;
+}
+
+static void set_var(const char *prefix, unsigned n, const char *name,
+                    const char *value)
+{
+    char var[64];
+
+    snprintf(var, sizeof(var), "%s_%u_%s", prefix, n, name);
+    setenv(var, value, 1);
+}
+
+/* the routes above are given as addr/len for IPv6, and addr/netmask or
+ * a host address for IPv4 */
+static void set_split_env(const char *prefix, const char *prefix6,
+                          struct oc_split_include *list)
+{
+    char addr[64], val[64], *slash;
+    struct in_addr mask;
+    unsigned n4 = 0, n6 = 0, len;
+    uint32_t m;
+
+    for (; list != NULL; list = list->next) {
+        snprintf(addr, sizeof(addr), "%s", list->route);
+        slash = strchr(addr, '/');
+        if (slash != NULL)
+            *slash++ = 0;
+
+        if (strchr(addr, ':') != NULL) {
+            set_var(prefix6, n6, "ADDR", addr);
+            set_var(prefix6, n6++, "MASKLEN", slash ? slash : "128");
+            continue;
+        }
+
+        if (slash == NULL)
+            slash = (char *)"255.255.255.255";
+        inet_pton(AF_INET, slash, &mask);
+        for (len = 0, m = ntohl(mask.s_addr); m & 0x80000000; m <<= 1)
+            len++;
+        snprintf(val, sizeof(val), "%u", len);
+        set_var(prefix, n4, "ADDR", addr);
+        set_var(prefix, n4, "MASK", slash);
+        set_var(prefix, n4++, "MASKLEN", val);
+    }
+    snprintf(val, sizeof(val), "%u", n4);
+    setenv(prefix, val, 1);
+    snprintf(val, sizeof(val), "%u", n6);
+    setenv(prefix6, val, 1);
+}
+
+/* the environment openconnect gives the script for the same session */
+static void set_script_env(const struct oc_ip_info *info)
+{
+    char val[32];
+
+    setenv("VPNGATEWAY", GATEWAY, 1);
+    setenv("TUNDEV", TUNDEV, 1);
+    setenv("INTERNAL_IP4_ADDRESS", info->addr, 1);
+    setenv("INTERNAL_IP4_NETMASK", info->netmask, 1);
+    setenv("INTERNAL_IP4_NETMASKLEN", "16", 1);
+    setenv("INTERNAL_IP4_NETADDR", "10.20.0.0", 1);
+    snprintf(val, sizeof(val), "%d", info->mtu);
+    setenv("INTERNAL_IP4_MTU", val, 1);
+    setenv("INTERNAL_IP6_ADDRESS", info->addr6, 1);
+    setenv("INTERNAL_IP6_NETMASK", info->netmask6, 1);
+    setenv("INTERNAL_IP4_DNS", info->dns[0], 1);
+    setenv("CISCO_DEF_DOMAIN", info->domain, 1);
+    set_split_env("CISCO_SPLIT_INC", "CISCO_IPV6_SPLIT_INC",
+                  info->split_includes);
+    set_split_env("CISCO_SPLIT_EXC", "CISCO_IPV6_SPLIT_EXC",
+                  info->split_excludes);
+}
+
+static int check_script(const struct oc_ip_info *info, const char *script)
+{
+    uint64_t t0, connect_us = 0, disconnect_us = 0;
+    std::string cmd = std::string("sh ") + script + " >/dev/null 2>&1";
+    unsigned i;
+    int ret = 0;
+
+    set_script_env(info);
+    for (i = 0; i < ROUNDS; i++) {
+        setenv("reason", "connect", 1);
+        t0 = now_us();
+        if (system(cmd.c_str()) != 0) {
+            fprintf(stderr, "the vpnc-script failed to connect\n");
+            return 1;
+        }
+        connect_us += now_us() - t0;
+        if (tun_routes() < INCLUDES)
+            ret = 1;
+
+        setenv("reason", "disconnect", 1);
+        t0 = now_us();
+        if (system(cmd.c_str()) != 0)
+            ret = 1;
+        disconnect_us += now_us() - t0;
+
+        /* the script leaves the addresses to openconnect's tun device */
+        run("ip addr flush dev " TUNDEV);
+    }
+
+    printf("%-28s %u us, %u us to revert\n", "vpnc-script",
+           (unsigned)(connect_us / ROUNDS), (unsigned)(disconnect_us / ROUNDS));
+    if (ret != 0)
+        fprintf(stderr, "the vpnc-script did not set up the routes\n");
+    return ret;
+}
+
+int main(void)
+{
+    struct oc_ip_info info;
+    const char *script = getenv("VPNC_SCRIPT");
+    std::string text;
+    int ret = 0;
+
+    if (script == NULL)
+        script = DEFAULT_VPNC_SCRIPT;
+    text = read_file(script);
+
+    if (getuid() != 0 || unshare(CLONE_NEWNET | CLONE_NEWNS) != 0
+        || mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) != 0
+        || mount("none", "/etc", "tmpfs", 0, NULL) != 0) {
+        printf("skipped: needs root for a network and mount namespace\n");
+        return 0;
+    }
+    write_file("/etc/resolv.conf", OLD_RESOLV, 0644);
+    /* the script, where it was before /etc was covered */
+    if (text.empty() == false) {
+        script = "/etc/vpnc-script";
+        write_file(script, text, 0755);
+    }
+
+    run("ip link set lo up");
+    run("ip link add veth0 type veth peer name veth1");
+    run("ip addr add " PHYS_ADDR " dev veth0");
+    run("ip link set veth0 up");
+    run("ip link set veth1 up");
+    run("ip route add default via " PHYS_GATEWAY " dev veth0");
+    run("ip tuntap add dev " TUNDEV " mode tun");
+
+    make_info(&info);
+
+    if (check_netconfig(&info) != 0)
+        ret = 1;
+    if (check_partial(&info) != 0)
+        ret = 1;
+    if (check_recover(&info) != 0)
+        ret = 1;
+
+    if (text.empty() == false) {
+        if (check_script(&info, script) != 0)
+            ret = 1;
+    } else {
+        printf("%-28s not found, skipped\n", "vpnc-script");
+    }
+    return ret;
+}
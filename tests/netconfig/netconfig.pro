@@ -0,0 +1,20 @@
+# The native network configuration and the vpnc-script on a tun device
+# in a network and mount namespace of their own; needs root and iproute2,
+# and is skipped without.
+
+QMAKE_CXXFLAGS += -O2 -g
+
+QT       += core
+QT       -= gui
+
+TARGET = netconfig
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += netconfig.cpp \
+    ../../netconfig.cpp
+
+HEADERS += ../../netconfig.h
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "netmonitor.h"
+#include <string>
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <openconnect.h>
+}
+
+/* Drives the network monitor with real rtnetlink events in a network
+ * namespace of its own (as root, with iproute2): a tun device stands in
+ * for the tunnel and a veth pair for a new network path.
+ *
+ * - events of the tunnel device must not pause the session
+ * - a new link, address and default route must pause it once, after
+ *   they settled, and stats must then be requested until the tunnel is
+ *   reported restored
+ * - removals must not pause it
+ */
+
+#define QUIET_TIME (SETTLE_MAX + 1000)
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void run(const char *cmd)
+{
+    if (system(cmd) != 0) {
+        fprintf(stderr, "failed: %s\n", cmd);
+        exit(1);
+    }
+}
+
+/* returns the command byte, or zero if none came within timeout ms */
+static char next_cmd(int fd, int timeout)
+{
+    struct pollfd pfd;
+    char c;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, timeout) <= 0)
+        return 0;
+    if (read(fd, &c, 1) != 1)
+        return 0;
+    return c;
+}
+
+static int expect_quiet(int fd, const char *what)
+{
+    char c = next_cmd(fd, QUIET_TIME);
+
+    if (c != 0) {
+        fprintf(stderr, "%s: unexpected command '%c'\n", what, c);
+        return -1;
+    }
+    printf("%-28s no pause\n", what);
+    return 0;
+}
+
+int main(void)
+{
+    std::string err, reason;
+    uint64_t start, outage;
+    unsigned polls;
+    int sv[2], ret = 0;
+    int tun;
+    char c;
+
+    if (getuid() != 0 || unshare(CLONE_NEWNET) != 0) {
+        printf("skipped: needs root for a network namespace\n");
+        return 0;
+    }
+
+    run("ip link set lo up");
+    run("ip tuntap add octtun mode tun");
+    tun = if_nametoindex("octtun");
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        return 1;
+    }
+
+    NetMonitor monitor(sv[1], tun);
+    if (monitor.setup(err) != 0) {
+        fprintf(stderr, "setup: %s\n", err.c_str());
+        return 1;
+    }
+    monitor.start();
+
+    /* what the session does to its own tunnel device */
+    run("ip link set octtun up");
+    run("ip addr add 10.9.0.1/24 dev octtun");
+    run("ip route add default dev octtun metric 10");
+    if (expect_quiet(sv[0], "tunnel device configured") != 0)
+        ret = 1;
+
+    /* a new path: one pause once the events settled */
+    start = now_ms();
+    run("ip link add octa type veth peer name octb");
+    run("ip link set octb up");
+    run("ip link set octa up");
+    run("ip addr add 192.0.2.1/24 dev octa");
+    run("ip route add default via 192.0.2.2 dev octa metric 100");
+
+    c = next_cmd(sv[0], SETTLE_MAX + 1000);
+    if (c != OC_CMD_PAUSE) {
+        fprintf(stderr, "new path: no pause\n");
+        return 1;
+    }
+    printf("%-28s paused after %u ms\n", "new link, address, route",
+           (unsigned)(now_ms() - start));
+
+    /* until the tunnel is restored, stats are requested */
+    polls = 0;
+    start = now_ms();
+    while (now_ms() - start < 1000) {
+        c = next_cmd(sv[0], 1000);
+        if (c == OC_CMD_PAUSE) {
+            fprintf(stderr, "new path: paused twice\n");
+            ret = 1;
+        } else if (c == OC_CMD_STATS)
+            polls++;
+    }
+    if (polls < 1000 / RESTORE_POLL - 1 || polls > 1000 / RESTORE_POLL + 1) {
+        fprintf(stderr, "%u stats requests in a second\n", polls);
+        ret = 1;
+    }
+
+    if (monitor.restored(&outage, reason) == false
+        || outage < SETTLE_TIME || reason.empty()) {
+        fprintf(stderr, "no outage recorded\n");
+        ret = 1;
+    }
+    printf("%-28s %u stats requests/s, outage %u ms (%s)\n", "restored",
+           polls, (unsigned)outage, reason.c_str());
+    if (monitor.restored(&outage, reason) == true) {
+        fprintf(stderr, "outage reported twice\n");
+        ret = 1;
+    }
+
+    /* one request may have been under way */
+    next_cmd(sv[0], RESTORE_POLL / 2);
+    if (expect_quiet(sv[0], "after the restore") != 0)
+        ret = 1;
+
+    run("ip route del default via 192.0.2.2 dev octa");
+    run("ip addr del 192.0.2.1/24 dev octa");
+    run("ip link set octa down");
+    if (expect_quiet(sv[0], "path removed") != 0)
+        ret = 1;
+
+    monitor.stop();
+    return ret;
+}
@@ -0,0 +1,19 @@
+# The network change monitor against rtnetlink events in a network
+# namespace of its own; needs root and iproute2, and is skipped without.
+
+QMAKE_CXXFLAGS += -O2 -g
+
+QT       += core
+QT       -= gui
+
+TARGET = netmonitor
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += netmonitor.cpp \
+    ../../netmonitor.cpp
+
+HEADERS += ../../netmonitor.h
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tunpump.h"
+#include "flowtable.h"
+#include "packetring.h"
+#include <QThread>
+#include <QString>
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+}
+
+/* Compares the userspace tun data path with the direct one, without root
+ * and without a server: a socket pair stands in for the tun device.
+ *
+ * direct: writer -> socket pair -> reader, as openconnect reading the tun
+ *         device
+ * pumped: writer -> socket pair -> TunPump -> socket pair -> reader
+ *
+ * The writer sends IPv4/UDP packets of FLOWS different flows. The run
+ * fails if a packet is lost or the flow table does not add up.
+ */
+
+#define PACKETS 200000
+#define FLOWS 6000              /* more than the flow table holds */
+#define SOCKBUF (1024*1024)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void make_packet(uint8_t * pkt, unsigned size, unsigned flow)
+{
+    memset(pkt, 0, size);
+    pkt[0] = 0x45;
+    pkt[2] = size >> 8;
+    pkt[3] = size & 0xff;
+    pkt[8] = 64;
+    pkt[9] = 17;
+    pkt[12] = 10;
+    pkt[15] = 2;
+    pkt[16] = 192;
+    pkt[17] = 0;
+    pkt[18] = 2;
+    pkt[19] = 1;
+    pkt[20] = (1024 + flow) >> 8;
+    pkt[21] = (1024 + flow) & 0xff;
+    pkt[22] = 0;
+    pkt[23] = 53;
+}
+
+class Writer:public QThread {
+ public:
+    Writer(int fd, unsigned size) {
+        this->fd = fd;
+        this->size = size;
+    }
+ protected:
+    void run() {
+        uint8_t pkt[2048];
+        unsigned i;
+
+        for (i = 0; i < PACKETS; i++) {
+            make_packet(pkt, size, i % FLOWS);
+            if (send(fd, pkt, size, 0) != (ssize_t) size) {
+                perror("send");
+                exit(1);
+            }
+        }
+    }
+ private:
+    int fd;
+    unsigned size;
+};
+
+static void pair(int sv[2])
+{
+    int size = SOCKBUF;
+
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) < 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+/* returns the nanoseconds per packet */
+static double receive(int fd, unsigned size, Writer * w)
+{
+    uint8_t buf[2048];
+    uint64_t start;
+    unsigned i;
+
+    start = now_ns();
+    w->start();
+    for (i = 0; i < PACKETS; i++) {
+        if (recv(fd, buf, sizeof(buf), 0) != (ssize_t) size) {
+            fprintf(stderr, "lost or truncated packet %u\n", i);
+            exit(1);
+        }
+    }
+    w->wait();
+    return (double)(now_ns() - start) / PACKETS;
+}
+
+static double direct(unsigned size)
+{
+    int sv[2];
+    double ns;
+
+    pair(sv);
+    Writer w(sv[0], size);
+    ns = receive(sv[1], size, &w);
+    close(sv[0]);
+    close(sv[1]);
+    return ns;
+}
+
+static double pumped(unsigned size, FlowTable * flows, PacketRing * ring)
+{
+    TunPump pump(flows, ring);
+    QString err;
+    int tun[2];
+    double ns;
+
+    pair(tun);
+    if (pump.attach(tun[1], err) != 0) {
+        fprintf(stderr, "cannot set up the pump\n");
+        exit(1);
+    }
+    pump.start();
+
+    Writer w(tun[0], size);
+    ns = receive(pump.get_vpn_fd(), size, &w);
+
+    pump.stop();
+    close(tun[0]);
+    return ns;
+}
+
+static int check_flows(FlowTable * flows, unsigned size)
+{
+    std::vector < flow_entry > top;
+    uint64_t bytes = 0;
+    unsigned i;
+
+    flows->top(top, FLOW_TABLE_SIZE);
+    for (i = 0; i < top.size(); i++)
+        bytes += top[i].tx_bytes;
+
+    if (flows->get_packets() != PACKETS || flows->get_evicted() == 0
+        || bytes > (uint64_t) PACKETS * size || top.size() > FLOW_TABLE_SIZE) {
+        fprintf(stderr, "flow table does not add up: %llu packets, "
+                "%llu flows dropped, %u kept\n",
+                (unsigned long long)flows->get_packets(),
+                (unsigned long long)flows->get_evicted(),
+                (unsigned)top.size());
+        return -1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const unsigned sizes[] = { 64, 576, 1400 };
+    FlowTable flows;
+    PacketRing ring;
+    double d, p;
+    unsigned i;
+    int ret = 0;
+
+    printf("%-6s %12s %12s %12s %12s\n", "size", "direct ns", "pumped ns",
+           "overhead ns", "pump ns");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        flows.clear();
+        d = direct(sizes[i]);
+        p = pumped(sizes[i], &flows, &ring);
+        printf("%-6u %12.0f %12.0f %12.0f %12u\n", sizes[i], d, p, p - d,
+               flows.get_pump_cost());
+        if (check_flows(&flows, sizes[i]) != 0)
+            ret = 1;
+    }
+
+    /* capture on: the cost of copying the headers into the ring */
+    ring.enable(RING_DEFAULT_SNAPLEN);
+    flows.clear();
+    p = pumped(1400, &flows, &ring);
+    printf("%-6s %12s %12.0f %12s %12u\n", "1400+c", "", p, "",
+           flows.get_pump_cost());
+
+    return ret;
+}
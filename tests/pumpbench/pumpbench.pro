@@ -0,0 +1,24 @@
+# The userspace tun data path against the direct one; run as any user.
+
+QMAKE_CXXFLAGS += -O2 -g
+
+QT       += core
+QT       -= gui
+
+TARGET = pumpbench
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += pumpbench.cpp \
+    ../../tunpump.cpp \
+    ../../flowtable.cpp \
+    ../../routetable.cpp \
+    ../../packetring.cpp
+
+HEADERS += ../../tunpump.h \
+    ../../flowtable.h \
+    ../../routetable.h \
+    ../../packetring.h
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "routetable.h"
+#include <vector>
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+}
+
+/* Checks the split-tunnel policy lookup and times it; runs as any user.
+ *
+ * - the longest matching prefix is found, for IPv4 and IPv6, down to
+ *   host routes and up to a default route
+ * - an exclude wins over an include of the same prefix, and of equal
+ *   prefixes the first is kept
+ * - without includes everything but the excludes goes to the VPN
+ * - over ROUTES random routes the trie agrees with a linear scan, and
+ *   the time per lookup is reported for both
+ */
+
+#define ROUTES 10000
+#define LOOKUPS 1000000
+#define SCAN_LOOKUPS 20000      /* the linear scan is slow */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned family_of(const char *addr)
+{
+    return strchr(addr, ':') ? 6 : 4;
+}
+
+static int add(RouteTable * t, const char *addr, unsigned plen, bool exclude)
+{
+    uint8_t a[16];
+    unsigned family = family_of(addr);
+
+    inet_pton(family == 6 ? AF_INET6 : AF_INET, addr, a);
+    return t->add(a, family, plen, exclude);
+}
+
+static int lookup(RouteTable * t, const char *addr)
+{
+    uint8_t a[16];
+    unsigned family = family_of(addr);
+
+    inet_pton(family == 6 ? AF_INET6 : AF_INET, addr, a);
+    return t->lookup(a, family);
+}
+
+static bool via_vpn(RouteTable * t, const char *addr)
+{
+    uint8_t a[16];
+    unsigned family = family_of(addr);
+
+    inet_pton(family == 6 ? AF_INET6 : AF_INET, addr, a);
+    return t->via_vpn(a, family);
+}
+
+static int failures = 0;
+
+static void expect(RouteTable * t, const char *addr, int route)
+{
+    int r = lookup(t, addr);
+
+    if (r != route) {
+        fprintf(stderr, "%s: route %d, expected %d\n", addr, r, route);
+        failures++;
+    }
+}
+
+static void expect_vpn(RouteTable * t, const char *addr, bool vpn)
+{
+    if (via_vpn(t, addr) != vpn) {
+        fprintf(stderr, "%s: %s the VPN, expected %s\n", addr,
+                vpn ? "not through" : "through", vpn ? "through" : "not");
+        failures++;
+    }
+}
+
+static void check_prefixes(void)
+{
+    RouteTable t;
+    int r8, r16, r24, r32, r0, s32, s48, s64, s128;
+
+    r8 = add(&t, "10.0.0.0", 8, false);
+    r16 = add(&t, "10.1.0.0", 16, true);
+    r24 = add(&t, "10.1.2.0", 24, false);
+    r32 = add(&t, "10.1.2.3", 32, true);
+    expect(&t, "10.9.9.9", r8);
+    expect(&t, "10.1.9.9", r16);
+    expect(&t, "10.1.2.4", r24);
+    expect(&t, "10.1.2.3", r32);
+    expect(&t, "11.0.0.1", -1);
+    expect_vpn(&t, "10.9.9.9", true);
+    expect_vpn(&t, "10.1.9.9", false);
+    expect_vpn(&t, "10.1.2.4", true);
+    expect_vpn(&t, "10.1.2.3", false);
+    expect_vpn(&t, "11.0.0.1", false);
+
+    s32 = add(&t, "2001:db8::", 32, false);
+    s48 = add(&t, "2001:db8:1::", 48, true);
+    s64 = add(&t, "2001:db8:1:2::", 64, false);
+    s128 = add(&t, "2001:db8:1:2::1", 128, true);
+    expect(&t, "2001:db8:ffff::1", s32);
+    expect(&t, "2001:db8:1:ffff::1", s48);
+    expect(&t, "2001:db8:1:2::2", s64);
+    expect(&t, "2001:db8:1:2::1", s128);
+    expect(&t, "2001:db9::1", -1);
+    /* the families do not mix */
+    expect(&t, "::ffff:10.1.2.3", -1);
+    expect(&t, "32.1.13.184", -1);
+
+    r0 = add(&t, "0.0.0.0", 0, false);
+    expect(&t, "11.0.0.1", r0);
+    expect(&t, "10.1.2.3", r32);
+    expect_vpn(&t, "11.0.0.1", true);
+}
+
+static void check_precedence(void)
+{
+    RouteTable t;
+    int inc, exc, exc2, inc2, first, second;
+
+    /* as the session adds them: the includes, then the excludes */
+    inc = add(&t, "192.168.0.0", 16, false);
+    exc = add(&t, "192.168.0.0", 16, true);
+    expect(&t, "192.168.1.1", exc);
+    expect_vpn(&t, "192.168.1.1", false);
+
+    /* and the other way round */
+    exc2 = add(&t, "172.16.0.0", 12, true);
+    inc2 = add(&t, "172.16.0.0", 12, false);
+    expect(&t, "172.16.1.1", exc2);
+    expect_vpn(&t, "172.16.1.1", false);
+
+    first = add(&t, "fd00::", 8, false);
+    second = add(&t, "fd00::", 8, false);
+    expect(&t, "fd00::1", first);
+    if (second == first || inc == exc || inc2 == exc2) {
+        fprintf(stderr, "a duplicate has no index of its own\n");
+        failures++;
+    }
+
+    /* host bits beyond the prefix do not matter */
+    expect(&t, "192.168.255.255", exc);
+    if (add(&t, "192.168.77.77", 16, false) < 0
+        || lookup(&t, "192.168.1.1") != exc) {
+        fprintf(stderr, "a prefix with host bits replaced the route\n");
+        failures++;
+    }
+}
+
+static void check_excludes_only(void)
+{
+    RouteTable t;
+
+    add(&t, "198.51.100.0", 24, true);
+    add(&t, "2001:db8::", 32, true);
+    expect_vpn(&t, "198.51.100.7", false);
+    expect_vpn(&t, "203.0.113.7", true);
+    expect_vpn(&t, "2001:db8::7", false);
+    expect_vpn(&t, "2001:db9::7", true);
+
+    /* an include of one family makes the other's default direct only
+     * there */
+    add(&t, "10.0.0.0", 8, false);
+    expect_vpn(&t, "203.0.113.7", false);
+    expect_vpn(&t, "2001:db9::7", true);
+
+    t.clear();
+    expect_vpn(&t, "198.51.100.7", true);
+    expect(&t, "10.1.1.1", -1);
+}
+
+/* the longest match by comparing with every route, first one of equal
+ * prefixes, excludes first */
+static int scan(const std::vector < route_entry > &routes,
+                const uint8_t * addr, unsigned family)
+{
+    int best = -1;
+    unsigned i, bytes, bits;
+
+    for (i = 0; i < routes.size(); i++) {
+        const route_entry & r = routes[i];
+
+        if (r.family != family)
+            continue;
+        bytes = r.plen / 8;
+        bits = r.plen % 8;
+        if (memcmp(r.addr, addr, bytes) != 0)
+            continue;
+        if (bits && ((r.addr[bytes] ^ addr[bytes]) & (0xff << (8 - bits))))
+            continue;
+        if (best == -1 || r.plen > routes[best].plen
+            || (r.plen == routes[best].plen && r.exclude
+                && routes[best].exclude == false))
+            best = i;
+    }
+    return best;
+}
+
+static void random_addr(uint8_t * addr, unsigned family)
+{
+    unsigned i;
+
+    for (i = 0; i < (family == 6 ? 16u : 4u); i++)
+        addr[i] = rand() & 0xff;
+    /* a few prefixes, so that routes nest */
+    addr[0] = family == 6 ? 0x20 : 10;
+    addr[1] &= 0x0f;
+}
+
+static void benchmark(void)
+{
+    RouteTable t;
+    std::vector < route_entry > routes;
+    std::vector < uint8_t > addrs(LOOKUPS * 16);
+    std::vector < unsigned >families(LOOKUPS);
+    uint8_t addr[16];
+    uint64_t t0, build, trie, linear;
+    unsigned i, family, plen, mismatches = 0, hits = 0;
+    volatile int sink = 0;
+
+    srand(1);
+    t0 = now_ns();
+    for (i = 0; i < ROUTES; i++) {
+        family = (i % 4 == 0) ? 6 : 4;
+        random_addr(addr, family);
+        plen = family == 6 ? 16 + rand() % 49 : 8 + rand() % 25;
+        t.add(addr, family, plen, rand() % 8 == 0);
+    }
+    build = now_ns() - t0;
+    routes = t.get_routes();
+
+    for (i = 0; i < LOOKUPS; i++) {
+        families[i] = (i % 4 == 0) ? 6 : 4;
+        random_addr(&addrs[i * 16], families[i]);
+    }
+
+    t0 = now_ns();
+    for (i = 0; i < LOOKUPS; i++)
+        sink += t.lookup(&addrs[i * 16], families[i]);
+    trie = now_ns() - t0;
+
+    t0 = now_ns();
+    for (i = 0; i < SCAN_LOOKUPS; i++)
+        sink += scan(routes, &addrs[i * 16], families[i]);
+    linear = now_ns() - t0;
+
+    for (i = 0; i < SCAN_LOOKUPS; i++) {
+        int r = t.lookup(&addrs[i * 16], families[i]);
+
+        if (r != -1)
+            hits++;
+        if (r != scan(routes, &addrs[i * 16], families[i]))
+            mismatches++;
+    }
+
+    printf("%-28s %u routes in %llu us\n", "built",
+           ROUTES, (unsigned long long)(build / 1000));
+    printf("%-28s %.0f ns per lookup\n", "trie", (double)trie / LOOKUPS);
+    printf("%-28s %.0f ns per lookup\n", "linear scan",
+           (double)linear / SCAN_LOOKUPS);
+    printf("%-28s %u of %u matched, %u differ\n", "trie against the scan",
+           hits, SCAN_LOOKUPS, mismatches);
+    if (mismatches != 0 || hits == 0)
+        failures++;
+}
+
+int main(void)
+{
+    check_prefixes();
+    check_precedence();
+    check_excludes_only();
+    benchmark();
+
+    return failures == 0 ? 0 : 1;
+}
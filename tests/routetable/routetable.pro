@@ -0,0 +1,19 @@
+# Longest-prefix matching of the split-tunnel policy, checked against a
+# linear scan and timed over random routes; runs as any user.
+
+QMAKE_CXXFLAGS += -O2 -g
+
+QT       += core
+QT       -= gui
+
+TARGET = routetable
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += routetable.cpp \
+    ../../routetable.cpp
+
+HEADERS += ../../routetable.h
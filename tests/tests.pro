@@ -0,0 +1,6 @@
+# Programs that exercise parts of the client without a VPN server:
+#   qmake && make && make check
+TEMPLATE = subdirs
+
+SUBDIRS += routetable domaintrie
+linux: SUBDIRS += pumpbench mtuprobe netmonitor dnsproxy netconfig gateway
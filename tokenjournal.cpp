@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tokenjournal.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QList>
+#include <QMutex>
+
+#ifdef _WIN32
+#include <io.h>
+#define sync_fd _commit
+#elif defined(__MACH__)
+#include <unistd.h>
+#define sync_fd fsync
+#else
+#include <unistd.h>
+#define sync_fd fdatasync
+#endif
+
+/* the copies of a profile (the session's and the editor's) live in one
+ * process; this orders their appends and clears */
+static QMutex journal_mutex;
+
+TokenJournal::TokenJournal()
+{
+}
+
+void TokenJournal::set_file(QString file)
+{
+    this->file = file;
+}
+
+bool TokenJournal::exists()
+{
+    return file.isEmpty() == false && QFile::exists(file);
+}
+
+static QByteArray checksum(const QByteArray & rec)
+{
+    return QByteArray::number(qChecksum(rec.constData(), rec.size()), 16);
+}
+
+int TokenJournal::append(const QByteArray & data)
+{
+    QMutexLocker locker(&journal_mutex);
+    QFile f(file);
+    QByteArray rec;
+
+    if (file.isEmpty() == true)
+        return -1;
+
+    QDir().mkpath(QFileInfo(file).absolutePath());
+    if (f.open(QIODevice::WriteOnly | QIODevice::Append) == false)
+        return -1;
+
+    rec = data.toBase64();
+    rec = checksum(rec) + " " + rec + "\n";
+
+    /* the state is in use once this returns; a crash must not bring the
+     * old one back */
+    if (f.write(rec) != rec.size() || f.flush() == false
+        || sync_fd(f.handle()) != 0)
+        return -1;
+    return 0;
+}
+
+bool TokenJournal::last(QByteArray & data)
+{
+    QMutexLocker locker(&journal_mutex);
+    return read_last(data);
+}
+
+bool TokenJournal::read_last(QByteArray & data)
+{
+    QFile f(file);
+    QList < QByteArray > lines;
+    int i, sp;
+
+    if (file.isEmpty() == true || f.open(QIODevice::ReadOnly) == false)
+        return false;
+
+    /* the part after the last newline is an incomplete record */
+    lines = f.readAll().split('\n');
+    for (i = lines.size() - 2; i >= 0; i--) {
+        sp = lines[i].indexOf(' ');
+        if (sp <= 0)
+            continue;
+        if (checksum(lines[i].mid(sp + 1)) != lines[i].left(sp))
+            continue;
+        data = QByteArray::fromBase64(lines[i].mid(sp + 1));
+        return true;
+    }
+    return false;
+}
+
+void TokenJournal::clear()
+{
+    QMutexLocker locker(&journal_mutex);
+
+    if (exists() == true)
+        QFile::remove(file);
+}
+
+bool TokenJournal::clear_upto(const QByteArray & data)
+{
+    QMutexLocker locker(&journal_mutex);
+    QByteArray cur;
+
+    if (read_last(cur) == true && cur != data)
+        return false;
+    if (exists() == true)
+        QFile::remove(file);
+    return true;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOKENJOURNAL_H
+#define TOKENJOURNAL_H
+
+#include <QString>
+#include <QByteArray>
+
+/* An append-only file of token states (the HOTP counter advances on every
+ * use), so that an update is one small synced write rather than a rewrite
+ * of the whole profile. Each record is a line with a checksum; the last
+ * complete one is the current state. The profile store absorbs it on its
+ * next save, which clears the journal unless a newer state was appended
+ * meanwhile (by the session's copy of the profile).
+ */
+class TokenJournal {
+ public:
+    TokenJournal();
+
+    void set_file(QString file);
+    bool exists();
+
+    /* appends a state and syncs it to disk; returns zero on success */
+    int append(const QByteArray & data);
+    /* the last complete record; a torn write at the end is skipped */
+    bool last(QByteArray & data);
+    void clear();
+    /* clears the journal if data is still its last record, i.e. nothing
+     * was appended since it was read; returns true if it is gone */
+    bool clear_upto(const QByteArray & data);
+
+ private:
+    bool read_last(QByteArray & data);
+
+    QString file;
+};
+
+#endif                          // TOKENJOURNAL_H
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "transportlog.h"
+
+TransportLog::TransportLog()
+{
+    state = TRANSPORT_NONE;
+    since = 0;
+    total[0] = total[1] = total[2] = 0;
+    fallbacks = 0;
+    restored = false;
+    had_dtls = false;
+}
+
+bool TransportLog::update(bool dtls, uint64_t now)
+{
+    transport_t s = dtls ? TRANSPORT_DTLS : TRANSPORT_CSTP;
+
+    if (s == state)
+        return false;
+
+    total[state] += now - since;
+    if (s == TRANSPORT_DTLS) {
+        restored = had_dtls;
+        had_dtls = true;
+    } else if (state == TRANSPORT_DTLS) {
+        fallbacks++;
+    }
+
+    state = s;
+    since = now;
+    return true;
+}
+
+uint64_t TransportLog::get_time(transport_t s, uint64_t now)
+{
+    if (s == state)
+        return total[s] + now - since;
+    return total[s];
+}
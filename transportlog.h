@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRANSPORTLOG_H
+#define TRANSPORTLOG_H
+
+#include <stdint.h>
+
+enum transport_t {
+    TRANSPORT_NONE,
+    TRANSPORT_CSTP,             /* TLS over TCP only */
+    TRANSPORT_DTLS              /* data over UDP */
+};
+
+/* Follows which transport carries the data of a session and for how
+ * long. Times are session times in ms.
+ */
+class TransportLog {
+ public:
+    TransportLog();
+
+    /* returns true on a transition */
+    bool update(bool dtls, uint64_t now);
+
+    transport_t get_state() {
+        return state;
+    }
+    /* ms spent in the state, including the current period */
+    uint64_t get_time(transport_t s, uint64_t now);
+    uint64_t get_since() {
+        return since;
+    }
+    unsigned get_fallbacks() {
+        return fallbacks;
+    }
+    /* true if DTLS was up before the last transition to it */
+    bool was_restored() {
+        return restored;
+    }
+
+ private:
+    transport_t state;
+    uint64_t since;
+    uint64_t total[3];
+    unsigned fallbacks;
+    bool restored;
+    bool had_dtls;
+};
+
+#endif                          // TRANSPORTLOG_H
@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tunpump.h"
+
+#ifdef USE_TUN_PUMP
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+}
+
+/* the largest packet openconnect will write to us */
+#define PUMP_MTU 65536
+/* packets moved in one direction before polling again */
+#define PUMP_BATCH 64
+#define PUMP_SOCKBUF (1024*1024)
+
+TunPump::TunPump(FlowTable * flows, PacketRing * ring)
+{
+    this->flows = flows;
+    this->ring = ring;
+    tun_fd = -1;
+    pump_fd = -1;
+    vpn_fd = -1;
+    stop_pipe[0] = stop_pipe[1] = -1;
+    held = 0;
+}
+
+TunPump::~TunPump()
+{
+    stop();
+    if (tun_fd != -1)
+        close(tun_fd);
+    if (pump_fd != -1)
+        close(pump_fd);
+    if (vpn_fd != -1)
+        close(vpn_fd);
+    if (stop_pipe[0] != -1) {
+        close(stop_pipe[0]);
+        close(stop_pipe[1]);
+    }
+}
+
+int TunPump::setup(QString & ifname, QString & err)
+{
+    struct ifreq ifr;
+    int fd;
+
+    fd = open("/dev/net/tun", O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        err = QObject::tr("Cannot open /dev/net/tun: ") +
+            QString::fromLocal8Bit(strerror(errno));
+        return -1;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+    if (ioctl(fd, TUNSETIFF, &ifr) < 0) {
+        err = QObject::tr("Cannot create the tun device: ") +
+            QString::fromLocal8Bit(strerror(errno));
+        close(fd);
+        return -1;
+    }
+    ifname = QString::fromLocal8Bit(ifr.ifr_name);
+
+    return attach(fd, err);
+}
+
+int TunPump::attach(int fd, QString & err)
+{
+    int sv[2];
+    int size = PUMP_SOCKBUF;
+
+    tun_fd = fd;
+    fcntl(tun_fd, F_SETFL, fcntl(tun_fd, F_GETFL) | O_NONBLOCK);
+
+    /* datagram sockets keep the packet boundaries */
+    if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        err = QObject::tr("Cannot create the socket pair: ") +
+            QString::fromLocal8Bit(strerror(errno));
+        return -1;
+    }
+    pump_fd = sv[0];
+    vpn_fd = sv[1];
+    setsockopt(pump_fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(pump_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(vpn_fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(vpn_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    if (pipe2(stop_pipe, O_CLOEXEC) < 0) {
+        err = QObject::tr("Cannot create pipe: ") +
+            QString::fromLocal8Bit(strerror(errno));
+        stop_pipe[0] = stop_pipe[1] = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+void TunPump::stop()
+{
+    char c = 0;
+
+    if (this->isRunning() == false)
+        return;
+
+    if (write(stop_pipe[1], &c, 1) < 0)
+        return;
+    this->wait();
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Moves up to PUMP_BATCH packets; returns -1 if the source is gone. An
+ * outbound packet openconnect has no room for is held in buf. */
+int TunPump::forward(int from, int to, bool outbound, uint8_t * buf)
+{
+    uint64_t start = now_ns();
+    unsigned pkts;
+    ssize_t len;
+
+    for (pkts = 0; pkts < PUMP_BATCH; pkts++) {
+        if (from == pump_fd)
+            len = recv(from, buf, PUMP_MTU, MSG_DONTWAIT);
+        else
+            len = read(from, buf, PUMP_MTU);
+
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                break;
+            return -1;
+        }
+        if (len == 0)
+            break;
+
+        if (ring->is_enabled())
+            ring->capture(buf, len);
+        flows->account(buf, len, outbound, start / 1000000000ULL);
+
+        if (to == pump_fd) {
+            held = len;
+            if (flush(buf) < 0)
+                return -1;
+            if (held != 0) {
+                pkts++;
+                break;
+            }
+        } else {
+            /* like the kernel's, the tun queue drops when full */
+            len = write(to, buf, len);
+            if (len < 0 && errno != EAGAIN && errno != ENOBUFS)
+                return -1;
+        }
+    }
+
+    if (pkts > 0)
+        flows->add_pump_time(now_ns() - start, pkts);
+    return 0;
+}
+
+/* Sends the held outbound packet; it stays held while openconnect has no
+ * room for it. */
+int TunPump::flush(uint8_t * buf)
+{
+    ssize_t len;
+
+    len = send(pump_fd, buf, held, MSG_DONTWAIT);
+    if (len < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
+        if (errno != ENOBUFS)
+            return -1;
+    }
+    held = 0;
+    return 0;
+}
+
+void TunPump::run()
+{
+    struct pollfd pfd[3];
+    uint8_t *out_buf, *in_buf;
+    int ret;
+
+    out_buf = new uint8_t[PUMP_MTU];
+    in_buf = new uint8_t[PUMP_MTU];
+    held = 0;
+
+    pfd[0].fd = tun_fd;
+    pfd[1].fd = pump_fd;
+    pfd[2].fd = stop_pipe[0];
+    pfd[2].events = POLLIN;
+
+    for (;;) {
+        /* while a packet is held, the tun queue pushes back instead */
+        pfd[0].events = held ? 0 : POLLIN;
+        pfd[1].events = held ? POLLIN | POLLOUT : POLLIN;
+
+        ret = poll(pfd, 3, -1);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (pfd[2].revents)
+            break;
+
+        if (held && (pfd[1].revents & POLLOUT)) {
+            if (flush(out_buf) < 0)
+                break;
+        }
+
+        if (held == 0 && (pfd[0].revents & POLLIN)) {
+            if (forward(tun_fd, pump_fd, true, out_buf) < 0)
+                break;
+        }
+
+        if (pfd[1].revents & POLLIN) {
+            if (forward(pump_fd, tun_fd, false, in_buf) < 0)
+                break;
+        }
+
+        if ((pfd[0].revents | pfd[1].revents) & (POLLERR | POLLHUP | POLLNVAL))
+            break;
+    }
+
+    delete[]out_buf;
+    delete[]in_buf;
+}
+
+#endif                          // USE_TUN_PUMP
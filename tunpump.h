@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TUNPUMP_H
+#define TUNPUMP_H
+
+#include "common.h"
+#include "flowtable.h"
+#include "packetring.h"
+#include <QThread>
+#include <QString>
+#include <sys/types.h>
+
+#ifdef USE_TUN_PUMP
+
+/* The userspace data path: openconnect is given one end of a socket pair
+ * instead of the tun device, and this thread moves the packets between
+ * the other end and a tun device it owns, accounting each of them in the
+ * flow table. Packets are read into a single buffer per direction and
+ * written out of it; they are not copied in between.
+ *
+ * The thread never blocks outside poll(): when openconnect falls behind,
+ * the packet for it is held and the tun device is not read until it can
+ * be sent, and stop() is always served.
+ */
+class TunPump:public QThread {
+ public:
+    TunPump(FlowTable * flows, PacketRing * ring);
+    ~TunPump();
+
+    /* creates the tun device and the socket pair; returns zero on success */
+    int setup(QString & ifname, QString & err);
+    /* the same, with fd in place of the tun device (any descriptor that
+     * keeps packet boundaries will do, e.g. for a benchmark) */
+    int attach(int fd, QString & err);
+
+    /* the socket to pass to openconnect_setup_tun_fd() */
+    int get_vpn_fd() {
+        return vpn_fd;
+    }
+    /* once openconnect has taken it over; until then it is closed with
+     * the pump */
+    void release_vpn_fd() {
+        vpn_fd = -1;
+    }
+
+    void stop();
+
+ protected:
+    void run();
+
+ private:
+    int forward(int from, int to, bool outbound, uint8_t * buf);
+    int flush(uint8_t * buf);
+
+    FlowTable *flows;
+    PacketRing *ring;
+    int tun_fd;
+    int pump_fd;
+    int vpn_fd;
+    int stop_pipe[2];
+    ssize_t held;               /* outbound packet waiting for openconnect */
+};
+
+#endif                          // USE_TUN_PUMP
+
+#endif                          // TUNPUMP_H
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "vpncscript.h"
+#include "mainwindow.h"
+#include "scriptlog.h"
+#include <QProcess>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QCoreApplication>
+
+extern "C" {
+#include <string.h>
+}
+
+VpncScript::VpncScript(MainWindow * m)
+{
+    this->m = m;
+    this->script = QLatin1String(DEFAULT_VPNC_SCRIPT);
+    this->timeout = 0;
+}
+
+static QString mask_from_len(int len)
+{
+    quint32 mask = 0;
+
+    if (len > 0)
+        mask = 0xffffffffU << (32 - len);
+    return QHostAddress(mask).toString();
+}
+
+void VpncScript::set_split(const char *prefix, const char *prefix6,
+                           struct oc_split_include *list)
+{
+    QPair < QHostAddress, int >subnet;
+    QString var;
+    int n4 = 0, n6 = 0;
+
+    for (; list != NULL; list = list->next) {
+        subnet = QHostAddress::parseSubnet(QLatin1String(list->route));
+        if (subnet.first.isNull() == true)
+            continue;
+
+        if (subnet.first.protocol() == QAbstractSocket::IPv6Protocol) {
+            var = QLatin1String(prefix6) + "_" + QString::number(n6++);
+            env.insert(var + "_ADDR", subnet.first.toString());
+            env.insert(var + "_MASKLEN", QString::number(subnet.second));
+        } else {
+            var = QLatin1String(prefix) + "_" + QString::number(n4++);
+            env.insert(var + "_ADDR", subnet.first.toString());
+            env.insert(var + "_MASK", mask_from_len(subnet.second));
+            env.insert(var + "_MASKLEN", QString::number(subnet.second));
+            env.insert(var + "_PROTOCOL", "0");
+            env.insert(var + "_SPORT", "0");
+            env.insert(var + "_DPORT", "0");
+        }
+    }
+
+    if (n4 > 0)
+        env.insert(prefix, QString::number(n4));
+    if (n6 > 0)
+        env.insert(prefix6, QString::number(n6));
+}
+
+void VpncScript::prepare(struct openconnect_info *vpninfo, QString tundev,
+                         QString gateway)
+{
+    const struct oc_ip_info *info;
+    struct oc_split_include *dom;
+    QStringList dns4, dns6, nbns, domains;
+    QPair < QHostAddress, int >subnet;
+    int i;
+
+    env = QProcessEnvironment::systemEnvironment();
+    env.insert("VPNGATEWAY", gateway);
+    env.insert("VPNPID", QString::number(QCoreApplication::applicationPid()));
+    env.insert("TUNDEV", tundev);
+
+    if (openconnect_get_ip_info(vpninfo, &info, NULL, NULL) != 0)
+        return;
+
+    if (info->addr) {
+        env.insert("INTERNAL_IP4_ADDRESS", QLatin1String(info->addr));
+        if (info->mtu > 0)
+            env.insert("INTERNAL_IP4_MTU", QString::number(info->mtu));
+        if (info->netmask) {
+            subnet =
+                QHostAddress::parseSubnet(QLatin1String(info->addr) + "/" +
+                                          QLatin1String(info->netmask));
+            env.insert("INTERNAL_IP4_NETMASK", QLatin1String(info->netmask));
+            if (subnet.first.isNull() == false) {
+                env.insert("INTERNAL_IP4_NETMASKLEN",
+                           QString::number(subnet.second));
+                env.insert("INTERNAL_IP4_NETADDR", subnet.first.toString());
+            }
+        }
+    }
+
+    if (info->addr6) {
+        env.insert("INTERNAL_IP6_ADDRESS", QLatin1String(info->addr6));
+        if (info->netmask6)
+            env.insert("INTERNAL_IP6_NETMASK", QLatin1String(info->netmask6));
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (info->dns[i] == NULL)
+            continue;
+        if (strchr(info->dns[i], ':') != NULL)
+            dns6 << QLatin1String(info->dns[i]);
+        else
+            dns4 << QLatin1String(info->dns[i]);
+    }
+    if (dns4.isEmpty() == false)
+        env.insert("INTERNAL_IP4_DNS", dns4.join(" "));
+    if (dns6.isEmpty() == false)
+        env.insert("INTERNAL_IP6_DNS", dns6.join(" "));
+
+    for (i = 0; i < 3; i++) {
+        if (info->nbns[i])
+            nbns << QLatin1String(info->nbns[i]);
+    }
+    if (nbns.isEmpty() == false)
+        env.insert("INTERNAL_IP4_NBNS", nbns.join(" "));
+
+    if (info->domain)
+        env.insert("CISCO_DEF_DOMAIN", QLatin1String(info->domain));
+    if (info->proxy_pac)
+        env.insert("CISCO_PROXY_PAC", QLatin1String(info->proxy_pac));
+
+    for (dom = info->split_dns; dom != NULL; dom = dom->next)
+        domains << QLatin1String(dom->route);
+    if (domains.isEmpty() == false)
+        env.insert("CISCO_SPLIT_DNS", domains.join(","));
+
+    set_split("CISCO_SPLIT_INC", "CISCO_IPV6_SPLIT_INC", info->split_includes);
+    set_split("CISCO_SPLIT_EXC", "CISCO_IPV6_SPLIT_EXC", info->split_excludes);
+}
+
+int VpncScript::run(const char *reason)
+{
+    QProcess proc;
+    QStringList args;
+    QElapsedTimer timer;
+    QString line;
+    bool killed = false;
+
+    env.insert("reason", QLatin1String(reason));
+    proc.setProcessEnvironment(env);
+    proc.setProcessChannelMode(QProcess::MergedChannels);
+
+    args << "-c" << script;
+    timer.start();
+    proc.start("/bin/sh", args);
+    if (proc.waitForStarted() == false) {
+        m->updateProgressBar(QObject::tr("Could not run ") + script);
+        return -1;
+    }
+
+    while (proc.state() != QProcess::NotRunning) {
+        proc.waitForReadyRead(100);
+        while (proc.canReadLine()) {
+            line = QString::fromLocal8Bit(proc.readLine()).trimmed();
+            if (line.isEmpty() == false)
+                m->updateProgressBar(script_log_line(timer.elapsed(), line),
+                                     false);
+        }
+
+        if (timeout > 0 && timer.elapsed() > (qint64) timeout * 1000) {
+            m->updateProgressBar(QObject::tr("The vpnc-script (") +
+                                 QLatin1String(reason) +
+                                 QObject::tr(") did not finish in ") +
+                                 QString::number(timeout) +
+                                 QObject::tr(" s and was stopped"));
+            proc.kill();
+            proc.waitForFinished(-1);
+            killed = true;
+        }
+    }
+
+    line = QString::fromLocal8Bit(proc.readAll()).trimmed();
+    if (line.isEmpty() == false)
+        m->updateProgressBar(script_log_line(timer.elapsed(), line), false);
+
+    if (killed || proc.exitStatus() != QProcess::NormalExit)
+        return -1;
+
+    m->updateProgressBar(QObject::tr("The vpnc-script (") +
+                         QLatin1String(reason) +
+                         QObject::tr(") exited with status ") +
+                         QString::number(proc.exitCode()) +
+                         QObject::tr(" after ") +
+                         QString::number(timer.elapsed()) +
+                         QObject::tr(" ms"), false);
+    return proc.exitCode();
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VPNCSCRIPT_H
+#define VPNCSCRIPT_H
+
+#include <QString>
+#include <QStringList>
+#include <QProcessEnvironment>
+
+extern "C" {
+#include <openconnect.h>
+}
+
+/* Runs the vpnc-script for a tun device that was not set up by
+ * openconnect itself (see TunPump). The environment mirrors the one
+ * openconnect passes to the script, so the stock vpnc-script works
+ * unchanged.
+ */
+class VpncScript {
+ public:
+    VpncScript(class MainWindow * m);
+
+    /* captures the tunnel parameters; call once the CSTP channel is up */
+    void prepare(struct openconnect_info *vpninfo, QString tundev,
+                 QString gateway);
+    void set_tundev(QString tundev) {
+        env.insert("TUNDEV", tundev);
+    }
+    /* points the system at a local resolver instead of the VPN's; with
+     * split set that resolver handles the split domains itself */
+    void override_dns(QString addr, bool split) {
+        env.insert("INTERNAL_IP4_DNS", addr);
+        env.remove("INTERNAL_IP6_DNS");
+        if (split)
+            env.remove("CISCO_SPLIT_DNS");
+    }
+    /* seconds before a run is killed, zero for no limit */
+    void set_timeout(unsigned secs) {
+        timeout = secs;
+    }
+    /* runs the script with the given reason, logging its output as it
+     * comes; returns its exit code */
+    int run(const char *reason);
+
+    QString script;
+
+ private:
+    void set_split(const char *prefix, const char *prefix6,
+                   struct oc_split_include *list);
+
+    QProcessEnvironment env;
+    MainWindow *m;
+    unsigned timeout;
+};
+
+#endif                          // VPNCSCRIPT_H
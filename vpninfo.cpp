@@ -22,13 +22,23 @@
 extern "C" {
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <net/if.h>
+#endif
 }
 #include "gtdb.h"
+#include "vpnworker.h"
 #include <QMessageBox>
 #include <QInputDialog>
 #include <dialogs.h>
 #include <QApplication>
 #include <QDir>
+#include <QHostAddress>
+#include <QElapsedTimer>
 
 static void stats_vfn(void *privdata, const struct oc_stats *stats)
 {
@@ -36,12 +46,22 @@ static void stats_vfn(void *privdata, const struct oc_stats *stats)
     const char *cipher;
     QString dtls;
 
+    /* OC_CMD_STATS doubles as the wakeup for queued commands */
+    VpnWorker::process_commands();
+
+    vpn->update_dpd(stats);
+    vpn->check_resumed(stats);
+
     cipher = openconnect_get_dtls_cipher(vpn->vpninfo);
     if (cipher != NULL) {
-        dtls = QLatin1String(cipher);
+        dtls = QLatin1String(cipher) + QLatin1String(", ");
     }
+    dtls += vpn->update_transport();
 
-    vpn->m->updateStats(stats, dtls);
+    vpn->link.update(stats, vpn->ssl_fd, cipher != NULL, vpn->elapsed());
+
+    vpn->m->updateStats(stats, dtls, vpn->get_compression_info(),
+                        vpn->get_dns_cache_info());
 }
 
 static
@@ -64,20 +84,35 @@ void progress_vfn(void *privdata, int level, const char *fmt, ...)
     len = strlen(buf);
     if (buf[len - 1] == '\n')
         buf[len - 1] = 0;
+
     vpn->m->updateProgressBar(buf);
+
+    /* DTLS state changes are announced here before the next stats */
+    vpn->update_transport();
 }
 
 static
 int process_auth_form(void *privdata, struct oc_auth_form *form)
 {
     VpnInfo *vpn = static_cast < VpnInfo * >(privdata);
+    WaitScope wait(&vpn->timing);
     bool ok;
     QString text;
     struct oc_form_opt *opt;
     QStringList gitems;
     QStringList ditems;
+    QString form_id, key;
+    bool use_store;
     int i, idx;
 
+    vpn->reached_gateway = true;
+
+    /* the GUI may be waiting for this thread to exit */
+    if (vpn->m->disconnect_requested() == true)
+        return OC_FORM_RESULT_CANCELLED;
+
+    form_id = QLatin1String(form->auth_id ? form->auth_id : "");
+
     if (form->banner)
         vpn->m->updateProgressBar(QLatin1String(form->banner));
 
@@ -86,6 +121,13 @@ int process_auth_form(void *privdata, struct oc_auth_form *form)
 
     if (form->error) {
         vpn->m->updateProgressBar(QLatin1String(form->error));
+        /* the stored answers may be what was refused */
+        if (vpn->filled_fields.isEmpty() == false) {
+            for (i = 0; i < vpn->filled_fields.size(); i++)
+                vpn->ss->forget_form_answer(vpn->filled_fields.at(i));
+            vpn->ss->save();
+        }
+        vpn->auth_refused = true;
         return -1;
     }
 
@@ -133,13 +175,20 @@ int process_auth_form(void *privdata, struct oc_auth_form *form)
         }
     }
 
+    /* answers to a challenge that follows the first form change with
+     * each login, so they are neither stored nor replayed */
+    use_store = (vpn->forms_sent == 0);
+
     for (opt = form->opts; opt; opt = opt->next) {
         text.clear();
         if (opt->flags & OC_FORM_OPT_IGNORE)
             continue;
 
+        key = form_id + QLatin1String(":") + QLatin1String(opt->name);
+
         if (opt->type == OC_FORM_OPT_SELECT) {
             QStringList items;
+            QStringList names;
             struct oc_form_opt_select *select_opt =
                 reinterpret_cast < oc_form_opt_select * >(opt);
 
@@ -152,6 +201,17 @@ int process_auth_form(void *privdata, struct oc_auth_form *form)
 
             for (i = 0; i < select_opt->nr_choices; i++) {
                 items << select_opt->choices[i]->label;
+                names << select_opt->choices[i]->name;
+            }
+
+            /* a field filled from the store once already in this login
+             * was not accepted */
+            if (use_store == true && vpn->filled_fields.contains(key) == false
+                && vpn->ss->get_form_answer(key, text) == true
+                && names.contains(text) == true) {
+                openconnect_set_option_value(opt, text.toAscii().data());
+                vpn->filled_fields << key;
+                continue;
             }
 
             {
@@ -164,11 +224,13 @@ int process_auth_form(void *privdata, struct oc_auth_form *form)
             if (!ok)
                 goto fail;
 
-            idx = ditems.indexOf(text);
+            idx = items.indexOf(text);
             if (idx == -1)
                 goto fail;
 
             openconnect_set_option_value(opt, select_opt->choices[idx]->name);
+            if (use_store == true)
+                vpn->ss->set_form_answer(key, names.at(idx));
 
         } else if (opt->type == OC_FORM_OPT_TEXT) {
             vpn->m->updateProgressBar(QLatin1String("Text form: ") +
@@ -183,6 +245,15 @@ int process_auth_form(void *privdata, struct oc_auth_form *form)
                 continue;
             }
 
+            /* the username is kept by the profile itself */
+            if (use_store == true && strcasecmp(opt->name, "username") != 0
+                && vpn->filled_fields.contains(key) == false
+                && vpn->ss->get_form_answer(key, text) == true) {
+                openconnect_set_option_value(opt, text.toAscii().data());
+                vpn->filled_fields << key;
+                continue;
+            }
+
             do {
                 MyInputDialog dialog(vpn->m, QLatin1String(opt->name),
                                      QLatin1String(opt->label),
@@ -196,6 +267,8 @@ int process_auth_form(void *privdata, struct oc_auth_form *form)
 
             if (strcasecmp(opt->name, "username") == 0) {
                 vpn->ss->set_username(text);
+            } else if (use_store == true) {
+                vpn->ss->set_form_answer(key, text);
             }
 
             openconnect_set_option_value(opt, text.toAscii().data());
@@ -238,8 +311,10 @@ int process_auth_form(void *privdata, struct oc_auth_form *form)
         }
     }
 
+    vpn->forms_sent++;
     return OC_FORM_RESULT_OK;
  fail:
+    vpn->auth_refused = true;
     return OC_FORM_RESULT_CANCELLED;
 }
 
@@ -247,6 +322,7 @@ static
 int validate_peer_cert(void *privdata, const char *reason)
 {
     VpnInfo *vpn = static_cast < VpnInfo * >(privdata);
+    WaitScope wait(&vpn->timing);
     unsigned char *der;
     int der_size, ret;
     gnutls_datum_t raw;
@@ -257,6 +333,8 @@ int validate_peer_cert(void *privdata, const char *reason)
     bool save = false;
     bool ok;
 
+    vpn->reached_gateway = true;
+
     der_size = openconnect_get_peer_cert_DER(vpn->vpninfo, &der);
     if (der_size <= 0) {
         vpn->
@@ -286,6 +364,9 @@ int validate_peer_cert(void *privdata, const char *reason)
         free(details);
     }
 
+    if (ret != 0 && vpn->m->disconnect_requested() == true)
+        return -1;
+
     if (ret == GNUTLS_E_NO_CERTIFICATE_FOUND) {
         vpn->m->updateProgressBar(QObject::tr("peer is unknown"));
 
@@ -301,8 +382,10 @@ int validate_peer_cert(void *privdata, const char *reason)
         msgBox.show();
         ok = msgBox.result();
 
-        if (ok == false)
+        if (ok == false) {
+            vpn->auth_refused = true;
             return -1;
+        }
 
         save = true;
     } else if (ret == GNUTLS_E_CERTIFICATE_KEY_MISMATCH) {
@@ -320,14 +403,17 @@ int validate_peer_cert(void *privdata, const char *reason)
         msgBox.show();
         ok = msgBox.result();
 
-        if (ok == false)
+        if (ok == false) {
+            vpn->auth_refused = true;
             return -1;
+        }
 
         save = true;
     } else if (ret < 0) {
         str = QObject::tr("Could not verify certificate: ");
         str += gnutls_strerror(ret);
         vpn->m->updateProgressBar(str);
+        vpn->auth_refused = true;
         return -1;
     }
 
@@ -362,11 +448,25 @@ static int unlock_token_vfn(void *privdata, const char *newtok)
 {
     VpnInfo *vpn = static_cast < VpnInfo * >(privdata);
 
-    vpn->ss->set_token_str(newtok);
-    vpn->ss->save();
+    /* a full save is the fallback; the counter must not be reused */
+    if (vpn->ss->update_token_str(newtok) != 0)
+        vpn->ss->save();
     return 0;
 }
 
+/* called for every socket openconnect opens; the last stream socket is
+ * the one carrying the CSTP channel */
+static void protect_socket_vfn(void *privdata, int fd)
+{
+    VpnInfo *vpn = static_cast < VpnInfo * >(privdata);
+    int type = 0;
+    socklen_t len = sizeof(type);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, (char *)&type, &len) == 0
+        && type == SOCK_STREAM)
+        vpn->channel_opened(fd);
+}
+
 static inline int set_sock_block(int fd)
 {
 #ifdef _WIN32
@@ -400,7 +500,38 @@ VpnInfo::VpnInfo(QString name, class StoredServer * ss, class MainWindow * m)
     password_set = 0;
     form_attempt = 0;
     form_pass_attempt = 0;
+    forms_sent = 0;
+    auth_refused = false;
+    reached_gateway = false;
+    proxy_index = 0;
+#ifdef USE_REATTACH
+    reattached = false;
+#endif
+    this->ssl_fd = INVALID_SOCKET;
+    this->dpd = new DpdTuner(ss->get_dpd(), ss->get_adaptive_dpd());
+    this->session_timer.start();
+    this->compression = COMPRESSION_STATELESS;
+    this->tunnel_up = false;
+    this->paused = false;
+    this->pause_rx = 0;
+#ifdef USE_DNS_PROXY
+    this->dns_proxy = NULL;
+#endif
+#ifdef USE_SCRIPT_LOG
+    this->script_log = NULL;
+#endif
+#ifdef USE_NETLINK
+    this->net = NULL;
+    this->monitor = NULL;
+    this->net_changes = 0;
+    this->net_outage = 0;
+#endif
+#ifdef USE_TUN_PUMP
+    this->pump = NULL;
+    this->script = NULL;
+#endif
     openconnect_set_stats_handler(this->vpninfo, stats_vfn);
+    openconnect_set_protect_socket_handler(this->vpninfo, protect_socket_vfn);
     if (ss->get_token_str().isEmpty() == false) {
         openconnect_set_token_callbacks(this->vpninfo, this, lock_token_vfn,
                                         unlock_token_vfn);
@@ -412,11 +543,51 @@ VpnInfo::VpnInfo(QString name, class StoredServer * ss, class MainWindow * m)
 
 VpnInfo::~VpnInfo()
 {
+#ifdef USE_NETLINK
+    if (net) {
+        QElapsedTimer timer;
+
+        timer.start();
+        net->revert();
+        m->updateProgressBar(QObject::tr("Network configuration reverted in ")
+                             + QString::number(timer.elapsed()) +
+                             QObject::tr(" ms"), false);
+        delete net;
+    }
+#endif
+#ifdef USE_TUN_PUMP
+    /* the routes go before the tun device does */
+    if (script) {
+        script->run("disconnect");
+        delete script;
+    }
+    if (pump) {
+        pump->stop();
+        delete pump;
+    }
+#endif
+
+    /* runs the disconnect script when openconnect set up the tun */
     if (vpninfo)
         openconnect_vpninfo_free(vpninfo);
 
+#ifdef USE_SCRIPT_LOG
+    if (script_log) {
+        script_log->stop();
+        delete script_log;
+    }
+#endif
+#ifdef USE_DNS_PROXY
+    /* after the script has restored the system's resolvers */
+    if (dns_proxy) {
+        dns_proxy->stop();
+        delete dns_proxy;
+    }
+#endif
+
     if (this->ss)
         delete this->ss;
+    delete this->dpd;
 }
 
 void VpnInfo::parse_url(const char *url)
@@ -424,12 +595,110 @@ void VpnInfo::parse_url(const char *url)
     openconnect_parse_url(this->vpninfo, const_cast < char *>(url));
 }
 
+int VpnInfo::authenticate()
+{
+    int ret;
+
+    /* a failure before the gateway was reached may be the proxy's */
+    do {
+        reached_gateway = false;
+        ret = openconnect_obtain_cookie(vpninfo);
+    } while (ret != 0 && reached_gateway == false && next_proxy());
+
+    if (ret != 0) {
+        this->last_err =
+            QObject::tr("Authentication error; cannot obtain cookie");
+    }
+    return ret;
+}
+
+#ifdef USE_REATTACH
+/* sessions older than this are assumed to have expired on the gateway */
+#define SESSION_MAX_AGE (24*60*60)
+
+/* Resumes the session a previous, detached instance left on the gateway;
+ * the cookie is checked by the gateway when the CSTP channel is set up.
+ */
+bool VpnInfo::reattach()
+{
+    reattached = false;
+    if (ss->get_keep_session() == false
+        || ss->get_session_cookie().isEmpty() == true)
+        return false;
+
+    if (ss->get_session_age() > SESSION_MAX_AGE) {
+        ss->clear_session();
+        return false;
+    }
+
+    if (openconnect_parse_url(vpninfo,
+                              ss->get_session_url().toLocal8Bit().data()) != 0
+        || openconnect_set_cookie(vpninfo,
+                                  ss->get_session_cookie().toAscii().data())
+        != 0) {
+        parse_url(ss->get_servername().toLocal8Bit().data());
+        ss->clear_session();
+        return false;
+    }
+
+    m->updateProgressBar(QObject::tr("Resuming the session of ") +
+                         QString::number(ss->get_session_age() / 60) +
+                         QObject::tr(" minutes ago"));
+    reattached = true;
+    return true;
+}
+
+/* keeps the cookie for a later instance, and reports how a resumed
+ * session went */
+void VpnInfo::store_session()
+{
+    const struct oc_ip_info *info;
+    QString addr;
+
+    if (ss->get_keep_session() == false)
+        return;
+
+    if (openconnect_get_ip_info(vpninfo, &info, NULL, NULL) == 0
+        && info->addr != NULL)
+        addr = QLatin1String(info->addr);
+
+    if (reattached == true) {
+        m->updateProgressBar(QObject::tr("Reattached to the gateway in ") +
+                             QString::number(timing.get_total()) +
+                             QObject::tr(" ms, ") +
+                             (addr == ss->get_session_addr() ?
+                              QObject::tr("keeping the address ") :
+                              QObject::tr("with the new address ")) + addr);
+        return;
+    }
+
+    ss->set_session(QLatin1String(openconnect_get_cookie(vpninfo)),
+                    QLatin1String(openconnect_get_connect_url(vpninfo)),
+                    addr);
+    ss->save();
+}
+#endif
+
 int VpnInfo::connect()
 {
     int ret;
-    QString cert_file, key_file, tfile;
+    QString cert_file, key_file;
     QString ca_file;
+#ifdef USE_SCRIPT_LOG
+    std::string err;
+#else
+    QString tfile;
     bool status;
+#endif
+
+    timing.start();
+    setup_proxy();
+    timing.mark("proxy");
+
+    PinCache::instance()->set_timeout(ss->get_pin_cache());
+    if (ss->get_pin_cache() > 0 && PinCache::instance()->is_available() == false)
+        m->updateProgressBar(QObject::tr
+                             ("Token PINs are not kept: memory could not be locked"));
 
     cert_file = ss->get_cert_file();
     ca_file = ss->get_ca_cert_file();
@@ -450,25 +719,118 @@ int VpnInfo::connect()
 
     openconnect_set_reported_os(vpninfo, "win");
 
-    ret = openconnect_obtain_cookie(vpninfo);
-    if (ret != 0) {
-        this->last_err =
-            QObject::tr("Authentication error; cannot obtain cookie");
-        return ret;
+#ifdef USE_REATTACH
+    if (reattach() == false)
+#endif
+    {
+        ret = authenticate();
+        if (ret != 0)
+            return ret;
     }
+    timing.mark("auth");
+
+    apply_mtu();
+    apply_compression();
+    if (dpd->get_dpd() > 0)
+        openconnect_set_dpd(vpninfo, dpd->get_dpd());
 
     ret = openconnect_make_cstp_connection(vpninfo);
+#ifdef USE_REATTACH
+    if (ret != 0 && reattached == true) {
+        m->updateProgressBar(QObject::tr
+                             ("The previous session is gone; logging in"));
+        reattached = false;
+        ss->clear_session();
+        openconnect_clear_cookie(vpninfo);
+        parse_url(ss->get_servername().toLocal8Bit().data());
+        ret = authenticate();
+        if (ret != 0)
+            return ret;
+        ret = openconnect_make_cstp_connection(vpninfo);
+    }
+#endif
     if (ret != 0) {
         this->last_err = QObject::tr("Error establishing the CSTP channel");
         return ret;
     }
+    timing.mark("CSTP");
+#ifdef USE_REATTACH
+    store_session();
+#endif
+    /* keeps the token logged in for the reconnects */
+    if (key_file.startsWith("pkcs11:") == true)
+        PinCache::instance()->hold(key_file);
+
+    load_routes(m->get_routes());
+
+    script_cmd = DEFAULT_VPNC_SCRIPT;
+#ifdef USE_DNS_PROXY
+    if (ss->get_dns_cache() == true || ss->get_split_dns() == true)
+        setup_dns_proxy();
+    /* openconnect runs the script with /bin/sh -c, so assignments in
+     * front of it override the environment it sets */
+    if (dns_proxy != NULL && dns_proxy->get_split())
+        script_cmd.prepend("CISCO_SPLIT_DNS= ");
+    if (dns_proxy != NULL)
+        script_cmd.prepend("INTERNAL_IP4_DNS=" DNS_PROXY_ADDR
+                           " INTERNAL_IP6_DNS= ");
+#endif
+
+#ifdef USE_TUN_PUMP
+    if (ss->get_userspace_tun() == true) {
+        ret = setup_tun_pump();
+        if (ret == 0)
+            timing.mark("tun");
+        return ret;
+    }
+#endif
+
+#ifdef USE_NETLINK
+    /* the script still runs, but does nothing */
+    if (ss->get_native_config() == true)
+        script_cmd = ":";
+#endif
+
+#ifdef USE_SCRIPT_LOG
+    if (script_log == NULL && script_cmd != ":") {
+        script_log = new ScriptLog(m);
+        if (script_log->setup(err) != 0) {
+            m->updateProgressBar(QObject::tr
+                                 ("Could not set up the script log: ") +
+                                 QString::fromLocal8Bit(err.c_str()));
+            delete script_log;
+            script_log = NULL;
+        } else {
+            script_log->start();
+        }
+    }
+    if (script_log != NULL)
+        script_cmd = script_log->wrap(script_cmd, ss->get_script_timeout());
+#endif
 
-    ret = openconnect_setup_tun_device(vpninfo, DEFAULT_VPNC_SCRIPT, NULL);
+    ret = openconnect_setup_tun_device(vpninfo, script_cmd.data(), NULL);
     if (ret != 0) {
         this->last_err = QObject::tr("Error setting up the TUN device");
         return ret;
     }
+    if (openconnect_get_ifname(vpninfo))
+        tun_name = QLatin1String(openconnect_get_ifname(vpninfo));
+
+#ifdef USE_NETLINK
+    if (ss->get_native_config() == true
+        && configure_native(QLatin1String(openconnect_get_ifname(vpninfo)))
+        != 0) {
+        this->script = new_script(QLatin1String
+                                  (openconnect_get_ifname(vpninfo)));
+        if (this->script->run("connect") != 0) {
+            this->last_err = QObject::tr("Error running the vpnc-script");
+            return -1;
+        }
+    }
+#endif
+    timing.mark("tun");
 
+#ifndef USE_SCRIPT_LOG
     /* now read %temp%\\vpnc.log and post it to our log */
     tfile = QDir::tempPath() + QLatin1String("/vpnc.log");
     QFile file(tfile);
@@ -492,36 +854,521 @@ int VpnInfo::connect()
     } else {
         this->m->updateProgressBar(QLatin1String("Could not open ") + tfile + ": " + QString::number((int)file.error()));
     }
+#endif
+
+    return 0;
+}
+
+#ifdef USE_TUN_PUMP
+/* Creates the tun device ourselves and hands openconnect a socket that is
+ * pumped to it, so that every packet passes through the flow table.
+ */
+int VpnInfo::setup_tun_pump()
+{
+    QString ifname, err;
+    bool native = false;
+    int ret;
+
+#ifdef USE_NETLINK
+    native = ss->get_native_config();
+#endif
+    if (native == false) {
+        this->script = new_script(QString());
+        this->script->run("pre-init");
+    }
+
+    this->pump = new TunPump(m->get_flows(), m->get_capture());
+    ret = this->pump->setup(ifname, err);
+    if (ret != 0) {
+        this->last_err = err;
+        goto fail;
+    }
+
+    this->m->updateProgressBar(QObject::tr("Using tun device ") + ifname);
+    tun_name = ifname;
+#ifdef USE_NETLINK
+    if (native == true && configure_native(ifname) != 0) {
+        native = false;
+        this->script = new_script(ifname);
+    }
+#endif
+    if (native == false) {
+        this->script->set_tundev(ifname);
+        ret = this->script->run("connect");
+        if (ret != 0) {
+            this->last_err = QObject::tr("Error running the vpnc-script");
+            goto fail;
+        }
+    }
+
+    ret = openconnect_setup_tun_fd(vpninfo, this->pump->get_vpn_fd());
+    if (ret != 0) {
+        this->last_err = QObject::tr("Error setting up the TUN device");
+        if (this->script)
+            this->script->run("disconnect");
+        goto fail;
+    }
+    this->pump->release_vpn_fd();
+
+    m->get_flows()->clear();
+    this->pump->start();
+    return 0;
+
+ fail:
+    delete this->script;
+    this->script = NULL;
+    delete this->pump;
+    this->pump = NULL;
+    return -1;
+}
+
+/* a runner of the vpnc-script with the session's environment */
+VpncScript *VpnInfo::new_script(QString ifname)
+{
+    VpncScript *s = new VpncScript(this->m);
+
+    s->prepare(vpninfo, ifname, get_gateway());
+    s->set_timeout(ss->get_script_timeout());
+#ifdef USE_DNS_PROXY
+    if (dns_proxy != NULL)
+        s->override_dns(QLatin1String(DNS_PROXY_ADDR),
+                        dns_proxy->get_split());
+#endif
+    return s;
+}
+#endif
+
+#ifdef USE_NETLINK
+/* Applies the addresses, routes and DNS of the session to the tun device
+ * without the vpnc-script. On failure nothing is left applied, and the
+ * caller falls back to the script.
+ */
+int VpnInfo::configure_native(QString ifname)
+{
+    const struct oc_ip_info *info;
+    QElapsedTimer timer;
+    std::string err;
+    const char *dns = NULL;
+
+#ifdef USE_DNS_PROXY
+    if (dns_proxy != NULL)
+        dns = DNS_PROXY_ADDR;
+#endif
+
+    timer.start();
+    net = new NetConfig();
+    if (openconnect_get_ip_info(vpninfo, &info, NULL, NULL) != 0) {
+        info = NULL;
+        err = "no IP configuration";
+    }
+    if (info == NULL || net->apply(info, ifname.toAscii().data(),
+                                   get_gateway().toAscii().data(), dns,
+                                   err) != 0) {
+        m->updateProgressBar(QObject::tr
+                             ("Could not configure the network, using the vpnc-script: ")
+                             + QString::fromLocal8Bit(err.c_str()));
+        delete net;
+        net = NULL;
+        return -1;
+    }
 
+    m->updateProgressBar(QObject::tr("Network configured in ") +
+                         QString::number(timer.elapsed()) +
+                         QObject::tr(" ms (") +
+                         QString::number(net->get_changes()) +
+                         QObject::tr(" changes)"), false);
     return 0;
 }
+#endif
+
+/* IP, UDP and DTLS headers, the cipher's IV, MAC and padding, and the
+ * CSTP header; the tunnel must fit in the path with either transport */
+#define TUNNEL_OVERHEAD 94
+#define TUNNEL_OVERHEAD6 (TUNNEL_OVERHEAD + 20)
+#define MIN_TUNNEL_MTU 576
+
+/* Measures the path MTU to the gateway before the tunnel is negotiated,
+ * when the profile asks for it, and requests a tunnel MTU that fits in
+ * it. If probing is disabled or fails, the value measured on an earlier
+ * connection is used.
+ */
+void VpnInfo::apply_mtu()
+{
+    int pmtu, mtu;
+    bool ipv6 = false;
+
+#ifdef USE_MTU_PROBE
+    if (ss->get_mtu_probe() == true) {
+        IcmpMtuProbe probe;
+        std::string err;
+        QElapsedTimer timer;
+
+        timer.start();
+        if (probe.open(openconnect_get_hostname(vpninfo), err) != 0) {
+            m->updateProgressBar(QObject::tr("Path MTU probe failed: ") +
+                                 QString::fromLocal8Bit(err.c_str()));
+        } else {
+            pmtu = probe.run();
+            ipv6 = probe.is_ipv6();
+            if (pmtu > 0) {
+                ss->set_path_mtu(pmtu);
+                m->updateProgressBar(QObject::tr("Path MTU: ") +
+                                     QString::number(pmtu) +
+                                     QObject::tr(" (probed in ") +
+                                     QString::number(timer.elapsed()) +
+                                     QObject::tr(" ms)"));
+            } else {
+                m->updateProgressBar(QObject::tr
+                                     ("Path MTU probes got no reply after ") +
+                                     QString::number(timer.elapsed()) +
+                                     QObject::tr(" ms"));
+            }
+        }
+    } else
+#endif
+    {
+        ipv6 = get_gateway().contains(':');
+    }
+
+    pmtu = ss->get_path_mtu();
+    if (pmtu <= 0)
+        return;
+
+    mtu = pmtu - (ipv6 ? TUNNEL_OVERHEAD6 : TUNNEL_OVERHEAD);
+    if (mtu < MIN_TUNNEL_MTU)
+        mtu = MIN_TUNNEL_MTU;
+    openconnect_set_reqmtu(vpninfo, mtu);
+}
 
 int VpnInfo::dtls_connect()
 {
     int ret;
 
     if (this->ss->get_disable_udp() != true) {
-        ret = openconnect_setup_dtls(vpninfo, 60);
+        ret = openconnect_setup_dtls(vpninfo,
+                                     ss->get_dtls_attempt_period());
         if (ret != 0) {
             this->last_err = QObject::tr("Error setting up DTLS");
             return ret;
         }
+        timing.mark("DTLS");
     }
 
     return 0;
 }
 
-void VpnInfo::mainloop()
+int VpnInfo::mainloop()
 {
     int ret;
 
+    this->tunnel_up = true;
+    update_transport();
+#ifdef USE_NETLINK
+    if (ss->get_net_monitor() == true)
+        start_monitor();
+#endif
+
+    m->updateProgressBar(QObject::tr("Connected in ") + timing.summary() +
+                         (timing.get_attempts() > 1 ?
+                          QObject::tr(", attempt ") +
+                          QString::number(timing.get_attempts()) :
+                          QString()), false);
+
     while (1) {
-        ret = openconnect_mainloop(vpninfo, 15, RECONNECT_INTERVAL_MIN);
+        ret = openconnect_mainloop(vpninfo, ss->get_reconnect_timeout(),
+                                   RECONNECT_INTERVAL_MIN);
         if (ret != 0) {
             this->last_err = QObject::tr("Disconnected");
             break;
         }
+        /* paused: on a network change, or by the user; the channel is
+         * reconnected by the next call */
+        this->paused = true;
+        this->pause_rx = (uint64_t) - 1;
+    }
+
+#ifdef USE_REATTACH
+    /* a detached session is resumed by the next start; on any other end
+     * it was logged off, or is of no use */
+    if (ret != -ECONNABORTED && ss->get_session_cookie().isEmpty() == false) {
+        ss->clear_session();
+        ss->save();
+    }
+#endif
+
+#ifdef USE_NETLINK
+    if (monitor) {
+        monitor->stop();
+        delete monitor;
+        monitor = NULL;
+    }
+    if (net_changes > 0)
+        m->updateProgressBar(QObject::tr("Network changes followed: ") +
+                             QString::number(net_changes) +
+                             QObject::tr(", average outage ") +
+                             QString::number(net_outage / net_changes) +
+                             QObject::tr(" ms"), false);
+#endif
+
+    if (link.get_peak_throughput() > 0) {
+        m->updateProgressBar(QObject::tr("Peak tunnel throughput ") +
+                             QString::number(link.get_peak_throughput() /
+                                             1000) +
+                             QObject::tr(" kB/s, link rate ") +
+                             QString::number(link.get_link_rate() / 1000) +
+                             QObject::tr(" kB/s, CPU allows ") +
+                             QString::number(link.get_cpu_rate() / 1000) +
+                             QObject::tr(" kB/s"), false);
+    }
+    /* a short session keeps the previous measurements */
+    if (link.get_link_rate() > 0 && link.get_cpu_rate() > 0) {
+        ss->set_link_stats(link.get_link_rate(), link.get_cpu_rate());
+        ss->save();
+    }
+
+    if (dpd->get_latencies().empty() == false)
+        m->updateProgressBar(QObject::tr("Dead peers detected: ") +
+                             QString::number(dpd->get_latencies().size()) +
+                             QObject::tr(", average detection latency ") +
+                             QString::number(dpd->get_average_latency()) +
+                             QObject::tr(" ms"), false);
+    return ret;
+}
+
+/* Compression spends CPU time of the session thread to save bytes on the
+ * link. Where the thread could move payload many times faster than the
+ * link carries it, the CPU is there to spare and everything is
+ * compressed; where the two are close, compressing would make the thread
+ * the bottleneck. The CPU rate was measured under the last session's
+ * mode, so a mode that strained the CPU steps itself down. The figures
+ * are the CPU rate over the link rate.
+ */
+#define AUTO_HEADROOM_ALL 8
+#define AUTO_HEADROOM_STATELESS 3
+
+static const char *compression_names[] = { "none", "stateless", "all" };
+
+void VpnInfo::apply_compression()
+{
+    unsigned rate, cpu_rate;
+
+    compression = ss->get_compression();
+    if (compression < COMPRESSION_NONE || compression > COMPRESSION_AUTO)
+        compression = COMPRESSION_STATELESS;
+
+    if (compression == COMPRESSION_AUTO) {
+        rate = ss->get_link_rate();
+        cpu_rate = ss->get_link_cpu_rate();
+
+        if (rate == 0 || cpu_rate == 0)
+            compression = COMPRESSION_STATELESS;
+        else if (cpu_rate / rate >= AUTO_HEADROOM_ALL)
+            compression = COMPRESSION_ALL;
+        else if (cpu_rate / rate >= AUTO_HEADROOM_STATELESS)
+            compression = COMPRESSION_STATELESS;
+        else
+            compression = COMPRESSION_NONE;
+
+        m->updateProgressBar(QObject::tr("Compression ") +
+                             QLatin1String(compression_names[compression]) +
+                             QObject::tr(" chosen for a link of ") +
+                             QString::number(rate / 1000) +
+                             QObject::tr(" kB/s and a CPU rate of ") +
+                             QString::number(cpu_rate / 1000) +
+                             QObject::tr(" kB/s on the last connection"),
+                             false);
+    }
+
+    openconnect_set_compression_mode(vpninfo,
+                                     (oc_compression_mode_t) compression);
+}
+
+QString VpnInfo::get_compression_info()
+{
+    QString str;
+    double ratio;
+
+    str = QLatin1String(compression_names[compression]);
+
+    /* framing less what compression saved, over TCP */
+    ratio = link.get_wire_ratio();
+    if (ratio >= 0)
+        str += QObject::tr(", TCP wire overhead ") +
+            QString::number((ratio - 1) * 100, 'f', 0) + QLatin1String("%");
+
+    str += QObject::tr(", CPU ") +
+        QString::number(link.get_cpu_ms() / 1000.0, 'f', 1) +
+        QObject::tr(" s");
+    return str;
+}
+
+static QString percent(uint64_t part, uint64_t total)
+{
+    if (total == 0)
+        return QLatin1String("0%");
+    return QString::number((unsigned)(part * 100 / total)) +
+        QLatin1String("%");
+}
+
+QString VpnInfo::update_transport()
+{
+    uint64_t now = elapsed(), udp, tcp;
+    uint64_t prev = transport.get_since();
+    QString str;
+
+    if (this->tunnel_up == false)
+        return str;
+
+    if (transport.update(openconnect_get_dtls_cipher(vpninfo) != NULL, now)) {
+        if (transport.get_state() == TRANSPORT_DTLS) {
+            if (transport.was_restored())
+                str = QObject::tr("DTLS restored after ") +
+                    QString::number((now - prev) / 1000) +
+                    QObject::tr(" s over TCP");
+            else
+                str = QObject::tr("DTLS up; data goes over UDP");
+        } else if (prev != 0 || transport.get_fallbacks() > 0) {
+            str = QObject::tr("DTLS down; data falls back to TCP");
+            channel_lost();
+        } else {
+            str = QObject::tr("Data goes over TCP until DTLS is up");
+        }
+        m->updateProgressBar(str);
+    }
+
+    udp = transport.get_time(TRANSPORT_DTLS, now);
+    tcp = transport.get_time(TRANSPORT_CSTP, now);
+
+    if (transport.get_state() == TRANSPORT_DTLS)
+        str = QObject::tr("UDP");
+    else
+        str = QObject::tr("TCP");
+    str += QObject::tr(" for ") +
+        QString::number((now - transport.get_since()) / 1000) +
+        QObject::tr(" s, UDP ") + percent(udp, udp + tcp) +
+        QObject::tr(" of the time");
+    if (transport.get_fallbacks() > 0)
+        str += QObject::tr(", ") + QString::number(transport.get_fallbacks()) +
+            QObject::tr(" fallbacks to TCP");
+    return str;
+}
+
+/* called from the stats callback, which the GUI triggers periodically */
+void VpnInfo::update_dpd(const struct oc_stats *stats)
+{
+    if (dpd->update(stats->rx_pkts, stats->tx_pkts, elapsed()) == false)
+        return;
+
+    openconnect_set_dpd(vpninfo, dpd->get_dpd());
+    m->updateProgressBar(QObject::tr("DPD interval set to ") +
+                         QString::number(dpd->get_dpd()) + QObject::tr(" s"),
+                         false);
+}
+
+/* Called for every CSTP connection openconnect makes. Once the tunnel is
+ * up, one that no pause of ours asked for replaces a channel that was
+ * lost.
+ */
+void VpnInfo::channel_opened(SOCKET fd)
+{
+    this->ssl_fd = fd;
+
+    if (this->tunnel_up == false || this->paused)
+        return;
+    channel_lost();
+}
+
+/* The reconnect after a pause is over when packets are received again;
+ * until then DTLS going down is part of it. The counters of the first
+ * update after the pause are the reference: the ones before may be stale.
+ */
+void VpnInfo::check_resumed(const struct oc_stats *stats)
+{
+    if (this->paused == false)
+        return;
+    if (this->pause_rx == (uint64_t) - 1) {
+        this->pause_rx = stats->rx_pkts;
+        return;
+    }
+    if (stats->rx_pkts == this->pause_rx)
+        return;
+    this->paused = false;
+    path_restored();
+}
+
+/* The CSTP channel was replaced, or DTLS fell back to TCP, on openconnect's
+ * own account. Its DPD declares a peer dead after two intervals without
+ * a received packet, so a loss after less than one (as seen by the stats
+ * updates) was a rekey or a close by the server.
+ */
+void VpnInfo::channel_lost()
+{
+    unsigned interval = dpd->get_dpd();
+
+    if (this->paused)
+        return;
+    if (interval == 0)
+        interval = DPD_MIN;
+    if (dpd->get_silence(elapsed()) < (uint64_t) interval * 1000)
+        return;
+    dead_peer();
+}
+
+void VpnInfo::dead_peer()
+{
+    bool changed = dpd->dead_peer(elapsed());
+
+    /* the latency is measured from the last stats update that saw
+     * received packets */
+    m->updateProgressBar(QObject::tr("Dead peer detected ") +
+                         QString::number(dpd->get_latencies().empty()? 0 :
+                                         dpd->get_latencies().back()) +
+                         QObject::tr(" ms after the last received packet"),
+                         false);
+    if (changed)
+        openconnect_set_dpd(vpninfo, dpd->get_dpd());
+}
+
+#ifdef USE_NETLINK
+/* watches for network changes; the session is paused through the same
+ * command pipe as the GUI uses */
+void VpnInfo::start_monitor()
+{
+    std::string err;
+    int ifindex = 0;
+
+    if (tun_name.isEmpty() == false)
+        ifindex = if_nametoindex(tun_name.toAscii().data());
+
+    monitor = new NetMonitor(cmd_fd, ifindex);
+    if (monitor->setup(err) != 0) {
+        m->updateProgressBar(QObject::tr
+                             ("Could not watch for network changes: ") +
+                             QString::fromLocal8Bit(err.c_str()));
+        delete monitor;
+        monitor = NULL;
+        return;
     }
+    monitor->start();
+}
+#endif
+
+void VpnInfo::path_restored()
+{
+#ifdef USE_NETLINK
+    std::string reason;
+    uint64_t ms;
+
+    if (monitor == NULL || monitor->restored(&ms, reason) == false)
+        return;
+
+    net_changes++;
+    net_outage += ms;
+    m->updateProgressBar(QObject::tr("Tunnel restored ") +
+                         QString::number(ms) +
+                         QObject::tr(" ms after a network change (") +
+                         QLatin1String(reason.c_str()) + QLatin1String(")"));
+#endif
 }
 
 void VpnInfo::get_info(QString & dns, QString & ip, QString & ip6)
@@ -554,10 +1401,273 @@ void VpnInfo::get_info(QString & dns, QString & ip, QString & ip6)
             dns += " ";
             dns += info->dns[2];
         }
+#ifdef USE_DNS_PROXY
+        if (dns_proxy != NULL && dns_proxy->get_split())
+            dns = QLatin1String(DNS_PROXY_ADDR) + QObject::tr(" (") + dns +
+                QObject::tr(" for ") +
+                QString::number(dns_proxy->get_split_domains()) +
+                QObject::tr(" split domains)");
+        else if (dns_proxy != NULL)
+            dns = QLatin1String(DNS_PROXY_ADDR) +
+                QObject::tr(" (caching for ") + dns + QLatin1String(")");
+#endif
     }
     return;
 }
 
+#ifdef USE_DNS_PROXY
+/* Starts the stub for the VPN's DNS servers. On failure the servers are
+ * used directly, as without it. With split DNS the system's resolvers are
+ * read before the script replaces them.
+ */
+void VpnInfo::setup_dns_proxy()
+{
+    const struct oc_ip_info *info;
+    struct oc_split_include *dom;
+    QElapsedTimer timer;
+    std::string err;
+    unsigned n;
+    int i;
+
+    if (openconnect_get_ip_info(this->vpninfo, &info, NULL, NULL) != 0)
+        return;
+
+    if (ss->get_dns_cache() == false && info->split_dns == NULL)
+        return;
+
+    dns_proxy = new DnsProxy();
+    dns_proxy->set_cache(ss->get_dns_cache());
+    for (i = 0; i < 3; i++) {
+        if (info->dns[i])
+            dns_proxy->add_server(info->dns[i]);
+    }
+
+    if (ss->get_split_dns() == true && info->split_dns != NULL) {
+        timer.start();
+        for (dom = info->split_dns; dom != NULL; dom = dom->next)
+            dns_proxy->add_split_domain(dom->route);
+        /* the search domain is completed to internal names */
+        if (info->domain)
+            dns_proxy->add_split_domain(info->domain);
+        n = dns_proxy->add_local_servers("/etc/resolv.conf");
+        if (n == 0)
+            n = dns_proxy->add_local_servers(RESOLVED_CONF);
+
+        if (n == 0)
+            m->updateProgressBar(QObject::tr
+                                 ("Split DNS is inactive: no local DNS servers other than loopback ones were found; all names are resolved through the VPN"));
+        else
+            m->updateProgressBar(QObject::tr("Split DNS: ") +
+                                 QString::number(dns_proxy->
+                                                 get_split_domains()) +
+                                 QObject::tr(" domains compiled in ") +
+                                 QString::number(timer.nsecsElapsed() /
+                                                 1000) +
+                                 QObject::tr(" us"), false);
+    }
+
+    if (dns_proxy->get_split() == false && ss->get_dns_cache() == false) {
+        delete dns_proxy;
+        dns_proxy = NULL;
+        return;
+    }
+
+    if (dns_proxy->setup(err) != 0) {
+        m->updateProgressBar(QObject::tr("Could not start the DNS cache: ") +
+                             QString::fromLocal8Bit(err.c_str()));
+        delete dns_proxy;
+        dns_proxy = NULL;
+        return;
+    }
+    dns_proxy->start();
+}
+#endif
+
+QString VpnInfo::get_dns_cache_info()
+{
+    QString str;
+#ifdef USE_DNS_PROXY
+    struct dns_stats s;
+
+    if (dns_proxy == NULL)
+        return str;
+
+    dns_proxy->get_stats(&s);
+    str = QString::number(s.queries) + QObject::tr(" queries, ");
+    if (s.queries > 0)
+        str += QString::number(s.hits * 100 / s.queries);
+    else
+        str += QLatin1String("0");
+    str += QObject::tr("% from cache, ") + QString::number(s.coalesced) +
+        QObject::tr(" coalesced, ") + QString::number(s.failed) +
+        QObject::tr(" failed, ") + QString::number(s.entries) +
+        QObject::tr(" entries");
+    if (dns_proxy->get_split() && s.forwarded > 0)
+        str += QObject::tr("; ") + QString::number(s.local) +
+            QObject::tr(" local, ") +
+            QString::number(s.route_ns / s.forwarded) +
+            QObject::tr(" ns per split lookup");
+#endif
+    return str;
+}
+
+static unsigned add_split_routes(RouteTable * routes,
+                                 struct oc_split_include *list, bool exclude)
+{
+    QPair < QHostAddress, int >subnet;
+    Q_IPV6ADDR a6;
+    quint32 a4;
+    uint8_t addr[4];
+    unsigned n = 0;
+
+    for (; list != NULL; list = list->next) {
+        subnet = QHostAddress::parseSubnet(QLatin1String(list->route));
+        if (subnet.first.isNull() == true)
+            continue;
+
+        if (subnet.first.protocol() == QAbstractSocket::IPv6Protocol) {
+            a6 = subnet.first.toIPv6Address();
+            routes->add(a6.c, 6, subnet.second, exclude);
+        } else {
+            a4 = subnet.first.toIPv4Address();
+            addr[0] = a4 >> 24;
+            addr[1] = a4 >> 16;
+            addr[2] = a4 >> 8;
+            addr[3] = a4;
+            routes->add(addr, 4, subnet.second, exclude);
+        }
+        n++;
+    }
+    return n;
+}
+
+void VpnInfo::load_routes(RouteTable * routes)
+{
+    const struct oc_ip_info *info;
+    struct oc_split_include *dom;
+    QStringList domains;
+    QElapsedTimer timer;
+    unsigned n;
+
+    routes->clear();
+    if (openconnect_get_ip_info(this->vpninfo, &info, NULL, NULL) != 0)
+        return;
+
+    timer.start();
+    n = add_split_routes(routes, info->split_includes, false);
+    n += add_split_routes(routes, info->split_excludes, true);
+
+    for (dom = info->split_dns; dom != NULL; dom = dom->next)
+        domains << QLatin1String(dom->route);
+    routes->set_domains(domains);
+
+    if (n > 0)
+        this->m->updateProgressBar(QObject::tr("Compiled ") +
+                                   QString::number(n) +
+                                   QObject::tr(" split routes in ") +
+                                   QString::number(timer.nsecsElapsed() /
+                                                   1000) +
+                                   QObject::tr(" us"), false);
+}
+
+/* ms to wait for a proxy when there are others to fall back to */
+#define PROXY_PROBE_TIMEOUT 2000
+
+/* Finds the system proxy for the gateway; this may have to fetch and run
+ * a PAC script, so it runs here rather than on the GUI thread. Of several
+ * proxies the first one that answers is used.
+ */
+void VpnInfo::setup_proxy()
+{
+    QElapsedTimer timer;
+    bool cached;
+
+    timer.start();
+    proxies = m->get_proxy_cache()->lookup(QLatin1String
+                                           (openconnect_get_hostname
+                                            (vpninfo)), &cached);
+    if (cached == false)
+        m->updateProgressBar(QObject::tr("Proxy discovery took ") +
+                             QString::number(timer.elapsed()) +
+                             QObject::tr(" ms"), false);
+    if (proxies.isEmpty())
+        return;
+
+    proxy_index = ProxyCache::pick(proxies, PROXY_PROBE_TIMEOUT);
+    if (proxy_index > 0)
+        m->updateProgressBar(QObject::tr("Skipped ") +
+                             QString::number(proxy_index) +
+                             QObject::tr(" unreachable proxies"));
+    if (proxies.at(proxy_index).url.isEmpty())
+        return;
+
+    m->updateProgressBar(QObject::tr("Setting proxy to: ") +
+                         ProxyCache::display(proxies.at(proxy_index)));
+    openconnect_set_http_proxy(vpninfo,
+                               proxies.at(proxy_index).url.toAscii().data());
+}
+
+/* Moves on to the next proxy the system offers after the gateway could
+ * not be reached through the current one, e.g. when the proxy refused the
+ * CONNECT. A direct connection is not among the choices: openconnect
+ * cannot drop a proxy once it is set. Returns false if none is left.
+ */
+bool VpnInfo::next_proxy()
+{
+    QString failed;
+
+    if (proxy_index >= proxies.size())
+        return false;
+    failed = ProxyCache::display(proxies.at(proxy_index));
+
+    while (++proxy_index < proxies.size()) {
+        if (proxies.at(proxy_index).url.isEmpty())
+            continue;
+
+        m->updateProgressBar(QObject::tr("Could not reach the gateway via ") +
+                             failed + QObject::tr("; trying ") +
+                             ProxyCache::display(proxies.at(proxy_index)));
+        openconnect_set_http_proxy(vpninfo,
+                                   proxies.at(proxy_index).url.toAscii().
+                                   data());
+        return true;
+    }
+    return false;
+}
+
+QString VpnInfo::get_gateway()
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    char host[NI_MAXHOST];
+
+    if (this->ssl_fd == INVALID_SOCKET)
+        return QString();
+
+    if (getpeername(this->ssl_fd, (struct sockaddr *)&addr, &len) != 0)
+        return QString();
+
+    if (getnameinfo((struct sockaddr *)&addr, len, host, sizeof(host), NULL,
+                    0, NI_NUMERICHOST) != 0)
+        return QString();
+
+    return QLatin1String(host);
+}
+
+void VpnInfo::get_mtu(QString & mtu)
+{
+    const struct oc_ip_info *info;
+
+    if (openconnect_get_ip_info(this->vpninfo, &info, NULL, NULL) != 0)
+        return;
+
+    if (info->mtu > 0)
+        mtu = QString::number(info->mtu);
+    if (ss->get_path_mtu() > 0)
+        mtu += QObject::tr(" (path ") + QString::number(ss->get_path_mtu()) +
+            QLatin1String(")");
+}
+
 void VpnInfo::get_cipher_info(QString & cstp, QString & dtls)
 {
     const char *cipher;
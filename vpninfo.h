@@ -22,10 +22,31 @@
 
 #include <mainwindow.h>
 #include <storage.h>
+#include "tunpump.h"
+#include "vpncscript.h"
+#include "mtuprobe.h"
+#include "dpdtuner.h"
+#include "linkstats.h"
+#include "transportlog.h"
+#include "dnsproxy.h"
+#include "phasetimer.h"
+#include "scriptlog.h"
+#include "netconfig.h"
+#include "netmonitor.h"
+#include "pincache.h"
+#include <QElapsedTimer>
 
 extern "C" {
 #include <openconnect.h>
-} class VpnInfo {
+}
+
+/* a session can be left on the gateway and resumed by a later start
+ * when its cookie can be handed to a new vpninfo */
+#if OPENCONNECT_CHECK_VER(5,7)
+#define USE_REATTACH
+#endif
+
+class VpnInfo {
  public:
     explicit VpnInfo(QString name, class StoredServer * ss,
                      class MainWindow * m);
@@ -33,9 +54,11 @@ extern "C" {
     void parse_url(const char *url);
     int connect();
     int dtls_connect();
-    void mainloop();
+    /* returns the error that ended the session */
+    int mainloop();
     void get_info(QString & dns, QString & ip, QString & ip6);
     void get_cipher_info(QString & cstp, QString & dtls);
+    void get_mtu(QString & mtu);
     SOCKET get_cmd_fd() {
         return cmd_fd;
     }
@@ -45,11 +68,20 @@ extern "C" {
         password_set = 0;
         authgroup_set = 0;
         form_attempt = 0;
+        forms_sent = 0;
+        filled_fields.clear();
+        auth_refused = false;
     }
     bool get_minimize() {
         return ss->get_minimize();
     }
 
+    /* compiles the split include/exclude lists of the session */
+    void load_routes(RouteTable * routes);
+
+    /* the numeric address of the server the CSTP channel is connected to */
+    QString get_gateway();
+
     QString last_err;
     MainWindow *m;
     StoredServer *ss;
@@ -58,8 +90,90 @@ extern "C" {
     unsigned int password_set;
     unsigned int form_attempt;
     unsigned int form_pass_attempt;
+    /* forms submitted during this login; only answers to the first are
+     * stored, as later ones are usually challenges */
+    unsigned int forms_sent;
+    /* fields filled from the answer store during this login, as
+     * "form:field" */
+    QStringList filled_fields;
+    /* a form or the server certificate was refused, by the user or the
+     * server; the session must not be re-established unattended */
+    bool auth_refused;
+    /* the gateway asked for a form or had its certificate checked: the
+     * connection got through any proxy */
+    bool reached_gateway;
+    SOCKET ssl_fd;
+
+    /* session time in ms, for the DPD statistics */
+    uint64_t elapsed() {
+        return session_timer.elapsed();
+    }
+    void update_dpd(const struct oc_stats *stats);
+    /* the compression mode and its measured effect */
+    QString get_compression_info();
+
+    LinkStats link;
+    /* the latency of the connection phases */
+    PhaseTimer timing;
+
+    /* records DTLS/CSTP transitions; returns a summary for the GUI */
+    QString update_transport();
+    QString get_dns_cache_info();
+    /* a new CSTP connection was opened on fd */
+    void channel_opened(SOCKET fd);
+    /* ends a pause once packets are received again */
+    void check_resumed(const struct oc_stats *stats);
  private:
+    void setup_proxy();
+    bool next_proxy();
+    QList < proxy_entry > proxies;
+    int proxy_index;
+    int authenticate();
+#ifdef USE_REATTACH
+    bool reattach();
+    void store_session();
+    bool reattached;
+#endif
+    void apply_mtu();
+    void apply_compression();
+#ifdef USE_TUN_PUMP
+    int setup_tun_pump();
+    VpncScript *new_script(QString ifname);
+    TunPump *pump;
+    VpncScript *script;
+#endif
+#ifdef USE_NETLINK
+    int configure_native(QString ifname);
+    void start_monitor();
+    NetConfig *net;
+    NetMonitor *monitor;
+    unsigned net_changes;
+    uint64_t net_outage;
+#endif
+    QString tun_name;
+#ifdef USE_DNS_PROXY
+    void setup_dns_proxy();
+    DnsProxy *dns_proxy;
+#endif
+#ifdef USE_SCRIPT_LOG
+    ScriptLog *script_log;
+#endif
+    QByteArray script_cmd;      // must outlive the session
+
     SOCKET cmd_fd;
+    DpdTuner *dpd;
+    int compression;
+    TransportLog transport;
+    bool tunnel_up;
+    /* the mainloop returned on a pause; the reconnect is ours */
+    bool paused;
+    uint64_t pause_rx;          /* received packets at the first stats
+                                 * update after it, or -1 */
+    void channel_lost();
+    /* packets arrive again after a pause, possibly on a network change */
+    void path_restored();
+    void dead_peer();
+    QElapsedTimer session_timer;
 };
 
 #endif                          // VPNINFO_H
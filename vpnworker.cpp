@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "vpnworker.h"
+#include "vpninfo.h"
+#include "mainwindow.h"
+#include "backoff.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <errno.h>
+
+VpnWorker::VpnWorker(VpnInfo * vpninfo, MainWindow * m)
+{
+    this->vpninfo = vpninfo;
+    this->m = m;
+    this->rebuilds = 0;
+    this->rebuild_ms = 0;
+}
+
+VpnWorker::~VpnWorker()
+{
+    if (this->vpninfo != NULL)
+        delete this->vpninfo;
+}
+
+/* Called from openconnect callbacks on the session thread; executes the
+ * slot calls queued to the worker since the last time, and nothing else
+ * (no timers or deferred deletes). Such slots must be safe to run from
+ * inside a callback: they must not free what openconnect or the session
+ * uses. */
+void VpnWorker::process_commands()
+{
+    QCoreApplication::sendPostedEvents(NULL, QEvent::MetaCall);
+}
+
+/* sets up DTLS on a connected session and announces it */
+void VpnWorker::session_up()
+{
+    QString ip, ip6, dns, cstp, dtls, mtu;
+
+    if (vpninfo->dtls_connect() != 0) {
+        m->updateProgressBar(vpninfo->last_err);
+    }
+
+    vpninfo->get_info(dns, ip, ip6);
+    vpninfo->get_cipher_info(cstp, dtls);
+    vpninfo->get_mtu(mtu);
+    emit connected(dns, ip, ip6, cstp, dtls, mtu);
+
+    vpninfo->ss->save();
+}
+
+/* sleeps, while executing queued commands; false if a disconnect was
+ * requested meanwhile */
+bool VpnWorker::wait(unsigned ms)
+{
+    QElapsedTimer timer;
+
+    timer.start();
+    while (m->disconnect_requested() == false) {
+        if (timer.elapsed() >= (qint64) ms)
+            return true;
+        process_commands();
+        PinCache::instance()->expire();
+        ms_sleep(REBUILD_POLL);
+    }
+    return false;
+}
+
+/* Replaces a session that ended on its own (ret is the error of the
+ * mainloop) with a new one, from the stored profile. Returns false when
+ * the session is to end instead: the user disconnected, the profile does
+ * not reconnect, or the credentials or the server were refused. Once a
+ * rebuild has started, vpninfo is the new session, or NULL.
+ */
+bool VpnWorker::rebuild(int ret)
+{
+    Backoff backoff(REBUILD_BACKOFF_BASE, REBUILD_BACKOFF_CAP,
+                    REBUILD_BREAKER_FAILURES, REBUILD_BREAKER_COOLDOWN);
+    QElapsedTimer outage;
+    QSettings *settings;
+    StoredServer *ss;
+    QString label;
+    unsigned delay;
+    bool refused;
+
+    if (ret == -EINTR || m->disconnect_requested() == true
+        || vpninfo->ss->get_auto_reconnect() == false)
+        return false;
+
+    outage.start();
+    label = vpninfo->ss->get_label();
+    settings = vpninfo->ss->get_settings();
+
+    m->set_cmd_fd(INVALID_SOCKET);
+    delete vpninfo;
+    vpninfo = NULL;
+    emit connecting();
+
+    /* the loss itself counts, so that the first attempt is jittered too */
+    delay = backoff.failure();
+    while (1) {
+        m->updateProgressBar(QObject::tr("Reconnecting in ") +
+                             QString::number(delay) + QObject::tr(" ms"));
+        if (wait(delay) == false)
+            return false;
+
+        ss = new StoredServer(settings);
+        if (ss->load(label) < 0) {
+            m->updateProgressBar(QObject::tr("Could not reload profile: ") +
+                                 ss->last_err);
+            delete ss;
+            return false;
+        }
+
+        /* ss is now deallocated by vpninfo */
+        vpninfo = new VpnInfo(QObject::tr(APP_STRING), ss, m);
+        vpninfo->parse_url(ss->get_servername().toLocal8Bit().data());
+        if (m->set_cmd_fd(vpninfo->get_cmd_fd()) == false) {
+            delete vpninfo;
+            vpninfo = NULL;
+            return false;
+        }
+
+        m->updateProgressBar(QObject::tr("Reconnecting, attempt ") +
+                             QString::number(backoff.get_failures()));
+        if (vpninfo->connect() == 0)
+            break;
+
+        m->updateProgressBar(vpninfo->last_err);
+        refused = vpninfo->auth_refused;
+        m->set_cmd_fd(INVALID_SOCKET);
+        delete vpninfo;
+        vpninfo = NULL;
+
+        if (refused == true) {
+            m->updateProgressBar(QObject::tr
+                                 ("Authentication was refused; not reconnecting"));
+            return false;
+        }
+
+        delay = backoff.failure();
+        if (backoff.is_open() == true)
+            m->updateProgressBar(QString::number(backoff.get_failures() - 1) +
+                                 QObject::tr
+                                 (" attempts failed; trying again less often"));
+    }
+
+    rebuilds++;
+    rebuild_ms += outage.elapsed();
+    m->updateProgressBar(QObject::tr("Session re-established after ") +
+                         QString::number(backoff.get_failures()) +
+                         QObject::tr(" attempts in ") +
+                         QString::number(outage.elapsed()) +
+                         QObject::tr(" ms"));
+    session_up();
+    return true;
+}
+
+void VpnWorker::run()
+{
+    int ret;
+    QString reason;
+    bool retry = false;
+    QString oldpass, oldgroup;
+    bool reset_password = false;
+    int retries = 2;
+    bool pass_was_empty;
+
+    emit connecting();
+
+    pass_was_empty = vpninfo->ss->get_password().isEmpty();
+
+    do {
+        retry = false;
+        ret = vpninfo->connect();
+        if (ret != 0) {
+            if (retries-- <= 0)
+                goto fail;
+
+            if (pass_was_empty != true) {
+                /* authentication failed in batch mode? switch to non
+                 * batch and retry */
+                oldpass = vpninfo->ss->get_password();
+                oldgroup = vpninfo->ss->get_groupname();
+                vpninfo->ss->clear_password();
+                vpninfo->ss->clear_groupname();
+                retry = true;
+                reset_password = true;
+                m->updateProgressBar(QObject::tr
+                                     ("Authentication failed in batch mode, retrying with batch mode disabled"));
+                vpninfo->reset_vpn();
+                continue;
+            }
+
+            /* if we didn't manage to connect on a retry, the failure reason
+             * may not have been a changed password, reset it */
+            if (reset_password == true) {
+                vpninfo->ss->set_password(oldpass);
+                vpninfo->ss->set_groupname(oldgroup);
+            }
+
+            m->updateProgressBar(vpninfo->last_err);
+            goto fail;
+        }
+
+    } while (retry == true);
+
+    session_up();
+
+    do {
+        ret = vpninfo->mainloop();
+    } while (rebuild(ret) == true);
+
+    if (rebuilds > 0)
+        m->updateProgressBar(QObject::tr("Sessions re-established: ") +
+                             QString::number(rebuilds) +
+                             QObject::tr(", average time to recover ") +
+                             QString::number(rebuild_ms / rebuilds) +
+                             QObject::tr(" ms"), false);
+
+ fail:
+    /* free the session before reporting; openconnect has logged off
+     * and shut down the tun device by now */
+    if (vpninfo != NULL) {
+        reason = vpninfo->last_err;
+        delete vpninfo;
+        vpninfo = NULL;
+    }
+    PinCache::instance()->wipe();
+
+    emit disconnected(reason);
+    emit finished();
+}
+
+/* Re-reads the profile of the running session, so that settings edited
+ * while connected are not overwritten when the session saves it. This
+ * runs inside the stats callback; the session keeps its StoredServer and
+ * only takes over the edited fields.
+ */
+void VpnWorker::reconfigure()
+{
+    StoredServer *ss;
+    QString label;
+
+    if (vpninfo == NULL)
+        return;
+
+    label = vpninfo->ss->get_label();
+    ss = new StoredServer(vpninfo->ss->get_settings());
+    if (ss->load(label) < 0) {
+        m->updateProgressBar(QObject::tr("Could not reload profile: ") +
+                             ss->last_err);
+        delete ss;
+        return;
+    }
+
+    vpninfo->ss->copy_options(*ss);
+    delete ss;
+    m->updateProgressBar(QObject::tr("Profile settings reloaded"), false);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2015 Red Hat
+ *
+ * This file is part of openconnect-gui.
+ *
+ * openconnect-gui is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VPNWORKER_H
+#define VPNWORKER_H
+
+#include <QObject>
+#include <QString>
+#include <stdint.h>
+
+class VpnInfo;
+class MainWindow;
+
+/* Runs a single VPN session on its own QThread. The thread is blocked in
+ * openconnect while the tunnel is up; commands reach it through the
+ * openconnect cmd pipe, and queued slot calls are executed whenever the
+ * stats callback runs on the session thread (see process_commands()).
+ * When the profile asks for it, a session that ends on its own is
+ * replaced by a new one (see rebuild()).
+ */
+class VpnWorker:public QObject {
+ Q_OBJECT public:
+    explicit VpnWorker(VpnInfo * vpninfo, MainWindow * m);
+    ~VpnWorker();
+
+    static void process_commands();
+
+ public slots:
+    void run();
+    void reconfigure();
+
+ signals:
+    void connecting();
+    void connected(QString dns, QString ip, QString ip6,
+                   QString cstp_cipher, QString dtls_cipher, QString mtu);
+    void disconnected(QString reason);
+    void finished();
+
+ private:
+    void session_up();
+    bool rebuild(int ret);
+    bool wait(unsigned ms);
+
+    VpnInfo *vpninfo;
+    MainWindow *m;
+
+    unsigned rebuilds;          // sessions re-established
+    uint64_t rebuild_ms;        // and the time they took in total
+};
+
+#endif                          // VPNWORKER_H